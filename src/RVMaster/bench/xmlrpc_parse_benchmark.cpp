@@ -0,0 +1,126 @@
+/* Parse throughput of the XML-RPC requests RVMaster receives.
+ *
+ * Each request is parsed the way XmlRpcServerConnection used to, with
+ * XmlRpcUtil::parseTag, findTag and nextTagIs and an XmlRpcValue per
+ * parameter, and with rv::XmlRpcRequestParser. Both must yield the same
+ * method name and parameters.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "XmlRpcUtil.h"
+#include "XmlRpcValue.h"
+#include "rv/XmlRpcRequestParser.h"
+
+namespace
+{
+std::string call(std::string const& method, std::vector<std::string> const& params)
+{
+  std::string xml = "<?xml version=\"1.0\"?>\r\n<methodCall><methodName>" + method + "</methodName>\r\n<params>";
+  for (std::string const& param : params)
+  {
+    xml += "<param>" + param + "</param>";
+  }
+  return xml + "</params></methodCall>\r\n";
+}
+
+std::string str(std::string const& s)
+{
+  return "<value>" + s + "</value>";
+}
+
+struct Request
+{
+  char const* name;
+  std::string xml;
+};
+
+std::vector<Request> requests()
+{
+  // A node registering, a parameter upload and a multicall of lookups
+  std::vector<Request> result;
+  result.push_back({ "registerPublisher",
+                     call("registerPublisher", { str("/talker"), str("/chatter"), str("std_msgs/String"),
+                                                 str("http://host:40417/") }) });
+
+  std::string members;
+  for (int i = 0; i < 64; ++i)
+  {
+    members += "<member><name>gain_" + std::to_string(i) + "</name><value><double>" + std::to_string(i * 0.25) +
+               "</double></value></member><member><name>label_" + std::to_string(i) +
+               "</name><value><string>joint &amp; link " + std::to_string(i) + "</string></value></member>";
+  }
+  result.push_back({ "setParam", call("setParam", { str("/rvmaster"), str("/robot/controller"),
+                                                    "<value><struct>" + members + "</struct></value>" }) });
+
+  std::string calls;
+  for (int i = 0; i < 32; ++i)
+  {
+    calls += "<value><struct><member><name>methodName</name><value>lookupNode</value></member>"
+             "<member><name>params</name><value><array><data>" +
+             str("/rvmaster") + str("/node_" + std::to_string(i)) + "</data></array></value></member></struct></value>";
+  }
+  result.push_back({ "system.multicall",
+                     call("system.multicall", { "<value><array><data>" + calls + "</data></array></value>" }) });
+  return result;
+}
+
+std::string parseTags(std::string const& xml, XmlRpc::XmlRpcValue& params)
+{
+  int offset = 0;
+  std::string methodName = XmlRpc::XmlRpcUtil::parseTag("<methodName>", xml, &offset);
+  if (methodName.size() > 0 && XmlRpc::XmlRpcUtil::findTag("<params>", xml, &offset))
+  {
+    int nArgs = 0;
+    while (XmlRpc::XmlRpcUtil::nextTagIs("<param>", xml, &offset))
+    {
+      params[nArgs++] = XmlRpc::XmlRpcValue(xml, &offset);
+      (void)XmlRpc::XmlRpcUtil::nextTagIs("</param>", xml, &offset);
+    }
+    (void)XmlRpc::XmlRpcUtil::nextTagIs("</params>", xml, &offset);
+  }
+  return methodName;
+}
+
+std::string parseOnePass(std::string const& xml, XmlRpc::XmlRpcValue& params)
+{
+  std::string methodName;
+  rv::XmlRpcRequestParser(xml.data(), xml.data() + xml.size()).parse(methodName, params);
+  return methodName;
+}
+
+template <typename Parse>
+double run(std::string const& xml, Parse parse, int rounds)
+{
+  size_t names = 0;
+  auto const start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round)
+  {
+    XmlRpc::XmlRpcValue params;
+    names += parse(xml, params).size();
+  }
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  return names > 0 ? double(xml.size()) * rounds / elapsed.count() / 1e6 : 0.0;
+}
+}
+
+int main()
+{
+  int const rounds = 20000;
+  for (Request const& request : requests())
+  {
+    XmlRpc::XmlRpcValue expected, actual;
+    if (parseTags(request.xml, expected) != parseOnePass(request.xml, actual) || expected.toXml() != actual.toXml())
+    {
+      std::printf("%-18s parsers disagree\n", request.name);
+      return 1;
+    }
+    double const tags = run(request.xml, parseTags, rounds);
+    double const onePass = run(request.xml, parseOnePass, rounds);
+    std::printf("%-18s %6zu bytes  tags %8.1f MB/s  one pass %8.1f MB/s  (%.2fx)\n", request.name,
+                request.xml.size(), tags, onePass, onePass / tags);
+  }
+  return 0;
+}
@@ -99,11 +99,16 @@ namespace rv {
     const std::string &getUri()  { return _uri; }
     int getPort() const { return _port; }
     
-    // The xml-encoded request, http header of response, and response xml
+    // The xml-encoded request, and the http header and xml of the response
     std::string _request;
-    std::string _header;
     std::string _response;
 
+    // Where the xml starts in _response
+    size_t _bodyOffset;
+
+    // Decaying peak of the response sizes, see XmlRpcSocket::recycle
+    size_t _responseHighWater;
+
     // Number of times the client has attempted to send the request
     int _sendAttempts;
 
@@ -116,9 +121,9 @@ namespace rv {
 
     // True if the server closed the connection
     bool _eof;
-
-    // True if a fault response was returned by the server
-    bool _isFault;
+
+    // True if a fault response was returned by the server
+    bool _isFault;
 
     // Number of bytes expected in the response body (parsed from response header)
     int _contentLength;
@@ -12,6 +12,7 @@
 
 #ifndef MAKEDEPEND
 # include <list>
+# include <unordered_map>
 #endif
 
 namespace rv {
@@ -23,29 +24,64 @@ namespace rv {
   //! callbacks when interesting events happen.
   class XMLRPCPP_DECL XmlRpcDispatch {
   public:
-    //! Constructor
+    //! How work() waits for events
+    enum Backend {
+      SelectBackend,    //!< select(), limited to descriptors below FD_SETSIZE
+      EpollBackend,     //!< level-triggered epoll
+      EpollEdgeBackend  //!< edge-triggered epoll, for sources that drain their socket on each event
+    };
+
+    //! Constructor, with the default backend
     XmlRpcDispatch();
+    //! Constructor. Falls back to select() if the backend is not available.
+    explicit XmlRpcDispatch(Backend backend);
     ~XmlRpcDispatch();
 
+    //! The backend of dispatchers constructed from now on. Defaults to
+    //! EpollBackend when built with RV_XMLRPC_EPOLL.
+    static void setDefaultBackend(Backend backend);
+    static Backend getDefaultBackend();
+
+    Backend getBackend() const { return _backend; }
+
     //! Values indicating the type of events a source is interested in
     enum EventType {
       ReadableEvent = 1,    //!< data available to read
       WritableEvent = 2,    //!< connected/data can be written without blocking
       Exception     = 4     //!< uh oh
     };
-    
+
+    // A source to monitor and what to monitor it for
+    struct MonitoredSource {
+      MonitoredSource(XmlRpcSource* src, unsigned mask) : _src(src), _mask(mask), _fd(-1), _fdChanges(0) {}
+      XmlRpcSource* getSource() const { return _src; }
+      unsigned& getMask() { return _mask; }
+      XmlRpcSource* _src;   // 0 once removed
+      unsigned _mask;
+      int _fd;              // The descriptor registered with epoll, or -1
+      unsigned _fdChanges;  // The source's getFdChanges() when _fd was registered
+    };
+
+    // A list of sources to monitor
+    typedef std::list< MonitoredSource > SourceList;
+
+    //! Identifies a monitored source until it is removed
+    typedef SourceList::iterator SourceHandle;
+
     //! Monitor this source for the event types specified by the event mask
     //! and call its event handler when any of the events occur.
     //!  @param source The source to monitor
     //!  @param eventMask Which event types to watch for. \see EventType
-    void addSource(XmlRpcSource* source, unsigned eventMask);
+    SourceHandle addSource(XmlRpcSource* source, unsigned eventMask);
 
     //! Stop monitoring this source.
     //!  @param source The source to stop monitoring
     void removeSource(XmlRpcSource* source);
+    void removeSource(SourceHandle handle);
 
     //! Modify the types of events to watch for on this source
     void setSourceEvents(XmlRpcSource* source, unsigned eventMask);
+    void setSourceEvents(SourceHandle handle, unsigned eventMask);
 
 
     //! Watch current set of sources and process events for the specified
@@ -61,21 +97,35 @@ namespace rv {
     // helper
     double getTime();
 
-    // A source to monitor and what to monitor it for
-    struct MonitoredSource {
-      MonitoredSource(XmlRpcSource* src, unsigned mask) : _src(src), _mask(mask) {}
-      XmlRpcSource* getSource() const { return _src; }
-      unsigned& getMask() { return _mask; }
-      XmlRpcSource* _src;
-      unsigned _mask;
-    };
-
-    // A list of sources to monitor
-    typedef std::list< MonitoredSource > SourceList; 
-
     // Sources being monitored
     SourceList _sources;
   protected:
+    XmlRpcDispatch(XmlRpcDispatch const&) = delete;
+    XmlRpcDispatch& operator=(XmlRpcDispatch const&) = delete;
+
+    // Wait once for events and handle them. Returns false on error.
+    bool waitSelect(double timeout);
+    bool waitEpoll(double timeout);
+
+    // Call the handler of source for events and apply the mask it returns
+    void handleEvents(XmlRpcSource* source, unsigned events);
+
+    // Bring the epoll registration of a source in line with its fd and mask
+    void updateRegistration(MonitoredSource& monitored);
+
+    // Close and stop monitoring all sources
+    void closeAll();
+
+    // The entry of each source, for constant time lookups
+    typedef std::unordered_map< XmlRpcSource*, SourceHandle > SourceIndex;
+    SourceIndex _index;
+
+    // Sources removed during work(). Events collected before may still
+    // point to them, so they are only freed once those are handled.
+    SourceList _removed;
+
+    Backend _backend;
+    int _epollFd;
 
     // When work should stop (-1 implies wait forever, or until exit is called)
     double _endTime;
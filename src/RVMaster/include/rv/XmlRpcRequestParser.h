@@ -0,0 +1,67 @@
+#ifndef RVCPP_XMLRPCREQUESTPARSER_H_
+#define RVCPP_XMLRPCREQUESTPARSER_H_
+
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <cstddef>
+# include <string>
+#endif
+
+#include "XmlRpcValue.h"
+#include "XmlRpcDecl.h"
+
+namespace rv {
+
+  //! Parses a methodCall document in one pass over the received bytes.
+  //!
+  //! Each value is decoded straight from the buffer into its place in the
+  //! parameters, so no substrings of the request or temporary values are
+  //! made on the way. The buffer is only read and may be reused once
+  //! parse() returns.
+  class XMLRPCPP_DECL XmlRpcRequestParser {
+  public:
+    //! Parse the request in [begin, end)
+    XmlRpcRequestParser(const char* begin, const char* end);
+
+    //! Parse the method name and the parameters. Returns false if the
+    //! request is malformed, leaving what was parsed up to there.
+    bool parse(std::string& methodName, XmlRpc::XmlRpcValue& params);
+
+    //! The number of bytes parsed
+    size_t offset() const { return _cp - _begin; }
+
+  protected:
+
+    void skipSpace();
+
+    // Skip whitespace, then consume tag if it is next
+    bool nextTagIs(const char* tag, size_t length);
+    template <size_t N>
+    bool nextTagIs(const char (&tag)[N]) { return nextTagIs(tag, N - 1); }
+
+    // Consume the closing tag of the element named [name, name + length)
+    bool closeTag(const char* name, size_t length);
+
+    // The character data up to the next tag
+    const char* text();
+
+    bool parseValue(XmlRpc::XmlRpcValue& value);
+    bool parseTypedValue(const char* type, size_t length, bool empty, XmlRpc::XmlRpcValue& value);
+    bool parseArray(XmlRpc::XmlRpcValue& value);
+    bool parseStruct(XmlRpc::XmlRpcValue& value);
+
+    // Append the character data in [begin, end) to s, replacing entities
+    static void decode(const char* begin, const char* end, std::string& s);
+    static bool decodeBase64(const char* begin, const char* end, XmlRpc::XmlRpcValue& value);
+
+    const char* _begin;
+    const char* _cp;
+    const char* _end;
+  };
+
+} // namespace rv
+
+#endif // RVCPP_XMLRPCREQUESTPARSER_H_
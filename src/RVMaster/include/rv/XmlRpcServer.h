@@ -13,7 +13,10 @@
 
 #ifndef MAKEDEPEND
 # include <map>
+# include <memory>
+# include <mutex>
 # include <string>
+# include <vector>
 #endif
 
 #include "rv/XmlRpcDispatch.h"
@@ -55,6 +58,32 @@ namespace rv {
     //! Look up a method by name
     XmlRpcServerMethod2* findMethod(const std::string& name) const;
 
+    // Collection of methods. This could be a set keyed on method name if we wanted...
+    typedef std::map< std::string, XmlRpcServerMethod2* > MethodMap;
+    typedef std::shared_ptr<const MethodMap> MethodTable;
+
+    //! The methods as of now. Adding and removing methods replaces the table
+    //! instead of changing it, and removeMethod waits until no older table
+    //! listing the removed method is held, unless a method calls it, so the
+    //! methods in a table stay valid while it is held.
+    MethodTable getMethods() const;
+
+    //! Execute the named method, holding the method table meanwhile. Returns
+    //! false if there is no such method.
+    bool executeMethod(const std::string& name, XmlRpc::XmlRpcValue& params,
+                       rv::ClientInfo& ci, XmlRpc::XmlRpcValue& result);
+
+    //! Execute methods on this many worker threads instead of in work(), so
+    //! that a slow method does not hold up other clients. Requests are still
+    //! read and responses written in work(). 0, the default, executes them in
+    //! work(). Call while work() is not running. Requests the previous workers
+    //! had not taken run on the calling thread.
+    void setWorkerThreads(unsigned count);
+
+    //! Execute the request of conn on a worker if there are any. Returns
+    //! false if it should be executed right away instead.
+    bool executeAsync(XmlRpcServerConnection* conn);
+
     //! Create a socket, bind to the specified port, and
     //! set it in listen mode to make it available for clients.
     bool bindAndListen(int port, int backlog = 5);
@@ -92,8 +121,8 @@ namespace rv {
 
   protected:
 
-    //! Accept a client connection request
-    virtual void acceptConnection();
+    //! Accept a client connection request. Returns false if none was pending.
+    virtual bool acceptConnection();
 
     //! Create a new connection object for processing requests from a specific client.
     virtual XmlRpcServerConnection* createConnection(int socket);
@@ -104,9 +133,19 @@ namespace rv {
     // Event dispatcher
     XmlRpcDispatch _disp;
 
-    // Collection of methods. This could be a set keyed on method name if we wanted...
-    typedef std::map< std::string, XmlRpcServerMethod2* > MethodMap;
-    MethodMap _methods;
+    // Replace the method table with updated. Called with _methodsMutex held.
+    void publishMethods(std::shared_ptr<MethodMap> updated);
+
+    // The current methods, read with std::atomic_load
+    MethodTable _methods;
+    // Serializes changes to the methods
+    std::mutex _methodsMutex;
+    // Tables replaced since, which may still be in use
+    std::vector< std::weak_ptr<const MethodMap> > _retiredMethods;
+
+    // Runs requests off the work() thread, see setWorkerThreads
+    class WorkerPool;
+    WorkerPool* _workers;
 
     // system methods
     XmlRpcServerMethod2* _listMethods;
@@ -49,6 +49,13 @@ namespace rv {
     //!   @param eventType Type of IO event that occurred. @see XmlRpcDispatch::EventType.
     virtual unsigned handleEvent(unsigned eventType);
 
+    //! Run the parsed request and generate the response, on a worker thread
+    //! if the server has any. No IO happens meanwhile.
+    void runRequest();
+
+    //! Start writing the response generated by runRequest, in work()
+    void responseReady();
+
   protected:
 
     bool readHeader();
@@ -58,8 +65,13 @@ namespace rv {
     // Parses the request, runs the method, generates the response xml.
     virtual void executeRequest();
 
-    // Parse the methodName and parameters from the request.
-    std::string parseRequest(XmlRpc::XmlRpcValue& params);
+    // Parse the request and look up the client, in work(). Returns false,
+    // with a fault response ready to write, if the request is malformed.
+    bool prepareRequest();
+
+    // Parse the methodName and parameters from the request. Returns false if
+    // it is malformed.
+    bool parseRequest(std::string& methodName, XmlRpc::XmlRpcValue& params);
 
     // Execute a named method with the specified params.
     bool executeMethod(const std::string& methodName, XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result);
@@ -67,28 +79,45 @@ namespace rv {
     // Execute multiple calls and return the results in an array.
     bool executeMulticall(const std::string& methodName, XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result);
 
-    // Construct a response from the result XML.
-    void generateResponse(std::string const& resultXml);
+    // Construct a response from the result.
+    void generateResponse(XmlRpc::XmlRpcValue& result);
     void generateFaultResponse(std::string const& msg, int errorCode = -1);
-    std::string generateHeader(std::string const& body);
+    void generateHeader(size_t bodyLength);
 
 
     // The XmlRpc server that accepted this connection
     XmlRpcServer* _server;
     // Possible IO states for the connection
-    enum ServerConnectionState { READ_HEADER, READ_REQUEST, WRITE_RESPONSE };
+    enum ServerConnectionState { READ_HEADER, READ_REQUEST, EXECUTE_REQUEST, WRITE_RESPONSE };
     ServerConnectionState _connectionState;
 
-    // Request headers
-    std::string _header;
-
     // Number of bytes expected in the request body (parsed from header)
     int _contentLength;
 
-    // Request body
+    // Request headers and body, as received. Cleared but not freed after
+    // each response, so a keep-alive connection reads into the same buffer.
     std::string _request;
 
-    // Response
+    // Where the body starts in _request
+    size_t _bodyOffset;
+
+    // Decaying peak of the request sizes, see XmlRpcSocket::recycle
+    size_t _requestHighWater;
+
+    // The parsed request, until it has run
+    std::string _methodName;
+    XmlRpc::XmlRpcValue _params;
+
+    // Response: the http header, then the body between a constant prologue
+    // and epilogue, written together with writev
+    char _responseHeader[128];
+    int _responseHeaderLength;
+    const char* _responsePrologue;
+    const char* _responseEpilogue;
+    // The body, in _response or a pre-rendered template
+    const std::string* _responseBody;
+
+    // Serialized result. Cleared but not freed after each response.
     std::string _response;
 
     // Number of bytes of the response written so far
@@ -18,6 +18,8 @@
 #include "XmlRpcDecl.h"
 #include "rv/callInfo.h"
 
+struct iovec;
+
 namespace rv {
 
   //! A platform-independent socket API.
@@ -37,11 +39,26 @@ namespace rv {
     static bool setNonBlocking(int socket);
 
     //! Read text from the specified socket. Returns false on error.
-    static bool nbRead(int socket, std::string& s, bool *eof);
+    //! Appends to s, reading straight into its tail. Once the caller knows
+    //! that the message will take expected bytes of s, s is sized for it up
+    //! front instead of growing as the message arrives.
+    static bool nbRead(int socket, std::string& s, bool *eof, size_t expected = 0);
+
+    //! Empty s for the next message. s keeps its memory for keep-alive
+    //! connections, unless that is well beyond *highWater, the decaying
+    //! peak of recent messages, or beyond MAX_IDLE_BUFFER.
+    static void recycle(std::string& s, size_t *highWater);
+    static const size_t MAX_IDLE_BUFFER = 1 << 20;
 
     //! Write text to the specified socket. Returns false on error.
     static bool nbWrite(int socket, std::string& s, int *bytesSoFar);
 
+    //! Write count buffers, one after the other, to the specified socket in
+    //! one writev, skipping the first *bytesSoFar bytes. count is at most
+    //! MAX_WRITE_PARTS. Returns false on error.
+    static bool nbWrite(int socket, const struct iovec* parts, int count, int *bytesSoFar);
+    static const int MAX_WRITE_PARTS = 8;
+
 
     // The next four methods are appropriate for servers.
 
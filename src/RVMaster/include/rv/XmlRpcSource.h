@@ -27,7 +27,10 @@ namespace rv {
     //! Return the file descriptor being monitored.
     int getfd() const { return _fd; }
     //! Specify the file descriptor to monitor.
-    void setfd(int fd) { _fd = fd; }
+    void setfd(int fd) { _fd = fd; ++_fdChanges; }
+    //! How often setfd was called, which tells a new descriptor from a
+    //! closed one whose number it reuses.
+    unsigned getFdChanges() const { return _fdChanges; }
     ClientInfo getClientInfo() {return ci;};
     //! Return whether the file descriptor should be kept open if it is no longer monitored.
     bool getKeepOpen() const { return _keepOpen; }
@@ -46,6 +49,7 @@ namespace rv {
 
     // Socket. This should really be a SOCKET (an alias for unsigned int*) on windows...
     int _fd;
+    unsigned _fdChanges;
 
     // In the server, a new source (XmlRpcServerConnection) is created
     // for each connected client. When each connection is closed, the
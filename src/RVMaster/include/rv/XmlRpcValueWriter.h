@@ -0,0 +1,32 @@
+#ifndef RVCPP_XMLRPCVALUEWRITER_H_
+#define RVCPP_XMLRPCVALUEWRITER_H_
+
+#if defined(_MSC_VER)
+# pragma warning(disable:4786)    // identifier was truncated in debug info
+#endif
+
+#ifndef MAKEDEPEND
+# include <string>
+#endif
+
+#include "XmlRpcValue.h"
+#include "XmlRpcDecl.h"
+
+namespace rv {
+
+  //! Serializes values as XmlRpcValue::toXml does, but appends to a buffer
+  //! the caller keeps instead of returning a new string for every value.
+  class XMLRPCPP_DECL XmlRpcValueWriter {
+  public:
+    //! Append the xml of value to xml
+    static void append(XmlRpc::XmlRpcValue& value, std::string& xml);
+
+  protected:
+    // Append s to xml, replacing the characters xml reserves with entities
+    static void appendEncoded(const std::string& s, std::string& xml);
+    static void appendBase64(const XmlRpc::XmlRpcValue::BinaryData& data, std::string& xml);
+  };
+
+} // namespace rv
+
+#endif // RVCPP_XMLRPCVALUEWRITER_H_
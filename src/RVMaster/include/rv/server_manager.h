@@ -51,6 +51,8 @@ public:
   bool hasParamCallback(XmlRpc::XmlRpcValue& params, ClientInfo& ci, XmlRpc::XmlRpcValue& result);
 
   bool isMonitored(std::string const& topic);
+  /* Whether a node hosts a monitor, whose publishers are never redirected */
+  bool isMonitorNode(std::string const& node_name);
 
 private:
   bool requestTopic(const std::string& topic, XmlRpc::XmlRpcValue& protos, XmlRpc::XmlRpcValue& ret);
@@ -102,6 +102,12 @@ public:
   bool bind(const std::string& function_name, const XMLRPCFunc& cb);
   void unbind(const std::string& function_name);
 
+  /**
+   * @brief Execute bound functions on this many threads instead of the server
+   * thread, 0 to execute them on the server thread. Call before start().
+   */
+  void setWorkerThreads(unsigned count) { worker_threads_ = count; }
+
   void start();
   void shutdown();
 
@@ -112,6 +118,7 @@ private:
 
   std::string uri_;
   int port_;
+  unsigned worker_threads_;
   boost::thread server_thread_;
 
 #if defined(__APPLE__)
@@ -144,8 +151,6 @@ private:
   typedef std::map<std::string, FunctionInfo> M_StringToFuncInfo;
   boost::mutex functions_mutex_;
   M_StringToFuncInfo functions_;
-
-  volatile bool unbind_requested_;
 };
 
 }
@@ -2,6 +2,7 @@
 #include "rv/xmlrpc_manager.h"
 #include "rv/server_manager.h"
 #include "rv/master.h"
+#include "rv/XmlRpcDispatch.h"
 
 #include "ros/duration.h"
 #include <string>
@@ -10,10 +11,13 @@
 
 namespace rv { namespace monitor {
   extern std::set<std::string> monitorTopics;
+  extern std::set<std::string> monitorNodes;
 }}
 
 int main(int argc, char **argv)
 {
+  // Applied once the XML-RPC manager exists, after parsing
+  int xmlrpc_workers = -1;
   std::cerr << "Parsing args" << std::endl;
   for (int i = 1; i < argc; i++) {
     std::cerr << "i: " << i << std::endl;
@@ -24,9 +28,38 @@ int main(int argc, char **argv)
       if (i == argc) throw std::runtime_error("--monitor-topic requires one argument");
       rv::monitor::monitorTopics.insert(argv[i]);
     }
+    // Nodes hosting monitors besides /rvmonitor, e.g. nodelet managers
+    else if (argv[i] == std::string("--monitor-node")) {
+      i++;
+      if (i == argc) throw std::runtime_error("--monitor-node requires one argument");
+      rv::monitor::monitorNodes.insert(argv[i]);
+    }
+    // How the XML-RPC server and clients wait for their sockets
+    else if (argv[i] == std::string("--xmlrpc-dispatch")) {
+      i++;
+      if (i == argc) throw std::runtime_error("--xmlrpc-dispatch requires one argument");
+      std::string backend = argv[i];
+      if (backend == "select")
+        rv::XmlRpcDispatch::setDefaultBackend(rv::XmlRpcDispatch::SelectBackend);
+      else if (backend == "epoll")
+        rv::XmlRpcDispatch::setDefaultBackend(rv::XmlRpcDispatch::EpollBackend);
+      else if (backend == "epoll-et")
+        rv::XmlRpcDispatch::setDefaultBackend(rv::XmlRpcDispatch::EpollEdgeBackend);
+      else
+        throw std::runtime_error("--xmlrpc-dispatch must be select, epoll or epoll-et");
+    }
+    // Threads executing XML-RPC calls, 0 to execute them on the server thread
+    else if (argv[i] == std::string("--xmlrpc-workers")) {
+      i++;
+      if (i == argc) throw std::runtime_error("--xmlrpc-workers requires one argument");
+      xmlrpc_workers = std::stoi(argv[i]);
+      if (xmlrpc_workers < 0) throw std::runtime_error("--xmlrpc-workers must not be negative");
+    }
   }
 
   boost::shared_ptr<rv::XMLRPCManager> xmlrpc_manager_ = rv::XMLRPCManager::instance();
+  if (xmlrpc_workers >= 0)
+    xmlrpc_manager_->setWorkerThreads(xmlrpc_workers);
   boost::shared_ptr<rv::ServerManager> server_manager_ = rv::ServerManager::instance();
 
   ros::M_string remappings;
@@ -18,6 +18,7 @@ namespace rv
 
 namespace monitor {
   std::set<std::string> monitorTopics;
+  std::set<std::string> monitorNodes = { "/rvmonitor" };
 }
 
 // TODO: Fix project structure
@@ -32,6 +33,10 @@ bool ServerManager::isMonitored(std::string const& topic) {
   return rv::monitor::monitorTopics.find(topic) != rv::monitor::monitorTopics.end();
 }
 
+bool ServerManager::isMonitorNode(std::string const& node_name) {
+  return rv::monitor::monitorNodes.find(node_name) != rv::monitor::monitorNodes.end();
+}
+
 ServerManagerPtr g_server_manager;
 boost::mutex g_server_manager_mutex;
 
@@ -604,7 +609,7 @@ bool ServerManager::registerPublisherCallback(XmlRpc::XmlRpcValue& params, Clien
 
   ROS_INFO("Node %s trying to publish to topic %s from %s", node_name.c_str(), topic.c_str(), ci.ip.c_str());
   bool is_monitored = isMonitored(topic);
-  if (is_monitored && node_name != "/rvmonitor") {
+  if (is_monitored && !isMonitorNode(node_name)) {
     string monitor_topic = getMonitorSubscribedTopicForTopic(topic);
     ROS_INFO("Topic %s is monitored. Registering to %s instead.", topic.c_str(), monitor_topic.c_str());
     topic = monitor_topic;
@@ -99,8 +99,8 @@ const XMLRPCManagerPtr& XMLRPCManager::instance()
 
 XMLRPCManager::XMLRPCManager()
 : port_(0)
+, worker_threads_(4)
 , shutting_down_(false)
-, unbind_requested_(false)
 {
 }
 
@@ -153,6 +153,7 @@ void XMLRPCManager::start()
   ROS_ASSERT(bound);
   port_ = server_.get_port();
   ROS_ASSERT(port_ != 0);
+  server_.setWorkerThreads(worker_threads_);
 
 
 //  ROS_INFO("reach point debug2");
@@ -176,6 +177,8 @@ void XMLRPCManager::shutdown()
   shutting_down_ = true;
   server_thread_.join();
 
+  // Lets the functions still executing finish
+  server_.setWorkerThreads(0);
   server_.close();
 
   // kill the last few clients that were started in the shutdown process
@@ -283,16 +286,9 @@ void XMLRPCManager::serverThreadFunc()
     }
 
 
-    // Update the XMLRPC server, blocking for at most 100ms in select()
-    {
-      boost::mutex::scoped_lock lock(functions_mutex_);
-      server_.work(0.1);
-    }
-
-    while (unbind_requested_)
-    {
-      ros::WallDuration(0.01).sleep();
-    }
+    // Update the XMLRPC server, blocking for at most 100ms in select().
+    // Functions may be bound and unbound meanwhile, see XmlRpcServer::getMethods
+    server_.work(0.1);
 
     if (shutting_down_)
     {
@@ -428,9 +424,18 @@ bool XMLRPCManager::bind(const std::string& function_name, const XMLRPCFunc& cb)
 
 void XMLRPCManager::unbind(const std::string& function_name)
 {
-  unbind_requested_ = true;
-  boost::mutex::scoped_lock lock(functions_mutex_);
-  functions_.erase(function_name);
-  unbind_requested_ = false;
+  FunctionInfo info;
+  {
+    boost::mutex::scoped_lock lock(functions_mutex_);
+    M_StringToFuncInfo::iterator it = functions_.find(function_name);
+    if (it == functions_.end())
+    {
+      return;
+    }
+    info = it->second;
+    functions_.erase(it);
+  }
+  // Removing the wrapper waits for the calls of it still executing
+  info.wrapper.reset();
 }
 } //namespace rv
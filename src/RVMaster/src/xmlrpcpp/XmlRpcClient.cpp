@@ -42,6 +42,8 @@ XmlRpcClient::XmlRpcClient(const char* host, int port, const char* uri/*=0*/)
   _connectionState = NO_CONNECTION;
   _executing = false;
   _eof = false;
+  _bodyOffset = 0;
+  _responseHighWater = 0;
 
   // Default to keeping the connection open until an explicit close is done
   setKeepOpen();
@@ -109,7 +111,6 @@ XmlRpcClient::execute(const char* method, XmlRpc::XmlRpcValue const& params, Xml
     return false;
 
   XmlRpc::XmlRpcUtil::log(1, "XmlRpcClient::execute: method %s completed.", method);
-  _response = "";
   return true;
 }
 
@@ -155,7 +156,6 @@ XmlRpcClient::executeCheckDone(XmlRpc::XmlRpcValue& result)
     // Hopefully the caller can determine that parsing failed.
   }
   //XmlRpcUtil::log(1, "XmlRpcClient::execute: method %s completed.", method);
-  _response = "";
   return true;
 }
 
@@ -331,8 +331,8 @@ XmlRpcClient::writeRequest()
 
   // Wait for the result
   if (_bytesWritten == int(_request.length())) {
-    _header = "";
-    _response = "";
+    _response.clear();
+    _bodyOffset = 0;
     _connectionState = READ_HEADER;
   }
   return true;
@@ -344,12 +344,12 @@ bool
 XmlRpcClient::readHeader()
 {
   // Read available data
-  if ( ! XmlRpcSocket::nbRead(this->getfd(), _header, &_eof) ||
-       (_eof && _header.length() == 0)) {
+  if ( ! XmlRpcSocket::nbRead(this->getfd(), _response, &_eof) ||
+       (_eof && _response.length() == 0)) {
 
     // If we haven't read any data yet and this is a keep-alive connection, the server may
     // have timed out, so we try one more time.
-    if (getKeepOpen() && _header.length() == 0 && _sendAttempts++ == 0) {
+    if (getKeepOpen() && _response.length() == 0 && _sendAttempts++ == 0) {
       XmlRpc::XmlRpcUtil::log(4, "XmlRpcClient::readHeader: re-trying connection");
       XmlRpcSource::close();
       _connectionState = NO_CONNECTION;
@@ -362,10 +362,10 @@ XmlRpcClient::readHeader()
     return false;
   }
 
-  XmlRpc::XmlRpcUtil::log(4, "XmlRpcClient::readHeader: client has read %d bytes", _header.length());
+  XmlRpc::XmlRpcUtil::log(4, "XmlRpcClient::readHeader: client has read %d bytes", _response.length());
 
-  char *hp = (char*)_header.c_str();  // Start of header
-  char *ep = hp + _header.length();   // End of string
+  char *hp = (char*)_response.c_str(); // Start of header
+  char *ep = hp + _response.length();  // End of string
   char *bp = 0;                       // Start of body
   char *lp = 0;                       // Start of content-length value
 
@@ -403,9 +403,9 @@ XmlRpcClient::readHeader()
   	
   XmlRpc::XmlRpcUtil::log(4, "client read content length: %d", _contentLength);
 
-  // Otherwise copy non-header data to response buffer and set state to read response.
-  _response = bp;
-  _header = "";   // should parse out any interesting bits from the header (connection, etc)...
+  // The xml follows in the same buffer. Should parse out any interesting bits
+  // from the header (connection, etc)...
+  _bodyOffset = bp - hp;
   _connectionState = READ_RESPONSE;
   return true;    // Continue monitoring this source
 }
@@ -415,14 +415,14 @@ bool
 XmlRpcClient::readResponse()
 {
   // If we dont have the entire response yet, read available data
-  if (int(_response.length()) < _contentLength) {
-    if ( ! XmlRpcSocket::nbRead(this->getfd(), _response, &_eof)) {
+  if (int(_response.length() - _bodyOffset) < _contentLength) {
+    if ( ! XmlRpcSocket::nbRead(this->getfd(), _response, &_eof, _bodyOffset + _contentLength)) {
       XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::readResponse: read error (%s).",XmlRpcSocket::getErrorMsg().c_str());
       return false;
     }
 
     // If we haven't gotten the entire _response yet, return (keep reading)
-    if (int(_response.length()) < _contentLength) {
+    if (int(_response.length() - _bodyOffset) < _contentLength) {
       if (_eof) {
         XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::readResponse: EOF while reading response");
         return false;
@@ -432,8 +432,8 @@ XmlRpcClient::readResponse()
   }
 
   // Otherwise, parse and return the result
-  XmlRpc::XmlRpcUtil::log(3, "XmlRpcClient::readResponse (read %d bytes)", _response.length());
-  XmlRpc::XmlRpcUtil::log(5, "response:\n%s", _response.c_str());
+  XmlRpc::XmlRpcUtil::log(3, "XmlRpcClient::readResponse (read %d bytes)", _response.length() - _bodyOffset);
+  XmlRpc::XmlRpcUtil::log(5, "response:\n%s", _response.c_str() + _bodyOffset);
 
   _connectionState = IDLE;
 
@@ -446,9 +446,9 @@ bool
 XmlRpcClient::parseResponse(XmlRpc::XmlRpcValue& result)
 {
   // Parse response xml into result
-  int offset = 0;
+  int offset = int(_bodyOffset);
   if ( ! XmlRpc::XmlRpcUtil::findTag(METHODRESPONSE_TAG,_response,&offset)) {
-    XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no methodResponse. Response:\n%s", _response.c_str());
+    XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no methodResponse. Response:\n%s", _response.c_str() + _bodyOffset);
     return false;
   }
 
@@ -458,17 +458,17 @@ XmlRpcClient::parseResponse(XmlRpc::XmlRpcValue& result)
       (XmlRpc::XmlRpcUtil::nextTagIs(FAULT_TAG,_response,&offset) && (_isFault = true)))
   {
     if ( ! result.fromXml(_response, &offset)) {
-      XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response value. Response:\n%s", _response.c_str());
-      _response = "";
+      XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response value. Response:\n%s", _response.c_str() + _bodyOffset);
+      XmlRpcSocket::recycle(_response, &_responseHighWater);
       return false;
     }
   } else {
-    XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no param or fault tag. Response:\n%s", _response.c_str());
-    _response = "";
+    XmlRpc::XmlRpcUtil::error("Error in XmlRpcClient::parseResponse: Invalid response - no param or fault tag. Response:\n%s", _response.c_str() + _bodyOffset);
+    XmlRpcSocket::recycle(_response, &_responseHighWater);
     return false;
   }
       
-  _response = "";
+  XmlRpcSocket::recycle(_response, &_responseHighWater);
   return result.valid();
 }
 
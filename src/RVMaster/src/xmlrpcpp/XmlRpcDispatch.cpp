@@ -5,7 +5,9 @@
 
 #include <math.h>
 #include <errno.h>
+#include <string.h>
 #include <sys/timeb.h>
+#include <vector>
 
 #if defined(_WINDOWS)
 # include <winsock2.h>
@@ -19,40 +21,115 @@
 # include <sys/time.h>
 #endif  // _WINDOWS
 
+#if defined(RV_XMLRPC_EPOLL)
+# include <sys/epoll.h>
+# include <unistd.h>
+#endif
+
 
 using namespace rv;
 
 
+#if defined(RV_XMLRPC_EPOLL)
+static XmlRpcDispatch::Backend s_defaultBackend = XmlRpcDispatch::EpollBackend;
+
+// At most this many events are handled per epoll_wait
+static const int MAX_EPOLL_EVENTS = 256;
+#else
+static XmlRpcDispatch::Backend s_defaultBackend = XmlRpcDispatch::SelectBackend;
+#endif
+
+
 XmlRpcDispatch::XmlRpcDispatch()
+  : XmlRpcDispatch(s_defaultBackend)
 {
+}
+
+
+XmlRpcDispatch::XmlRpcDispatch(Backend backend)
+{
+  _backend = SelectBackend;
+  _epollFd = -1;
   _endTime = -1.0;
   _doClear = false;
   _inWork = false;
+
+#if defined(RV_XMLRPC_EPOLL)
+  if (backend != SelectBackend)
+  {
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+      XmlRpc::XmlRpcUtil::error("XmlRpcDispatch: epoll_create1 failed (%s), using select.", strerror(errno));
+    else
+      _backend = backend;
+  }
+#else
+  (void) backend;
+#endif
 }
 
 
 XmlRpcDispatch::~XmlRpcDispatch()
 {
+#if defined(RV_XMLRPC_EPOLL)
+  if (_epollFd >= 0)
+    ::close(_epollFd);
+#endif
 }
 
+
+void
+XmlRpcDispatch::setDefaultBackend(Backend backend)
+{
+  s_defaultBackend = backend;
+}
+
+
+XmlRpcDispatch::Backend
+XmlRpcDispatch::getDefaultBackend()
+{
+  return s_defaultBackend;
+}
+
+
 // Monitor this source for the specified events and call its event handler
 // when the event occurs
-void
+XmlRpcDispatch::SourceHandle
 XmlRpcDispatch::addSource(XmlRpcSource* source, unsigned mask)
 {
-  _sources.push_back(MonitoredSource(source, mask));
+  SourceIndex::iterator found = _index.find(source);
+  if (found != _index.end())
+  {
+    setSourceEvents(found->second, mask);
+    return found->second;
+  }
+  SourceHandle handle = _sources.insert(_sources.end(), MonitoredSource(source, mask));
+  _index[source] = handle;
+  updateRegistration(*handle);
+  return handle;
 }
 
 // Stop monitoring this source. Does not close the source.
 void
 XmlRpcDispatch::removeSource(XmlRpcSource* source)
 {
-  for (SourceList::iterator it=_sources.begin(); it!=_sources.end(); ++it)
-    if (it->getSource() == source)
-    {
-      _sources.erase(it);
-      break;
-    }
+  SourceIndex::iterator found = _index.find(source);
+  if (found != _index.end())
+    removeSource(found->second);
+}
+
+
+void
+XmlRpcDispatch::removeSource(SourceHandle handle)
+{
+  _index.erase(handle->getSource());
+  handle->getMask() = 0;
+  updateRegistration(*handle);
+  handle->_src = 0;
+  if (_inWork)
+    _removed.splice(_removed.end(), _sources, handle);
+  else
+    _sources.erase(handle);
 }
 
 
@@ -60,15 +137,67 @@ XmlRpcDispatch::removeSource(XmlRpcSource* source)
 void 
 XmlRpcDispatch::setSourceEvents(XmlRpcSource* source, unsigned eventMask)
 {
-  for (SourceList::iterator it=_sources.begin(); it!=_sources.end(); ++it)
-    if (it->getSource() == source)
-    {
-      it->getMask() = eventMask;
-      break;
-    }
+  SourceIndex::iterator found = _index.find(source);
+  if (found != _index.end())
+    setSourceEvents(found->second, eventMask);
 }
 
 
+void
+XmlRpcDispatch::setSourceEvents(SourceHandle handle, unsigned eventMask)
+{
+  if (handle->getMask() == eventMask && handle->_fd == handle->getSource()->getfd() &&
+      handle->_fdChanges == handle->getSource()->getFdChanges())
+    return;
+  handle->getMask() = eventMask;
+  updateRegistration(*handle);
+}
+
+
+void
+XmlRpcDispatch::updateRegistration(MonitoredSource& monitored)
+{
+#if defined(RV_XMLRPC_EPOLL)
+  if (_epollFd < 0)
+    return;
+
+  int fd = monitored.getSource() ? monitored.getSource()->getfd() : -1;
+  unsigned changes = monitored.getSource() ? monitored.getSource()->getFdChanges() : 0;
+  unsigned mask = monitored.getMask();
+  // A new descriptor may reuse the number of the closed one, whose
+  // registration the kernel dropped with it
+  bool moved = monitored._fd != fd || monitored._fdChanges != changes;
+  if (monitored._fd >= 0 && (moved || ! mask))
+  {
+    // Fails harmlessly if the source already closed the descriptor
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, monitored._fd, NULL);
+    monitored._fd = -1;
+  }
+  if (fd < 0 || ! mask)
+    return;
+
+  struct epoll_event event;
+  event.events = 0;
+  if (mask & ReadableEvent) event.events |= EPOLLIN;
+  if (mask & WritableEvent) event.events |= EPOLLOUT;
+  if (mask & Exception)     event.events |= EPOLLPRI;
+  if (_backend == EpollEdgeBackend) event.events |= EPOLLET;
+  event.data.ptr = &monitored;
+
+  // Modifying the registration also re-arms an edge-triggered descriptor
+  int op = (monitored._fd == fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(_epollFd, op, fd, &event) != 0)
+    XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch: could not watch fd %d (%s).", fd, strerror(errno));
+  else
+  {
+    monitored._fd = fd;
+    monitored._fdChanges = changes;
+  }
+#else
+  (void) monitored;
+#endif
+}
+
 
 // Watch current set of sources and process events
 void
@@ -82,92 +211,18 @@ XmlRpcDispatch::work(double timeout)
   // Only work while there is something to monitor
   while (_sources.size() > 0) {
 
-    // Construct the sets of descriptors we are interested in
-    fd_set inFd, outFd, excFd;
-	  FD_ZERO(&inFd);
-	  FD_ZERO(&outFd);
-	  FD_ZERO(&excFd);
-
-    int maxFd = -1;     // Not used on windows
-    SourceList::iterator it;
-    for (it=_sources.begin(); it!=_sources.end(); ++it) {
-      int fd = it->getSource()->getfd();
-      if (it->getMask() & ReadableEvent) FD_SET(fd, &inFd);
-      if (it->getMask() & WritableEvent) FD_SET(fd, &outFd);
-      if (it->getMask() & Exception)     FD_SET(fd, &excFd);
-      if (it->getMask() && fd > maxFd)   maxFd = fd;
-    }
-
-    // Check for events
-    int nEvents;
-    if (timeout < 0.0)
-      nEvents = select(maxFd+1, &inFd, &outFd, &excFd, NULL);
-    else 
-    {
-      struct timeval tv;
-      tv.tv_sec = (int)floor(timeout);
-      tv.tv_usec = ((int)floor(1000000.0 * (timeout-floor(timeout)))) % 1000000;
-      nEvents = select(maxFd+1, &inFd, &outFd, &excFd, &tv);
-    }
-
-    if (nEvents < 0)
+    bool ok = (_backend == SelectBackend) ? waitSelect(timeout) : waitEpoll(timeout);
+    _removed.clear();
+    if ( ! ok)
     {
-      if(errno != EINTR)
-        XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: error in select (%d).", nEvents);
       _inWork = false;
       return;
     }
 
-    // Process events
-    for (it=_sources.begin(); it != _sources.end(); )
-    {
-      SourceList::iterator thisIt = it++;
-      XmlRpcSource* src = thisIt->getSource();
-      int fd = src->getfd();
-      unsigned newMask = (unsigned) -1;
-      if (fd <= maxFd) {
-        // If you select on multiple event types this could be ambiguous
-        if (FD_ISSET(fd, &inFd))
-          newMask &= src->handleEvent(ReadableEvent);
-        if (FD_ISSET(fd, &outFd))
-          newMask &= src->handleEvent(WritableEvent);
-        if (FD_ISSET(fd, &excFd))
-          newMask &= src->handleEvent(Exception);
-
-        // Find the source again.  It may have moved as a result of the way
-        // that sources are removed and added in the call stack starting
-        // from the handleEvent() calls above.
-        for (thisIt=_sources.begin(); thisIt != _sources.end(); thisIt++)
-        {
-          if(thisIt->getSource() == src)
-            break;
-        }
-        if(thisIt == _sources.end())
-        {
-          XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: couldn't find source iterator");
-          continue;
-        }
-
-        if ( ! newMask) {
-          _sources.erase(thisIt);  // Stop monitoring this one
-          if ( ! src->getKeepOpen())
-            src->close();
-        } else if (newMask != (unsigned) -1) {
-          thisIt->getMask() = newMask;
-        }
-      }
-    }
-
     // Check whether to clear all sources
     if (_doClear)
     {
-      SourceList closeList = _sources;
-      _sources.clear();
-      for (SourceList::iterator it=closeList.begin(); it!=closeList.end(); ++it) {
-	XmlRpcSource *src = it->getSource();
-        src->close();
-      }
-
+      closeAll();
       _doClear = false;
     }
 
@@ -180,6 +235,145 @@ XmlRpcDispatch::work(double timeout)
 }
 
 
+bool
+XmlRpcDispatch::waitSelect(double timeout)
+{
+  // Construct the sets of descriptors we are interested in
+  fd_set inFd, outFd, excFd;
+  FD_ZERO(&inFd);
+  FD_ZERO(&outFd);
+  FD_ZERO(&excFd);
+
+  int maxFd = -1;     // Not used on windows
+  SourceList::iterator it;
+  for (it=_sources.begin(); it!=_sources.end(); ++it) {
+    int fd = it->getSource()->getfd();
+    if ( ! it->getMask() || fd < 0)
+      continue;
+#if !defined(_WINDOWS)
+    if (fd >= FD_SETSIZE) {
+      XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: fd %d does not fit in select, use epoll.", fd);
+      continue;
+    }
+#endif
+    if (it->getMask() & ReadableEvent) FD_SET(fd, &inFd);
+    if (it->getMask() & WritableEvent) FD_SET(fd, &outFd);
+    if (it->getMask() & Exception)     FD_SET(fd, &excFd);
+    if (fd > maxFd)                    maxFd = fd;
+  }
+
+  // Check for events
+  int nEvents;
+  if (timeout < 0.0)
+    nEvents = select(maxFd+1, &inFd, &outFd, &excFd, NULL);
+  else 
+  {
+    struct timeval tv;
+    tv.tv_sec = (int)floor(timeout);
+    tv.tv_usec = ((int)floor(1000000.0 * (timeout-floor(timeout)))) % 1000000;
+    nEvents = select(maxFd+1, &inFd, &outFd, &excFd, &tv);
+  }
+
+  if (nEvents < 0)
+  {
+    if(errno != EINTR)
+      XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: error in select (%d).", nEvents);
+    return false;
+  }
+
+  // Collect the events first, as handlers add and remove sources
+  std::vector< std::pair<MonitoredSource*, unsigned> > ready;
+  for (it=_sources.begin(); nEvents > 0 && it != _sources.end(); ++it)
+  {
+    int fd = it->getSource()->getfd();
+    if (fd < 0 || fd > maxFd)
+      continue;
+    unsigned events = 0;
+    if (FD_ISSET(fd, &inFd))  events |= ReadableEvent;
+    if (FD_ISSET(fd, &outFd)) events |= WritableEvent;
+    if (FD_ISSET(fd, &excFd)) events |= Exception;
+    if (events)
+      ready.push_back(std::make_pair(&*it, events));
+  }
+
+  for (size_t i = 0; i < ready.size(); ++i)
+    if (ready[i].first->getSource())
+      handleEvents(ready[i].first->getSource(), ready[i].second);
+  return true;
+}
+
+
+bool
+XmlRpcDispatch::waitEpoll(double timeout)
+{
+#if defined(RV_XMLRPC_EPOLL)
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+  int ms = (timeout < 0.0) ? -1 : (int)ceil(1000.0 * timeout);
+  int nEvents = epoll_wait(_epollFd, events, MAX_EPOLL_EVENTS, ms);
+  if (nEvents < 0)
+  {
+    if(errno != EINTR)
+      XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: error in epoll_wait (%s).", strerror(errno));
+    return false;
+  }
+
+  for (int i = 0; i < nEvents; ++i)
+  {
+    // Entries removed by an earlier handler stay allocated until work() moves on
+    MonitoredSource* monitored = static_cast<MonitoredSource*>(events[i].data.ptr);
+    if ( ! monitored->getSource())
+      continue;
+
+    unsigned mask = monitored->getMask();
+    unsigned happened = 0;
+    if (events[i].events & EPOLLIN)  happened |= ReadableEvent;
+    if (events[i].events & EPOLLOUT) happened |= WritableEvent;
+    if (events[i].events & EPOLLPRI) happened |= Exception;
+    // Like select, report errors and hangups to the reader or writer
+    if (events[i].events & (EPOLLERR | EPOLLHUP)) happened |= mask & (ReadableEvent | WritableEvent);
+    if (happened & mask)
+      handleEvents(monitored->getSource(), happened & mask);
+  }
+  return true;
+#else
+  (void) timeout;
+  return false;
+#endif
+}
+
+
+void
+XmlRpcDispatch::handleEvents(XmlRpcSource* src, unsigned events)
+{
+  unsigned newMask = (unsigned) -1;
+  // If you select on multiple event types this could be ambiguous
+  if (events & ReadableEvent)
+    newMask &= src->handleEvent(ReadableEvent);
+  if (events & WritableEvent)
+    newMask &= src->handleEvent(WritableEvent);
+  if (events & Exception)
+    newMask &= src->handleEvent(Exception);
+
+  // Find the source again. It may have been removed, or removed and added
+  // again, by the handleEvent() calls above.
+  SourceIndex::iterator found = _index.find(src);
+  if (found == _index.end())
+  {
+    XmlRpc::XmlRpcUtil::error("Error in XmlRpcDispatch::work: couldn't find source iterator");
+    return;
+  }
+
+  if ( ! newMask) {
+    removeSource(found->second);  // Stop monitoring this one
+    if ( ! src->getKeepOpen())
+      src->close();
+  } else {
+    // Also follows a source that changed its descriptor but kept its mask
+    setSourceEvents(found->second, (newMask != (unsigned) -1) ? newMask : found->second->getMask());
+  }
+}
+
+
 // Exit from work routine. Presumably this will be called from
 // one of the source event handlers.
 void
@@ -195,12 +389,21 @@ XmlRpcDispatch::clear()
   if (_inWork)
     _doClear = true;  // Finish reporting current events before clearing
   else
+    closeAll();
+}
+
+
+void
+XmlRpcDispatch::closeAll()
+{
+  std::vector<XmlRpcSource*> closeList;
+  while ( ! _sources.empty())
   {
-    SourceList closeList = _sources;
-    _sources.clear();
-    for (SourceList::iterator it=closeList.begin(); it!=closeList.end(); ++it)
-      it->getSource()->close();
+    closeList.push_back(_sources.front().getSource());
+    removeSource(_sources.begin());
   }
+  for (size_t i = 0; i < closeList.size(); ++i)
+    closeList[i]->close();
 }
 
 
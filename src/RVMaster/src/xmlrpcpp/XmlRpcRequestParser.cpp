@@ -0,0 +1,310 @@
+
+#include "rv/XmlRpcRequestParser.h"
+
+#ifndef MAKEDEPEND
+# include <ctype.h>
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
+#endif
+
+using namespace rv;
+
+
+// Longest number or date we convert. Longer ones are malformed.
+static const size_t MAX_SCALAR = 64;
+
+
+XmlRpcRequestParser::XmlRpcRequestParser(const char* begin, const char* end)
+  : _begin(begin), _cp(begin), _end(end)
+{
+}
+
+
+bool
+XmlRpcRequestParser::parse(std::string& methodName, XmlRpc::XmlRpcValue& params)
+{
+  // Skip the XML declaration and anything else before the method name
+  static const char METHODNAME_TAG[] = "<methodName>";
+  const char* found = (const char*) memmem(_cp, _end - _cp, METHODNAME_TAG, sizeof(METHODNAME_TAG) - 1);
+  if ( ! found)
+    return false;
+  _cp = found + sizeof(METHODNAME_TAG) - 1;
+
+  const char* name = _cp;
+  methodName.clear();
+  decode(name, text(), methodName);
+  if ( ! nextTagIs("</methodName>"))
+    return false;
+
+  if (nextTagIs("<params/>") || ! nextTagIs("<params>"))
+    return true;
+
+  int nArgs = 0;
+  while (nextTagIs("<param>")) {
+    if ( ! parseValue(params[nArgs++]) || ! nextTagIs("</param>"))
+      return false;
+  }
+  return nextTagIs("</params>");
+}
+
+
+void
+XmlRpcRequestParser::skipSpace()
+{
+  while (_cp < _end && isspace((unsigned char) *_cp))
+    ++_cp;
+}
+
+
+bool
+XmlRpcRequestParser::nextTagIs(const char* tag, size_t length)
+{
+  skipSpace();
+  if (size_t(_end - _cp) < length || memcmp(_cp, tag, length) != 0)
+    return false;
+  _cp += length;
+  return true;
+}
+
+
+bool
+XmlRpcRequestParser::closeTag(const char* name, size_t length)
+{
+  if (size_t(_end - _cp) < length + 3 || _cp[0] != '<' || _cp[1] != '/' ||
+      memcmp(_cp + 2, name, length) != 0 || _cp[length + 2] != '>')
+    return false;
+  _cp += length + 3;
+  return true;
+}
+
+
+const char*
+XmlRpcRequestParser::text()
+{
+  const char* lt = (const char*) memchr(_cp, '<', _end - _cp);
+  _cp = lt ? lt : _end;
+  return _cp;
+}
+
+
+bool
+XmlRpcRequestParser::parseValue(XmlRpc::XmlRpcValue& value)
+{
+  if (nextTagIs("<value/>")) {
+    value = std::string();
+    return true;
+  }
+  if ( ! nextTagIs("<value>"))
+    return false;
+
+  // A type tag, or else the text up to </value> is an untyped string
+  const char* start = _cp;
+  skipSpace();
+  if (_end - _cp > 1 && _cp[0] == '<' && _cp[1] != '/') {
+    const char* type = _cp + 1;
+    const char* gt = (const char*) memchr(type, '>', _end - type);
+    if ( ! gt)
+      return false;
+    _cp = gt + 1;
+    // An empty element such as <string/> has no closing tag
+    bool empty = (gt[-1] == '/');
+    if ( ! parseTypedValue(type, gt - type - (empty ? 1 : 0), empty, value))
+      return false;
+    return nextTagIs("</value>");
+  }
+
+  _cp = start;
+  value = std::string();
+  decode(start, text(), value);
+  return closeTag("value", 5);
+}
+
+
+bool
+XmlRpcRequestParser::parseTypedValue(const char* type, size_t length, bool empty, XmlRpc::XmlRpcValue& value)
+{
+  if (length == 5 && memcmp(type, "array", 5) == 0) {
+    if (empty) {
+      value.setSize(0);
+      return true;
+    }
+    return parseArray(value) && closeTag(type, length);
+  }
+  if (length == 6 && memcmp(type, "struct", 6) == 0) {
+    if (empty) {
+      parseStruct(value);
+      return true;
+    }
+    return parseStruct(value) && closeTag(type, length);
+  }
+
+  const char* start = _cp;
+  const char* stop = empty ? start : text();
+
+  if (length == 6 && memcmp(type, "string", 6) == 0) {
+    value = std::string();
+    decode(start, stop, value);
+  } else if (length == 6 && memcmp(type, "base64", 6) == 0) {
+    if ( ! decodeBase64(start, stop, value))
+      return false;
+  } else {
+    // Scalars are short, convert a terminated copy
+    char scalar[MAX_SCALAR];
+    while (start < stop && isspace((unsigned char) *start))
+      ++start;
+    while (stop > start && isspace((unsigned char) stop[-1]))
+      --stop;
+    size_t n = stop - start;
+    if (n == 0 || n >= MAX_SCALAR)
+      return false;
+    memcpy(scalar, start, n);
+    scalar[n] = 0;
+    char* converted;
+
+    if ((length == 3 && memcmp(type, "int", 3) == 0) || (length == 2 && memcmp(type, "i4", 2) == 0)) {
+      long ivalue = strtol(scalar, &converted, 10);
+      if (converted != scalar + n)
+        return false;
+      value = int(ivalue);
+    } else if (length == 7 && memcmp(type, "boolean", 7) == 0) {
+      if (n != 1 || (scalar[0] != '0' && scalar[0] != '1'))
+        return false;
+      value = XmlRpc::XmlRpcValue(scalar[0] == '1');
+    } else if (length == 6 && memcmp(type, "double", 6) == 0) {
+      double dvalue = strtod(scalar, &converted);
+      if (converted != scalar + n)
+        return false;
+      value = dvalue;
+    } else if (length == 16 && memcmp(type, "dateTime.iso8601", 16) == 0) {
+      struct tm t;
+      memset(&t, 0, sizeof(t));
+      if (sscanf(scalar, "%4d%2d%2dT%2d:%2d:%2d",
+                 &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6)
+        return false;
+      t.tm_isdst = -1;
+      value = XmlRpc::XmlRpcValue(&t);
+    } else {
+      return false;
+    }
+  }
+  return empty || closeTag(type, length);
+}
+
+
+bool
+XmlRpcRequestParser::parseArray(XmlRpc::XmlRpcValue& value)
+{
+  value.setSize(0);
+  if (nextTagIs("<data/>")) {
+    skipSpace();
+    return true;
+  }
+  if ( ! nextTagIs("<data>"))
+    return false;
+
+  // Each element is parsed where it ends up
+  int n = 0;
+  for (;;) {
+    skipSpace();
+    if (size_t(_end - _cp) < 6 || memcmp(_cp, "<value", 6) != 0)
+      break;
+    if ( ! parseValue(value[n++]))
+      return false;
+  }
+  if ( ! nextTagIs("</data>"))
+    return false;
+  skipSpace();
+  return true;
+}
+
+
+bool
+XmlRpcRequestParser::parseStruct(XmlRpc::XmlRpcValue& value)
+{
+  std::string name;
+  int nMembers = 0;
+  while (nextTagIs("<member>")) {
+    if ( ! nextTagIs("<name>"))
+      return false;
+    name.clear();
+    const char* start = _cp;
+    decode(start, text(), name);
+    if ( ! closeTag("name", 4) || ! parseValue(value[name]) || ! nextTagIs("</member>"))
+      return false;
+    ++nMembers;
+  }
+  if (nMembers == 0) {
+    // XmlRpcValue only becomes an empty struct by parsing one
+    static const std::string EMPTY_STRUCT = "<value><struct></struct></value>";
+    int offset = 0;
+    value = XmlRpc::XmlRpcValue(EMPTY_STRUCT, &offset);
+  }
+  skipSpace();
+  return true;
+}
+
+
+void
+XmlRpcRequestParser::decode(const char* begin, const char* end, std::string& s)
+{
+  static const struct { const char* entity; size_t length; char c; } ENTITIES[] = {
+    { "&lt;", 4, '<' }, { "&gt;", 4, '>' }, { "&amp;", 5, '&' }, { "&quot;", 6, '"' }, { "&apos;", 6, '\'' }
+  };
+
+  s.reserve(s.size() + (end - begin));
+  while (begin < end) {
+    const char* amp = (const char*) memchr(begin, '&', end - begin);
+    if ( ! amp) {
+      s.append(begin, end);
+      return;
+    }
+    s.append(begin, amp);
+    begin = amp;
+    size_t i = 0;
+    for ( ; i < sizeof(ENTITIES) / sizeof(ENTITIES[0]); ++i) {
+      if (size_t(end - amp) >= ENTITIES[i].length && memcmp(amp, ENTITIES[i].entity, ENTITIES[i].length) == 0) {
+        s += ENTITIES[i].c;
+        begin += ENTITIES[i].length;
+        break;
+      }
+    }
+    // Unknown entities are kept as they are
+    if (i == sizeof(ENTITIES) / sizeof(ENTITIES[0]))
+      s += *begin++;
+  }
+}
+
+
+bool
+XmlRpcRequestParser::decodeBase64(const char* begin, const char* end, XmlRpc::XmlRpcValue& value)
+{
+  char none = 0;
+  value = XmlRpc::XmlRpcValue(&none, 0);
+  XmlRpc::XmlRpcValue::BinaryData& bytes = value;
+  bytes.reserve((end - begin) / 4 * 3);
+
+  unsigned bits = 0;
+  int nBits = 0;
+  for (const char* cp = begin; cp < end; ++cp) {
+    int c = (unsigned char) *cp;
+    int sextet;
+    if (c >= 'A' && c <= 'Z')      sextet = c - 'A';
+    else if (c >= 'a' && c <= 'z') sextet = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') sextet = c - '0' + 52;
+    else if (c == '+')             sextet = 62;
+    else if (c == '/')             sextet = 63;
+    else if (c == '=')             break;
+    else if (isspace(c))           continue;
+    else                           return false;
+
+    bits = (bits << 6) | sextet;
+    nBits += 6;
+    if (nBits >= 8) {
+      nBits -= 8;
+      bytes.push_back(char((bits >> nBits) & 0xff));
+    }
+  }
+  return true;
+}
@@ -5,51 +5,286 @@
 #include "XmlRpcUtil.h"
 #include "XmlRpcException.h"
 #include "rv/callInfo.h"
+#include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 using namespace rv;
 
+// Whether this thread is executing a method, see removeMethod
+static thread_local bool executingMethod = false;
+
+
+// Worker threads that execute requests, and a pipe through which they hand
+// the connections back to the work() thread to write the responses.
+class XmlRpcServer::WorkerPool : public XmlRpcSource {
+public:
+  WorkerPool(XmlRpcServer* server, unsigned count)
+    : _server(server), _stopping(false)
+  {
+    _wakeFd[0] = _wakeFd[1] = -1;
+    if (pipe(_wakeFd) != 0 ||
+        ! XmlRpcSocket::setNonBlocking(_wakeFd[0]) || ! XmlRpcSocket::setNonBlocking(_wakeFd[1]))
+    {
+      XmlRpc::XmlRpcUtil::error("XmlRpcServer::setWorkerThreads: Could not create pipe (%s).", XmlRpcSocket::getErrorMsg().c_str());
+      return;
+    }
+    setfd(_wakeFd[0]);
+    setKeepOpen(true);
+    _server->_disp.addSource(this, XmlRpcDispatch::ReadableEvent);
+    for (unsigned i = 0; i < count; ++i)
+      _threads.push_back(std::thread(&WorkerPool::run, this));
+  }
+
+  ~WorkerPool()
+  {
+    std::vector<XmlRpcServerConnection*> pending, done;
+    stop(pending, done);
+    _server->_disp.removeSource(this);
+    for (int i = 0; i < 2; ++i)
+      if (_wakeFd[i] >= 0)
+        ::close(_wakeFd[i]);
+  }
+
+  bool running() const { return ! _threads.empty(); }
+
+  // Let the workers finish the requests they are running and join them.
+  // Hands back the connections whose requests no worker took, and those
+  // whose responses work() has not started writing.
+  void stop(std::vector<XmlRpcServerConnection*>& pending, std::vector<XmlRpcServerConnection*>& done)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _wakeup.notify_all();
+    for (size_t i = 0; i < _threads.size(); ++i)
+      _threads[i].join();
+    _threads.clear();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    pending.assign(_pending.begin(), _pending.end());
+    _pending.clear();
+    done.swap(_done);
+  }
+
+  void submit(XmlRpcServerConnection* conn)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending.push_back(conn);
+    }
+    _wakeup.notify_one();
+  }
+
+  // Write the responses the workers finished
+  unsigned handleEvent(unsigned)
+  {
+    char drain[256];
+    while (read(_wakeFd[0], drain, sizeof(drain)) > 0)
+      ;
+    std::vector<XmlRpcServerConnection*> done;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      done.swap(_done);
+    }
+    for (size_t i = 0; i < done.size(); ++i)
+      done[i]->responseReady();
+    return XmlRpcDispatch::ReadableEvent;
+  }
+
+private:
+  void run()
+  {
+    for (;;)
+    {
+      XmlRpcServerConnection* conn;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while ( ! _stopping && _pending.empty())
+          _wakeup.wait(lock);
+        if (_stopping)
+          return;
+        conn = _pending.front();
+        _pending.pop_front();
+      }
+
+      conn->runRequest();
+
+      bool first;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        first = _done.empty();
+        _done.push_back(conn);
+      }
+      // One byte wakes work() for all responses finished until it runs
+      if (first && write(_wakeFd[1], "", 1) < 0 && errno != EAGAIN)
+        XmlRpc::XmlRpcUtil::error("XmlRpcServer: Could not wake the dispatcher (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    }
+  }
+
+  XmlRpcServer* _server;
+  int _wakeFd[2];
+  std::vector<std::thread> _threads;
+
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  bool _stopping;
+  // Connections whose request waits for a worker, and whose response waits for work()
+  std::deque<XmlRpcServerConnection*> _pending;
+  std::vector<XmlRpcServerConnection*> _done;
+};
+
 
 XmlRpcServer::XmlRpcServer()
+  : _methods(std::make_shared<MethodMap>())
 {
   _introspectionEnabled = false;
   _listMethods = 0;
   _methodHelp = 0;
+  _workers = 0;
 }
 
 
 XmlRpcServer::~XmlRpcServer()
 {
   this->shutdown();
-  _methods.clear();
   delete _listMethods;
   delete _methodHelp;
 }
 
 
+void
+XmlRpcServer::setWorkerThreads(unsigned count)
+{
+  if (_workers)
+  {
+    // Requests still waiting for a worker run here instead
+    std::vector<XmlRpcServerConnection*> pending, done;
+    _workers->stop(pending, done);
+    delete _workers;
+    _workers = 0;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+      pending[i]->runRequest();
+      done.push_back(pending[i]);
+    }
+    for (size_t i = 0; i < done.size(); ++i)
+      done[i]->responseReady();
+  }
+  if (count > 0)
+  {
+    _workers = new WorkerPool(this, count);
+    if ( ! _workers->running())
+    {
+      delete _workers;
+      _workers = 0;
+    }
+  }
+}
+
+
+bool
+XmlRpcServer::executeAsync(XmlRpcServerConnection* conn)
+{
+  if ( ! _workers)
+    return false;
+  _workers->submit(conn);
+  return true;
+}
+
+
 // Add a command to the RPC server
 void 
 XmlRpcServer::addMethod(XmlRpcServerMethod2* method)
 {
-  _methods[method->name()] = method;
+  std::lock_guard<std::mutex> lock(_methodsMutex);
+  std::shared_ptr<MethodMap> updated = std::make_shared<MethodMap>(*getMethods());
+  (*updated)[method->name()] = method;
+  publishMethods(updated);
 }
 
 // Remove a command from the RPC server
 void 
 XmlRpcServer::removeMethod(XmlRpcServerMethod2* method)
 {
-  MethodMap::iterator i = _methods.find(method->name());
-  if (i != _methods.end())
-    _methods.erase(i);
+  removeMethod(method->name());
 }
 
 // Remove a command from the RPC server by name
 void 
 XmlRpcServer::removeMethod(const std::string& methodName)
 {
-  MethodMap::iterator i = _methods.find(methodName);
-  if (i != _methods.end())
-    _methods.erase(i);
+  // The tables that still list the method once it is removed
+  std::vector< std::weak_ptr<const MethodMap> > listing;
+  {
+    std::lock_guard<std::mutex> lock(_methodsMutex);
+    MethodTable current = getMethods();
+    if (current->find(methodName) == current->end())
+      return;
+    std::shared_ptr<MethodMap> updated = std::make_shared<MethodMap>(*current);
+    updated->erase(methodName);
+    publishMethods(updated);
+    for (size_t i = 0; i < _retiredMethods.size(); ++i) {
+      MethodTable retired = _retiredMethods[i].lock();
+      if (retired && retired->find(methodName) != retired->end())
+        listing.push_back(retired);
+    }
+  }
+
+  // Wait, without blocking addMethod and removeMethod, for the requests that
+  // may still be executing the method, unless this is one of them
+  if (executingMethod)
+    return;
+  for (size_t i = 0; i < listing.size(); ++i)
+    while ( ! listing[i].expired())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+
+void
+XmlRpcServer::publishMethods(std::shared_ptr<MethodMap> updated)
+{
+  MethodTable previous = std::atomic_exchange(&_methods, MethodTable(updated));
+  _retiredMethods.erase(std::remove_if(_retiredMethods.begin(), _retiredMethods.end(),
+                                       [](std::weak_ptr<const MethodMap> const& table) { return table.expired(); }),
+                        _retiredMethods.end());
+  _retiredMethods.push_back(previous);
+}
+
+
+XmlRpcServer::MethodTable
+XmlRpcServer::getMethods() const
+{
+  return std::atomic_load(&_methods);
+}
+
+
+bool
+XmlRpcServer::executeMethod(const std::string& name, XmlRpc::XmlRpcValue& params,
+                            rv::ClientInfo& ci, XmlRpc::XmlRpcValue& result)
+{
+  MethodTable methods = getMethods();
+  MethodMap::const_iterator i = methods->find(name);
+  if (i == methods->end())
+    return false;
+
+  bool const nested = executingMethod;
+  executingMethod = true;
+  try {
+    i->second->execute(params, ci, result);
+  } catch (...) {
+    executingMethod = nested;
+    throw;
+  }
+  executingMethod = nested;
+  return true;
 }
 
 
@@ -57,8 +292,9 @@ XmlRpcServer::removeMethod(const std::string& methodName)
 XmlRpcServerMethod2* 
 XmlRpcServer::findMethod(const std::string& name) const
 {
-  MethodMap::const_iterator i = _methods.find(name);
-  if (i == _methods.end())
+  MethodTable methods = getMethods();
+  MethodMap::const_iterator i = methods->find(name);
+  if (i == methods->end())
     return 0;
   return i->second;
 }
@@ -137,14 +373,16 @@ XmlRpcServer::work(double msTime)
 unsigned
 XmlRpcServer::handleEvent(unsigned)
 {
-  acceptConnection();
+  // Accept all pending connections, an edge-triggered dispatcher reports them only once
+  while (acceptConnection())
+    ;
   return XmlRpcDispatch::ReadableEvent;		// Continue to monitor this fd
 }
 
 
 // Accept a client connection request and create a connection to
-// handle method calls from the client.
-void
+// handle method calls from the client. Returns false once there is none left.
+bool
 XmlRpcServer::acceptConnection()
 {
   
@@ -162,7 +400,10 @@ map_family[s]=sci.family;
   if (s < 0)
   {
     //this->close();
-    XmlRpc::XmlRpcUtil::error("XmlRpcServer::acceptConnection: Could not accept connection (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    int err = XmlRpcSocket::getError();
+    if (err != EAGAIN && err != EWOULDBLOCK)
+      XmlRpc::XmlRpcUtil::error("XmlRpcServer::acceptConnection: Could not accept connection (%s).", XmlRpcSocket::getErrorMsg().c_str());
+    return false;
   }
   else if ( ! XmlRpcSocket::setNonBlocking(s))
   {
@@ -174,6 +415,7 @@ map_family[s]=sci.family;
     XmlRpc::XmlRpcUtil::log(2, "XmlRpcServer::acceptConnection: creating a connection");
     _disp.addSource(this->createConnection(s), XmlRpcDispatch::ReadableEvent);
   }
+  return true;
 }
 
 
@@ -207,6 +449,10 @@ XmlRpcServer::exit()
 void 
 XmlRpcServer::shutdown()
 {
+  // Connections still waiting for a worker are closed below
+  delete _workers;
+  _workers = 0;
+
   // This closes and destroys all connections as well as closing this socket
   _disp.clear();
 }
@@ -286,9 +532,10 @@ XmlRpcServer::enableIntrospection(bool enabled)
 void
 XmlRpcServer::listMethods(XmlRpc::XmlRpcValue& result)
 {
+  MethodTable methods = getMethods();
   int i = 0;
-  result.setSize(_methods.size()+1);
-  for (MethodMap::iterator it=_methods.begin(); it != _methods.end(); ++it)
+  result.setSize(methods->size()+1);
+  for (MethodMap::const_iterator it=methods->begin(); it != methods->end(); ++it)
     result[i++] = it->first;
 
   // Multicall support is built into XmlRpcServerConnection
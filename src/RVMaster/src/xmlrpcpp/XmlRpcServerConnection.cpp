@@ -1,5 +1,7 @@
 
 #include "rv/XmlRpcServerConnection.h"
+#include "rv/XmlRpcRequestParser.h"
+#include "rv/XmlRpcValueWriter.h"
 #include "rv/callInfo.h"
 
 #include "rv/XmlRpcSocket.h"
@@ -12,6 +14,9 @@
 	# include <strings.h>
 #endif
 # include <string.h>
+# include <sys/uio.h>
+# include <algorithm>
+# include <vector>
 #endif
 
 using namespace rv;
@@ -30,6 +35,53 @@ const std::string XmlRpcServerConnection::PARAMS = "params";
 const std::string XmlRpcServerConnection::FAULTCODE = "faultCode";
 const std::string XmlRpcServerConnection::FAULTSTRING = "faultString";
 
+static const char RESPONSE_1[] =
+  "<?xml version=\"1.0\"?>\r\n"
+  "<methodResponse><params><param>\r\n\t";
+static const char RESPONSE_2[] =
+  "\r\n</param></params></methodResponse>\r\n";
+
+static const char FAULT_RESPONSE_1[] =
+  "<?xml version=\"1.0\"?>\r\n"
+  "<methodResponse><fault>\r\n\t";
+static const char FAULT_RESPONSE_2[] =
+  "\r\n</fault></methodResponse>\r\n";
+
+
+// The [code, message, 0] results of xmlrpc::responseInt that RVMaster
+// returns most, rendered once. Returns 0 if result is not one of them.
+static const std::string*
+findTemplate(XmlRpc::XmlRpcValue& result)
+{
+  static const int N_TEMPLATES = 2;
+  static const struct { int code; const char* message; } ENVELOPES[N_TEMPLATES] = {
+    { 1, "" },                  // Success
+    { 0, "Access Control" },    // Denied by the access policy
+  };
+  static const std::vector<std::string> rendered = [] {
+    std::vector<std::string> xml(N_TEMPLATES);
+    for (int i = 0; i < N_TEMPLATES; ++i) {
+      XmlRpc::XmlRpcValue envelope;
+      envelope[0] = ENVELOPES[i].code;
+      envelope[1] = std::string(ENVELOPES[i].message);
+      envelope[2] = 0;
+      XmlRpcValueWriter::append(envelope, xml[i]);
+    }
+    return xml;
+  }();
+
+  if (result.getType() != XmlRpc::XmlRpcValue::TypeArray || result.size() != 3 ||
+      result[0].getType() != XmlRpc::XmlRpcValue::TypeInt ||
+      result[1].getType() != XmlRpc::XmlRpcValue::TypeString ||
+      result[2].getType() != XmlRpc::XmlRpcValue::TypeInt || static_cast<int&>(result[2]) != 0)
+    return 0;
+  for (int i = 0; i < N_TEMPLATES; ++i)
+    if (static_cast<int&>(result[0]) == ENVELOPES[i].code &&
+        static_cast<std::string&>(result[1]) == ENVELOPES[i].message)
+      return &rendered[i];
+  return 0;
+}
+
 
 
 // The server delegates handling client requests to a serverConnection object.
@@ -39,6 +91,11 @@ XmlRpcServerConnection::XmlRpcServerConnection(int fd, XmlRpcServer* server, boo
   XmlRpc::XmlRpcUtil::log(2,"XmlRpcServerConnection: new socket %d.", fd);
   _server = server;
   _connectionState = READ_HEADER;
+  _bodyOffset = 0;
+  _requestHighWater = 0;
+  _responseHeaderLength = 0;
+  _responsePrologue = _responseEpilogue = "";
+  _responseBody = &_response;
   _keepAlive = true;
 }
 
@@ -56,14 +113,34 @@ XmlRpcServerConnection::~XmlRpcServerConnection()
 unsigned
 XmlRpcServerConnection::handleEvent(unsigned /*eventType*/)
 {
-  if (_connectionState == READ_HEADER)
-    if ( ! readHeader()) return 0;
-
-  if (_connectionState == READ_REQUEST)
-    if ( ! readRequest()) return 0;
+  // Once a response is written, go on with the next request: its bytes may
+  // have arrived already, and an edge-triggered dispatcher does not report
+  // them again, nor does any dispatcher report bytes read with the last one.
+  bool responded;
+  do {
+    if (_connectionState == READ_HEADER)
+      if ( ! readHeader()) return 0;
+
+    if (_connectionState == READ_REQUEST)
+      if ( ! readRequest()) return 0;
+
+    if (_connectionState == EXECUTE_REQUEST && prepareRequest())
+    {
+      if (_server->executeAsync(this))
+      {
+        // Nothing to watch for until responseReady
+        _server->get_dispatch()->setSourceEvents(this, 0);
+        return (unsigned) -1;
+      }
+      runRequest();
+    }
 
-  if (_connectionState == WRITE_RESPONSE)
-    if ( ! writeResponse()) return 0;
+    responded = false;
+    if (_connectionState == WRITE_RESPONSE) {
+      if ( ! writeResponse()) return 0;
+      responded = (_connectionState == READ_HEADER);
+    }
+  } while (responded);
 
   return (_connectionState == WRITE_RESPONSE) 
         ? XmlRpcDispatch::WritableEvent : XmlRpcDispatch::ReadableEvent;
@@ -75,16 +152,16 @@ XmlRpcServerConnection::readHeader()
 {
   // Read available data
   bool eof;
-  if ( ! XmlRpcSocket::nbRead(this->getfd(), _header, &eof)) {
+  if ( ! XmlRpcSocket::nbRead(this->getfd(), _request, &eof)) {
     // Its only an error if we already have read some data
-    if (_header.length() > 0)
+    if (_request.length() > 0)
       XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::readHeader: error while reading header (%s).",XmlRpcSocket::getErrorMsg().c_str());
     return false;
   }
 
-  XmlRpc::XmlRpcUtil::log(4, "XmlRpcServerConnection::readHeader: read %d bytes.", _header.length());
-  char *hp = (char*)_header.c_str();  // Start of header
-  char *ep = hp + _header.length();   // End of string
+  XmlRpc::XmlRpcUtil::log(4, "XmlRpcServerConnection::readHeader: read %d bytes.", _request.length());
+  char *hp = (char*)_request.c_str(); // Start of header
+  char *ep = hp + _request.length();  // End of string
   char *bp = 0;                       // Start of body
   char *lp = 0;                       // Start of content-length value
   char *kp = 0;                       // Start of connection value
@@ -105,7 +182,7 @@ XmlRpcServerConnection::readHeader()
     // EOF in the middle of a request is an error, otherwise its ok
     if (eof) {
       XmlRpc::XmlRpcUtil::log(4, "XmlRpcServerConnection::readHeader: EOF");
-      if (_header.length() > 0)
+      if (_request.length() > 0)
         XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::readHeader: EOF while reading header");
       return false;   // Either way we close the connection
     }
@@ -127,12 +204,13 @@ XmlRpcServerConnection::readHeader()
   	
   XmlRpc::XmlRpcUtil::log(3, "XmlRpcServerConnection::readHeader: specified content length is %d.", _contentLength);
 
-  // Otherwise copy non-header data to request buffer and set state to read request.
-  _request = bp;
+  // The body follows in the same buffer
+  _bodyOffset = bp - hp;
 
   // Parse out any interesting bits from the header (HTTP version, connection)
+  static const char HTTP10[] = "HTTP/1.0";
   _keepAlive = true;
-  if (_header.find("HTTP/1.0") != std::string::npos) {
+  if (std::search(hp, bp, HTTP10, HTTP10 + sizeof(HTTP10) - 1) != bp) {
     if (kp == 0 || strncasecmp(kp, "keep-alive", 10) != 0)
       _keepAlive = false;           // Default for HTTP 1.0 is to close the connection
   } else {
@@ -142,7 +220,6 @@ XmlRpcServerConnection::readHeader()
   XmlRpc::XmlRpcUtil::log(3, "KeepAlive: %d", _keepAlive);
 
 
-  _header = ""; 
   _connectionState = READ_REQUEST;
   return true;    // Continue monitoring this source
 }
@@ -151,15 +228,15 @@ bool
 XmlRpcServerConnection::readRequest()
 {
   // If we dont have the entire request yet, read available data
-  if (int(_request.length()) < _contentLength) {
+  if (int(_request.length() - _bodyOffset) < _contentLength) {
     bool eof;
-    if ( ! XmlRpcSocket::nbRead(this->getfd(), _request, &eof)) {
+    if ( ! XmlRpcSocket::nbRead(this->getfd(), _request, &eof, _bodyOffset + _contentLength)) {
       XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::readRequest: read error (%s).",XmlRpcSocket::getErrorMsg().c_str());
       return false;
     }
 
     // If we haven't gotten the entire request yet, return (keep reading)
-    if (int(_request.length()) < _contentLength) {
+    if (int(_request.length() - _bodyOffset) < _contentLength) {
       if (eof) {
         XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::readRequest: EOF while reading request");
         return false;   // Either way we close the connection
@@ -169,10 +246,10 @@ XmlRpcServerConnection::readRequest()
   }
 
   // Otherwise, parse and dispatch the request
-  XmlRpc::XmlRpcUtil::log(3, "XmlRpcServerConnection::readRequest read %d bytes.", _request.length());
+  XmlRpc::XmlRpcUtil::log(3, "XmlRpcServerConnection::readRequest read %d bytes.", _request.length() - _bodyOffset);
   //XmlRpcUtil::log(5, "XmlRpcServerConnection::readRequest:\n%s\n", _request.c_str());
 
-  _connectionState = WRITE_RESPONSE;
+  _connectionState = EXECUTE_REQUEST;
 
   return true;    // Continue monitoring this source
 }
@@ -181,27 +258,39 @@ XmlRpcServerConnection::readRequest()
 bool
 XmlRpcServerConnection::writeResponse()
 {
-  if (_response.length() == 0) {
-    executeRequest();
-    _bytesWritten = 0;
-    if (_response.length() == 0) {
-      XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::writeResponse: empty response.");
-      return false;
-    }
+  if (_responseHeaderLength == 0) {
+    XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::writeResponse: empty response.");
+    return false;
   }
 
+  struct iovec parts[4];
+  parts[0].iov_base = _responseHeader;
+  parts[0].iov_len = _responseHeaderLength;
+  parts[1].iov_base = (void*) _responsePrologue;
+  parts[1].iov_len = strlen(_responsePrologue);
+  parts[2].iov_base = (void*) _responseBody->data();
+  parts[2].iov_len = _responseBody->size();
+  parts[3].iov_base = (void*) _responseEpilogue;
+  parts[3].iov_len = strlen(_responseEpilogue);
+  int length = int(parts[0].iov_len + parts[1].iov_len + parts[2].iov_len + parts[3].iov_len);
+
   // Try to write the response
-  if ( ! XmlRpcSocket::nbWrite(this->getfd(), _response, &_bytesWritten)) {
+  if ( ! XmlRpcSocket::nbWrite(this->getfd(), parts, 4, &_bytesWritten)) {
     XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::writeResponse: write error (%s).",XmlRpcSocket::getErrorMsg().c_str());
     return false;
   }
-  XmlRpc::XmlRpcUtil::log(3, "XmlRpcServerConnection::writeResponse: wrote %d of %d bytes.", _bytesWritten, _response.length());
+  XmlRpc::XmlRpcUtil::log(3, "XmlRpcServerConnection::writeResponse: wrote %d of %d bytes.", _bytesWritten, length);
 
-  // Prepare to read the next request
-  if (_bytesWritten == int(_response.length())) {
-    _header = "";
-    _request = "";
-    _response = "";
+  // Prepare to read the next request, keeping any of it read with this one
+  if (_bytesWritten == length) {
+    size_t const consumed = _bodyOffset + _contentLength;
+    if (_request.size() > consumed)
+      _request.erase(0, consumed);
+    else
+      XmlRpcSocket::recycle(_request, &_requestHighWater);
+    _bodyOffset = 0;
+    _response.clear();
+    _responseHeaderLength = 0;
     _connectionState = READ_HEADER;
   }
 
@@ -212,46 +301,74 @@ XmlRpcServerConnection::writeResponse()
 void
 XmlRpcServerConnection::executeRequest()
 {
-  XmlRpc::XmlRpcValue params, resultValue;
-  std::string methodName = parseRequest(params);
+  if (prepareRequest())
+    runRequest();
+}
+
+
+bool
+XmlRpcServerConnection::prepareRequest()
+{
+  _params.clear();
+  if ( ! parseRequest(_methodName, _params)) {
+    _params.clear();
+    generateFaultResponse("malformed request");
+    _bytesWritten = 0;
+    _connectionState = WRITE_RESPONSE;
+    return false;
+  }
+  _server->findClientInfo(getfd(), ci);
+  return true;
+}
+
+
+void
+XmlRpcServerConnection::runRequest()
+{
+  XmlRpc::XmlRpcValue resultValue;
   XmlRpc::XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: server calling method '%s'", 
-                    methodName.c_str());
+                    _methodName.c_str());
 
   try {
 
-    if ( ! executeMethod(methodName, params, resultValue) &&
-         ! executeMulticall(methodName, params, resultValue))
-      generateFaultResponse(methodName + ": unknown method name");
+    if ( ! executeMethod(_methodName, _params, resultValue) &&
+         ! executeMulticall(_methodName, _params, resultValue))
+      generateFaultResponse(_methodName + ": unknown method name");
     else
-      generateResponse(resultValue.toXml());
+      generateResponse(resultValue);
 
   } catch (const XmlRpc::XmlRpcException& fault) {
     XmlRpc::XmlRpcUtil::log(2, "XmlRpcServerConnection::executeRequest: fault %s.",
                     fault.getMessage().c_str()); 
     generateFaultResponse(fault.getMessage(), fault.getCode());
   }
+
+  _params.clear();
+  _bytesWritten = 0;
+  _connectionState = WRITE_RESPONSE;
 }
 
-// Parse the method name and the argument values from the request.
-std::string
-XmlRpcServerConnection::parseRequest(XmlRpc::XmlRpcValue& params)
-{
-  int offset = 0;   // Number of chars parsed from the request
 
-  std::string methodName = XmlRpc::XmlRpcUtil::parseTag(METHODNAME_TAG, _request, &offset);
+void
+XmlRpcServerConnection::responseReady()
+{
+  _server->get_dispatch()->setSourceEvents(this, XmlRpcDispatch::WritableEvent);
+}
 
-  if (methodName.size() > 0 && XmlRpc::XmlRpcUtil::findTag(PARAMS_TAG, _request, &offset))
-  {
-    int nArgs = 0;
-    while (XmlRpc::XmlRpcUtil::nextTagIs(PARAM_TAG, _request, &offset)) {
-      params[nArgs++] = XmlRpc::XmlRpcValue(_request, &offset);
-      (void) XmlRpc::XmlRpcUtil::nextTagIs(PARAM_ETAG, _request, &offset);
-    }
+// Parse the method name and the argument values from the request.
+bool
+XmlRpcServerConnection::parseRequest(std::string& methodName, XmlRpc::XmlRpcValue& params)
+{
+  const char* body = _request.data() + _bodyOffset;
+  size_t length = std::min(_request.length() - _bodyOffset, size_t(_contentLength));
+  XmlRpcRequestParser parser(body, body + length);
 
-    (void) XmlRpc::XmlRpcUtil::nextTagIs(PARAMS_ETAG, _request, &offset);
+  methodName.clear();
+  if ( ! parser.parse(methodName, params)) {
+    XmlRpc::XmlRpcUtil::error("XmlRpcServerConnection::parseRequest: malformed request at byte %d.", int(parser.offset()));
+    return false;
   }
-
-  return methodName;
+  return true;
 }
 
 // Execute a named method with the specified params.
@@ -259,16 +376,10 @@ bool
 XmlRpcServerConnection::executeMethod(const std::string& methodName, 
                                       XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result)
 {
-
-  XmlRpcServerMethod2* method = _server->findMethod(methodName);
-  int fd = getfd();
-  _server->findClientInfo(fd,ci);
   //rv::ClientInfo ci = getClientInfo();
   //:printf("execute method from client ip address %s with fd %d\n",ci.ip.c_str(),fd);
 
-  if ( ! method) return false;
-
-  method->execute(params, ci, result);
+  if ( ! _server->executeMethod(methodName, params, ci, result)) return false;
 
   // Ensure a valid result value
   if ( ! result.valid())
@@ -328,60 +439,44 @@ XmlRpcServerConnection::executeMulticall(const std::string& methodName,
 
 // Create a response from results xml
 void
-XmlRpcServerConnection::generateResponse(std::string const& resultXml)
+XmlRpcServerConnection::generateResponse(XmlRpc::XmlRpcValue& result)
 {
-  const char RESPONSE_1[] = 
-    "<?xml version=\"1.0\"?>\r\n"
-    "<methodResponse><params><param>\r\n\t";
-  const char RESPONSE_2[] =
-    "\r\n</param></params></methodResponse>\r\n";
-
-  std::string body = RESPONSE_1 + resultXml + RESPONSE_2;
-  std::string header = generateHeader(body);
-
-  _response = header + body;
-  XmlRpc::XmlRpcUtil::log(5, "XmlRpcServerConnection::generateResponse:\n%s\n", _response.c_str()); 
+  _responseBody = findTemplate(result);
+  if ( ! _responseBody) {
+    _response.clear();
+    XmlRpcValueWriter::append(result, _response);
+    _responseBody = &_response;
+  }
+  _responsePrologue = RESPONSE_1;
+  _responseEpilogue = RESPONSE_2;
+  generateHeader(sizeof(RESPONSE_1) - 1 + _responseBody->size() + sizeof(RESPONSE_2) - 1);
+  XmlRpc::XmlRpcUtil::log(5, "XmlRpcServerConnection::generateResponse:\n%s\n", _responseBody->c_str()); 
 }
 
-// Prepend http headers
-std::string
-XmlRpcServerConnection::generateHeader(std::string const& body)
+// Render the http headers
+void
+XmlRpcServerConnection::generateHeader(size_t bodyLength)
 {
-  std::string header = 
+  _responseHeaderLength = snprintf(_responseHeader, sizeof(_responseHeader),
     "HTTP/1.1 200 OK\r\n"
-    "Server: ";
-  header += "XMLRPC++ 0.7";
-  header += "\r\n"
+    "Server: XMLRPC++ 0.7\r\n"
     "Content-Type: text/xml\r\n"
-    "Content-length: ";
-
-  char buffLen[40];
-#ifdef _MSC_VER
-  sprintf_s(buffLen,40,"%d\r\n\r\n", (int)body.size());
-#else
-  sprintf(buffLen,"%d\r\n\r\n", (int)body.size());
-#endif
-
-  return header + buffLen;
+    "Content-length: %d\r\n\r\n", int(bodyLength));
 }
 
 
 void
 XmlRpcServerConnection::generateFaultResponse(std::string const& errorMsg, int errorCode)
 {
-  const char RESPONSE_1[] = 
-    "<?xml version=\"1.0\"?>\r\n"
-    "<methodResponse><fault>\r\n\t";
-  const char RESPONSE_2[] =
-    "\r\n</fault></methodResponse>\r\n";
-
   XmlRpc::XmlRpcValue faultStruct;
   faultStruct[FAULTCODE] = errorCode;
   faultStruct[FAULTSTRING] = errorMsg;
-  std::string body = RESPONSE_1 + faultStruct.toXml() + RESPONSE_2;
-  std::string header = generateHeader(body);
-
-  _response = header + body;
+  _response.clear();
+  XmlRpcValueWriter::append(faultStruct, _response);
+  _responseBody = &_response;
+  _responsePrologue = FAULT_RESPONSE_1;
+  _responseEpilogue = FAULT_RESPONSE_2;
+  generateHeader(sizeof(FAULT_RESPONSE_1) - 1 + _response.size() + sizeof(FAULT_RESPONSE_2) - 1);
 }
 
 
@@ -2,6 +2,8 @@
 #include "XmlRpcUtil.h"
 #include "rv/callInfo.h"
 
+#include <algorithm>
+
 #ifndef MAKEDEPEND
 
 #if defined(_WINDOWS)
@@ -38,6 +40,7 @@ extern "C" {
 # include <stdio.h>
 # include <sys/types.h>
 # include <sys/socket.h>
+# include <sys/uio.h>
 # include <netinet/in.h>
 # include <netdb.h>
 # include <errno.h>
@@ -62,6 +65,8 @@ using namespace rv;
 
 
 bool XmlRpcSocket::s_use_ipv6_ = false;
+const size_t XmlRpcSocket::MAX_IDLE_BUFFER;
+const int XmlRpcSocket::MAX_WRITE_PARTS;
 
 #if defined(_WINDOWS)
 
@@ -289,37 +294,63 @@ XmlRpcSocket::connect(int fd, std::string& host, int port)
 
 // Read available text from the specified socket. Returns false on error.
 bool
-XmlRpcSocket::nbRead(int fd, std::string& s, bool *eof)
+XmlRpcSocket::nbRead(int fd, std::string& s, bool *eof, size_t expected)
 {
-  const int READ_SIZE = 4096;   // Number of bytes to attempt to read at a time
-  char readBuf[READ_SIZE];
+  const size_t READ_SIZE = 4096;    // Number of bytes to attempt to read at a time
+  const size_t MAX_READ = 65536;    // ... when more are expected
+  const size_t MAX_PRESIZE = 64 << 20;  // Larger messages grow as they arrive
 
   bool wouldBlock = false;
   *eof = false;
 
-  while ( ! wouldBlock && ! *eof) {
+  // One allocation for the whole message
+  if (expected > s.capacity())
+    s.reserve(std::min(expected, s.size() + MAX_PRESIZE));
+
+  // Stop once the message is complete, the peer waits for an answer then
+  while ( ! wouldBlock && ! *eof && (expected == 0 || s.size() < expected)) {
+    // Resizing clears the bytes read into, so only open as many as will
+    // likely be read
+    size_t length = s.size();
+    size_t window = (expected > length) ? std::min(expected - length, MAX_READ) : READ_SIZE;
+    s.resize(length + window);
 #if defined(_WINDOWS)
-    int n = recv(fd, readBuf, READ_SIZE-1, 0);
+    int n = recv(fd, &s[length], int(window), 0);
 #else
-    int n = read(fd, readBuf, READ_SIZE-1);
+    int n = read(fd, &s[length], window);
 #endif
+    s.resize(length + (n > 0 ? n : 0));
     XmlRpc::XmlRpcUtil::log(5, "XmlRpcSocket::nbRead: read/recv returned %d.", n);
 
-    if (n > 0) {
-      readBuf[n] = 0;
-      s.append(readBuf, n);
-    } else if (n == 0) {
+    if (n == 0) {
       *eof = true;
-    } else if (nonFatalError()) {
+    } else if (n < 0) {
+      if ( ! nonFatalError())
+        return false;   // Error
       wouldBlock = true;
-    } else {
-      return false;   // Error
     }
   }
   return true;
 }
 
 
+void
+XmlRpcSocket::recycle(std::string& s, size_t *highWater)
+{
+  // Decays, so one large message is forgotten after a few small ones
+  *highWater = std::max(s.size(), *highWater - *highWater / 4);
+
+  size_t keep = std::min(2 * *highWater + 4096, MAX_IDLE_BUFFER);
+  if (s.capacity() > keep) {
+    std::string smaller;
+    smaller.reserve(std::min(*highWater, MAX_IDLE_BUFFER));
+    s.swap(smaller);
+  } else {
+    s.clear();
+  }
+}
+
+
 // Write text to the specified socket. Returns false on error.
 bool
 XmlRpcSocket::nbWrite(int fd, std::string& s, int *bytesSoFar)
@@ -350,6 +381,53 @@ XmlRpcSocket::nbWrite(int fd, std::string& s, int *bytesSoFar)
 }
 
 
+#if ! defined(_WINDOWS)
+// Write buffers with one system call instead of concatenating them first
+bool
+XmlRpcSocket::nbWrite(int fd, const struct iovec* parts, int count, int *bytesSoFar)
+{
+  // The parts not written yet
+  struct iovec rest[MAX_WRITE_PARTS];
+  int nRest = 0;
+  size_t skip = *bytesSoFar;
+  for (int i = 0; i < count && i < MAX_WRITE_PARTS; ++i) {
+    if (skip >= parts[i].iov_len) {
+      skip -= parts[i].iov_len;
+      continue;
+    }
+    rest[nRest].iov_base = (char*) parts[i].iov_base + skip;
+    rest[nRest].iov_len = parts[i].iov_len - skip;
+    skip = 0;
+    ++nRest;
+  }
+
+  struct iovec* next = rest;
+  while (nRest > 0) {
+    ssize_t n = writev(fd, next, nRest);
+    XmlRpc::XmlRpcUtil::log(5, "XmlRpcSocket::nbWrite: writev returned %d.", int(n));
+
+    if (n > 0) {
+      *bytesSoFar += int(n);
+      while (nRest > 0 && size_t(n) >= next->iov_len) {
+        n -= next->iov_len;
+        ++next;
+        --nRest;
+      }
+      if (nRest > 0) {
+        next->iov_base = (char*) next->iov_base + n;
+        next->iov_len -= n;
+      }
+    } else if (nonFatalError()) {
+      break;
+    } else {
+      return false;   // Error
+    }
+  }
+  return true;
+}
+#endif
+
+
 // Returns last errno
 int
 XmlRpcSocket::getError()
@@ -6,7 +6,7 @@ namespace rv {
 
 
   XmlRpcSource::XmlRpcSource(int fd /*= -1*/, bool deleteOnClose /*= false*/) 
-    : _fd(fd), _deleteOnClose(deleteOnClose), _keepOpen(false)
+    : _fd(fd), _fdChanges(0), _deleteOnClose(deleteOnClose), _keepOpen(false)
   {
   }
 
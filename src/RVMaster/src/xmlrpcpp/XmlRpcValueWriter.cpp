@@ -0,0 +1,134 @@
+
+#include "rv/XmlRpcValueWriter.h"
+
+#ifndef MAKEDEPEND
+# include <stdio.h>
+# include <string.h>
+# include <time.h>
+#endif
+
+using namespace rv;
+
+
+void
+XmlRpcValueWriter::append(XmlRpc::XmlRpcValue& value, std::string& xml)
+{
+  char scalar[64];
+
+  switch (value.getType()) {
+    case XmlRpc::XmlRpcValue::TypeBoolean:
+      xml += static_cast<bool&>(value) ? "<value><boolean>1</boolean></value>" : "<value><boolean>0</boolean></value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeInt:
+      snprintf(scalar, sizeof(scalar), "%d", static_cast<int&>(value));
+      xml += "<value><i4>";
+      xml += scalar;
+      xml += "</i4></value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeDouble:
+      // The precision toXml uses
+      snprintf(scalar, sizeof(scalar), "%.17g", static_cast<double&>(value));
+      xml += "<value><double>";
+      xml += scalar;
+      xml += "</double></value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeString:
+      xml += "<value>";
+      appendEncoded(static_cast<std::string&>(value), xml);
+      xml += "</value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeDateTime:
+    {
+      struct tm& t = value;
+      snprintf(scalar, sizeof(scalar), "%4d%02d%02dT%02d:%02d:%02d",
+               t.tm_year, t.tm_mon, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+      xml += "<value><dateTime.iso8601>";
+      xml += scalar;
+      xml += "</dateTime.iso8601></value>";
+      break;
+    }
+
+    case XmlRpc::XmlRpcValue::TypeBase64:
+      xml += "<value><base64>";
+      appendBase64(static_cast<XmlRpc::XmlRpcValue::BinaryData&>(value), xml);
+      xml += "</base64></value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeArray:
+      xml += "<value><array><data>";
+      for (int i = 0; i < value.size(); ++i)
+        append(value[i], xml);
+      xml += "</data></array></value>";
+      break;
+
+    case XmlRpc::XmlRpcValue::TypeStruct:
+      xml += "<value><struct>";
+      for (XmlRpc::XmlRpcValue::iterator it = value.begin(); it != value.end(); ++it) {
+        xml += "<member><name>";
+        appendEncoded(it->first, xml);
+        xml += "</name>";
+        append(it->second, xml);
+        xml += "</member>";
+      }
+      xml += "</struct></value>";
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+void
+XmlRpcValueWriter::appendEncoded(const std::string& s, std::string& xml)
+{
+  static const char RESERVED[] = "<>&'\"";
+
+  size_t start = 0;
+  for (;;) {
+    size_t found = s.find_first_of(RESERVED, start);
+    if (found == std::string::npos) {
+      xml.append(s, start, std::string::npos);
+      return;
+    }
+    xml.append(s, start, found - start);
+    switch (s[found]) {
+      case '<':  xml += "&lt;";   break;
+      case '>':  xml += "&gt;";   break;
+      case '&':  xml += "&amp;";  break;
+      case '\'': xml += "&apos;"; break;
+      default:   xml += "&quot;"; break;
+    }
+    start = found + 1;
+  }
+}
+
+
+void
+XmlRpcValueWriter::appendBase64(const XmlRpc::XmlRpcValue::BinaryData& data, std::string& xml)
+{
+  static const char DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  xml.reserve(xml.size() + (data.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for ( ; i + 2 < data.size(); i += 3) {
+    unsigned bits = ((unsigned char) data[i] << 16) | ((unsigned char) data[i+1] << 8) | (unsigned char) data[i+2];
+    xml += DIGITS[(bits >> 18) & 0x3f];
+    xml += DIGITS[(bits >> 12) & 0x3f];
+    xml += DIGITS[(bits >> 6) & 0x3f];
+    xml += DIGITS[bits & 0x3f];
+  }
+  if (i < data.size()) {
+    unsigned bits = (unsigned char) data[i] << 16;
+    if (i + 1 < data.size())
+      bits |= (unsigned char) data[i+1] << 8;
+    xml += DIGITS[(bits >> 18) & 0x3f];
+    xml += DIGITS[(bits >> 12) & 0x3f];
+    xml += (i + 1 < data.size()) ? DIGITS[(bits >> 6) & 0x3f] : '=';
+    xml += '=';
+  }
+}
@@ -0,0 +1,264 @@
+/* rv::XmlRpcDispatch with each of its backends, over socket pairs */
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "rv/XmlRpcDispatch.h"
+#include "rv/XmlRpcSocket.h"
+#include "rv/XmlRpcSource.h"
+
+using rv::XmlRpcDispatch;
+
+namespace
+{
+/* A source whose events are handled by a function, by default one that
+ * drains the socket and keeps watching for the same events
+ */
+struct Source : rv::XmlRpcSource
+{
+  Source(int fd, unsigned mask) : XmlRpcSource(fd), mask(mask), calls(0), events(0)
+  {
+    handler = [this](unsigned) { return this->mask; };
+  }
+
+  unsigned handleEvent(unsigned eventType)
+  {
+    ++calls;
+    events |= eventType;
+    if (eventType == XmlRpcDispatch::ReadableEvent)
+    {
+      drain();
+    }
+    return handler(eventType);
+  }
+
+  void drain()
+  {
+    char buffer[256];
+    while (read(getfd(), buffer, sizeof(buffer)) > 0)
+      ;
+  }
+
+  unsigned mask;
+  std::function<unsigned(unsigned)> handler;
+  int calls;
+  unsigned events;
+};
+
+struct SocketPair
+{
+  SocketPair()
+  {
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    EXPECT_TRUE(rv::XmlRpcSocket::setNonBlocking(fds[0]));
+  }
+
+  ~SocketPair()
+  {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+
+  void send()
+  {
+    EXPECT_EQ(1, write(fds[1], "x", 1));
+  }
+
+  int fds[2];
+};
+
+class Dispatch : public testing::TestWithParam<XmlRpcDispatch::Backend>
+{
+protected:
+  Dispatch() : dispatch(GetParam())
+  {
+  }
+
+  /* Handle the events of one short wait */
+  void work()
+  {
+    dispatch.work(0.01);
+  }
+
+  XmlRpcDispatch dispatch;
+};
+}
+
+TEST_P(Dispatch, ReadableAndWritableEventsAreDelivered)
+{
+  SocketPair reading, writing;
+  Source reader(reading.fds[0], XmlRpcDispatch::ReadableEvent);
+  Source writer(writing.fds[0], XmlRpcDispatch::WritableEvent);
+  dispatch.addSource(&reader, reader.mask);
+  dispatch.addSource(&writer, writer.mask);
+
+  work();
+  EXPECT_EQ(0, reader.calls);
+  EXPECT_LT(0, writer.calls);
+  EXPECT_EQ(unsigned(XmlRpcDispatch::WritableEvent), writer.events);
+
+  reading.send();
+  work();
+  EXPECT_LT(0, reader.calls);
+  EXPECT_EQ(unsigned(XmlRpcDispatch::ReadableEvent), reader.events);
+
+  // A source watching for nothing gets nothing
+  int const calls = writer.calls;
+  dispatch.setSourceEvents(&writer, 0);
+  work();
+  EXPECT_EQ(calls, writer.calls);
+}
+
+TEST_P(Dispatch, SourceRemovedByAnotherHandlerIsNotCalled)
+{
+  SocketPair first, second;
+  Source* sources[2] = { new Source(first.fds[0], XmlRpcDispatch::ReadableEvent),
+                         new Source(second.fds[0], XmlRpcDispatch::ReadableEvent) };
+  int removed = -1;
+  for (int i = 0; i < 2; ++i)
+  {
+    // Whichever is handled first removes and frees the other
+    sources[i]->handler = [&, i](unsigned) {
+      Source*& other = sources[1 - i];
+      if (other)
+      {
+        dispatch.removeSource(other);
+        delete other;
+        other = nullptr;
+        removed = 1 - i;
+      }
+      return unsigned(XmlRpcDispatch::ReadableEvent);
+    };
+    dispatch.addSource(sources[i], XmlRpcDispatch::ReadableEvent);
+  }
+
+  // Both are ready in the same pass
+  first.send();
+  second.send();
+  work();
+  ASSERT_NE(-1, removed);
+  Source* remaining = sources[1 - removed];
+  ASSERT_TRUE(remaining);
+  EXPECT_EQ(1, remaining->calls);
+  dispatch.removeSource(remaining);
+  delete remaining;
+}
+
+TEST_P(Dispatch, SourceRemovedAndAddedAgainIsWatched)
+{
+  SocketPair pair;
+  Source source(pair.fds[0], XmlRpcDispatch::ReadableEvent);
+  dispatch.addSource(&source, source.mask);
+
+  dispatch.removeSource(&source);
+  pair.send();
+  work();
+  EXPECT_EQ(0, source.calls);
+
+  dispatch.addSource(&source, source.mask);
+  work();
+  EXPECT_EQ(1, source.calls);
+
+  // The same from within its own handler
+  source.handler = [&](unsigned) {
+    dispatch.removeSource(&source);
+    dispatch.addSource(&source, XmlRpcDispatch::ReadableEvent);
+    return unsigned(XmlRpcDispatch::ReadableEvent);
+  };
+  pair.send();
+  work();
+  EXPECT_EQ(2, source.calls);
+  pair.send();
+  work();
+  EXPECT_EQ(3, source.calls);
+}
+
+TEST_P(Dispatch, SourceThatChangesItsFdIsWatchedOnTheNewOne)
+{
+  SocketPair pair;
+  int replacement[2] = { -1, -1 };
+  Source source(pair.fds[0], XmlRpcDispatch::ReadableEvent);
+  dispatch.addSource(&source, source.mask);
+
+  // The handler reconnects: the new descriptor likely reuses the old number
+  source.handler = [&](unsigned) {
+    ::close(source.getfd());
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, replacement));
+    rv::XmlRpcSocket::setNonBlocking(replacement[0]);
+    source.setfd(replacement[0]);
+    source.handler = [&source](unsigned) { return source.mask; };
+    return source.mask;
+  };
+  pair.send();
+  work();
+  ASSERT_EQ(1, source.calls);
+  pair.fds[0] = -1;
+
+  EXPECT_EQ(1, write(replacement[1], "x", 1));
+  work();
+  EXPECT_EQ(2, source.calls);
+
+  // And when it changes outside of work()
+  ::close(source.getfd());
+  ::close(replacement[1]);
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, replacement));
+  rv::XmlRpcSocket::setNonBlocking(replacement[0]);
+  source.setfd(replacement[0]);
+  dispatch.setSourceEvents(&source, source.mask);
+  EXPECT_EQ(1, write(replacement[1], "x", 1));
+  work();
+  EXPECT_EQ(3, source.calls);
+
+  dispatch.removeSource(&source);
+  ::close(replacement[0]);
+  ::close(replacement[1]);
+}
+
+TEST_P(Dispatch, DescriptorBeyondFdSetSizeIsOnlySkippedBySelect)
+{
+  rlimit limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+  if (limit.rlim_cur <= FD_SETSIZE)
+  {
+    limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, FD_SETSIZE + 16);
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  SocketPair low, high;
+  int const highFd = dup2(high.fds[0], FD_SETSIZE + 8);
+  if (highFd < 0)
+  {
+    std::cout << "Cannot open descriptors beyond FD_SETSIZE, skipping" << std::endl;
+    return;
+  }
+
+  Source lowSource(low.fds[0], XmlRpcDispatch::ReadableEvent);
+  Source highSource(highFd, XmlRpcDispatch::ReadableEvent);
+  dispatch.addSource(&lowSource, lowSource.mask);
+  dispatch.addSource(&highSource, highSource.mask);
+  low.send();
+  high.send();
+  work();
+
+  // The other sources are still served
+  EXPECT_EQ(1, lowSource.calls);
+  EXPECT_EQ(dispatch.getBackend() == XmlRpcDispatch::SelectBackend ? 0 : 1, highSource.calls);
+
+  dispatch.removeSource(&lowSource);
+  dispatch.removeSource(&highSource);
+  ::close(highFd);
+}
+
+INSTANTIATE_TEST_CASE_P(XmlRpcDispatch, Dispatch,
+                        testing::Values(XmlRpcDispatch::SelectBackend, XmlRpcDispatch::EpollBackend,
+                                        XmlRpcDispatch::EpollEdgeBackend));
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,183 @@
+/* rv::XmlRpcRequestParser against the parsing XmlRpcServerConnection did
+ * before it, with XmlRpcUtil::parseTag, findTag and nextTagIs and an
+ * XmlRpcValue per parameter.
+ */
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "XmlRpcUtil.h"
+#include "XmlRpcValue.h"
+#include "rv/XmlRpcRequestParser.h"
+
+using XmlRpc::XmlRpcValue;
+
+namespace
+{
+std::string call(std::string const& method, std::vector<std::string> const& params)
+{
+  std::string xml = "<?xml version=\"1.0\"?>\r\n<methodCall><methodName>" + method + "</methodName>\r\n<params>";
+  for (std::string const& param : params)
+  {
+    xml += "<param>" + param + "</param>";
+  }
+  return xml + "</params></methodCall>\r\n";
+}
+
+std::string parseTags(std::string const& xml, XmlRpcValue& params)
+{
+  int offset = 0;
+  std::string methodName = XmlRpc::XmlRpcUtil::parseTag("<methodName>", xml, &offset);
+  if (methodName.size() > 0 && XmlRpc::XmlRpcUtil::findTag("<params>", xml, &offset))
+  {
+    int nArgs = 0;
+    while (XmlRpc::XmlRpcUtil::nextTagIs("<param>", xml, &offset))
+    {
+      params[nArgs++] = XmlRpcValue(xml, &offset);
+      (void)XmlRpc::XmlRpcUtil::nextTagIs("</param>", xml, &offset);
+    }
+    (void)XmlRpc::XmlRpcUtil::nextTagIs("</params>", xml, &offset);
+  }
+  return methodName;
+}
+
+bool parseOnePass(std::string const& xml, std::string& methodName, XmlRpcValue& params)
+{
+  return rv::XmlRpcRequestParser(xml.data(), xml.data() + xml.size()).parse(methodName, params);
+}
+
+/* Both parsers yield the same method name and parameters for xml */
+void expectSameAsTags(std::string const& xml)
+{
+  XmlRpcValue expected, actual;
+  std::string const expectedName = parseTags(xml, expected);
+  std::string actualName;
+  ASSERT_TRUE(parseOnePass(xml, actualName, actual)) << xml;
+  EXPECT_EQ(expectedName, actualName) << xml;
+  EXPECT_EQ(expected.toXml(), actual.toXml()) << xml;
+}
+
+bool rejects(std::string const& xml)
+{
+  std::string methodName;
+  XmlRpcValue params;
+  return !parseOnePass(xml, methodName, params);
+}
+}
+
+TEST(XmlRpcRequestParser, ScalarsMatchTheTagParser)
+{
+  expectSameAsTags(call("getPid", { "<value>/rvmaster</value>" }));
+  expectSameAsTags(call("setParam", { "<value><string>/a</string></value>", "<value><i4>-42</i4></value>",
+                                      "<value><int>7</int></value>", "<value><boolean>1</boolean></value>",
+                                      "<value><double>0.25</double></value>" }));
+  expectSameAsTags(call("setParam", { "<value><dateTime.iso8601>20240131T23:59:58</dateTime.iso8601></value>" }));
+  expectSameAsTags(call("setParam", { "<value><base64>aGVsbG8gd29ybGQ=</base64></value>" }));
+  expectSameAsTags(call("setParam", { "<value>joint &amp; link &lt;3&gt; &quot;a&apos;</value>" }));
+}
+
+TEST(XmlRpcRequestParser, ContainersMatchTheTagParser)
+{
+  expectSameAsTags(call("setParam", { "<value><array><data><value><i4>1</i4></value><value>two</value>"
+                                      "<value><array><data><value><double>3.5</double></value></data></array></value>"
+                                      "</data></array></value>" }));
+  expectSameAsTags(call("setParam", { "<value><array><data></data></array></value>" }));
+  expectSameAsTags(call("setParam", { "<value><struct><member><name>gain</name><value><double>0.5</double></value>"
+                                      "</member><member><name>a &amp; b</name><value><struct><member><name>x</name>"
+                                      "<value><i4>1</i4></value></member></struct></value></member></struct></value>" }));
+  expectSameAsTags(call("setParam", { "<value><struct></struct></value>" }));
+
+  std::string calls;
+  for (int i = 0; i < 4; ++i)
+  {
+    calls += "<value><struct><member><name>methodName</name><value>lookupNode</value></member>"
+             "<member><name>params</name><value><array><data><value>/rvmaster</value><value>/node_" +
+             std::to_string(i) + "</value></data></array></value></member></struct></value>";
+  }
+  expectSameAsTags(call("system.multicall", { "<value><array><data>" + calls + "</data></array></value>" }));
+}
+
+TEST(XmlRpcRequestParser, IndentedRequestMatchesTheTagParser)
+{
+  expectSameAsTags("<?xml version=\"1.0\"?>\n"
+                   "<methodCall>\n"
+                   "  <methodName>registerSubscriber</methodName>\n"
+                   "  <params>\n"
+                   "    <param>\n"
+                   "      <value><string>/listener</string></value>\n"
+                   "    </param>\n"
+                   "    <param>\n"
+                   "      <value>\n"
+                   "        <array>\n"
+                   "          <data>\n"
+                   "            <value><i4>1</i4></value>\n"
+                   "            <value><string>two</string></value>\n"
+                   "          </data>\n"
+                   "        </array>\n"
+                   "      </value>\n"
+                   "    </param>\n"
+                   "  </params>\n"
+                   "</methodCall>\n");
+}
+
+TEST(XmlRpcRequestParser, RequestWithoutParameters)
+{
+  std::string methodName;
+  XmlRpcValue params;
+  ASSERT_TRUE(parseOnePass("<methodCall><methodName>getSystemState</methodName></methodCall>", methodName, params));
+  EXPECT_EQ("getSystemState", methodName);
+  EXPECT_EQ(0, params.size());
+
+  ASSERT_TRUE(parseOnePass("<methodCall><methodName>getUri</methodName><params/></methodCall>", methodName, params));
+  EXPECT_EQ("getUri", methodName);
+  EXPECT_EQ(0, params.size());
+}
+
+TEST(XmlRpcRequestParser, ValuesHaveTheirTypes)
+{
+  std::string methodName;
+  XmlRpcValue params;
+  ASSERT_TRUE(parseOnePass(call("setParam", { "<value/>", "<value><string/></value>", "<value><i4>12</i4></value>",
+                                              "<value><boolean>0</boolean></value>", "<value><double>-1.5</double></value>",
+                                              "<value><base64>AAEC</base64></value>" }),
+                           methodName, params));
+  ASSERT_EQ(6, params.size());
+  EXPECT_EQ(XmlRpcValue::TypeString, params[0].getType());
+  EXPECT_EQ("", static_cast<std::string&>(params[0]));
+  EXPECT_EQ("", static_cast<std::string&>(params[1]));
+  EXPECT_EQ(12, static_cast<int&>(params[2]));
+  EXPECT_FALSE(static_cast<bool&>(params[3]));
+  EXPECT_EQ(-1.5, static_cast<double&>(params[4]));
+  XmlRpcValue::BinaryData const& bytes = params[5];
+  EXPECT_EQ(XmlRpcValue::BinaryData({ 0, 1, 2 }), bytes);
+}
+
+TEST(XmlRpcRequestParser, MalformedRequestsAreRejected)
+{
+  EXPECT_TRUE(rejects(""));
+  EXPECT_TRUE(rejects("<methodCall><params></params></methodCall>"));
+  EXPECT_TRUE(rejects("<methodCall><methodName>getPid"));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><i4>12</int></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><i4>twelve</i4></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><boolean>2</boolean></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><double>1.5x</double></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><base64>a!b</base64></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><nil/></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><array><value>1</value></array></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value><struct><member><value>1</value></member></struct></value>" })));
+  EXPECT_TRUE(rejects(call("setParam", { "<value>unterminated" })));
+
+  // Cut anywhere, a request is incomplete
+  std::string const complete = call("setParam", { "<value><struct><member><name>a</name><value><i4>1</i4></value>"
+                                                  "</member></struct></value>" });
+  for (size_t length = complete.find("<params>") + 9; length < complete.find("</params>"); ++length)
+  {
+    EXPECT_TRUE(rejects(complete.substr(0, length))) << complete.substr(0, length);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,333 @@
+/* rv::XmlRpcServer executing methods on worker threads, and adding and
+ * removing methods while requests run
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "rv/XmlRpcServer.h"
+#include "rv/XmlRpcServerMethod.h"
+
+using namespace rv;
+
+namespace
+{
+/* A server whose work() runs on a thread of its own until paused */
+struct RunningServer
+{
+  explicit RunningServer(unsigned workers) : stopping(false)
+  {
+    server.setWorkerThreads(workers);
+    EXPECT_TRUE(server.bindAndListen(0, 16));
+  }
+
+  ~RunningServer()
+  {
+    pause();
+  }
+
+  void start()
+  {
+    stopping = false;
+    thread = std::thread([this] {
+      while (!stopping)
+        server.work(0.02);
+    });
+  }
+
+  void pause()
+  {
+    stopping = true;
+    if (thread.joinable())
+      thread.join();
+  }
+
+  XmlRpcServer server;
+  std::atomic<bool> stopping;
+  std::thread thread;
+};
+
+class Echo : public XmlRpcServerMethod2
+{
+public:
+  explicit Echo(XmlRpcServer* server) : XmlRpcServerMethod2("echo", server) {}
+
+  void execute(XmlRpc::XmlRpcValue& params, ClientInfo&, XmlRpc::XmlRpcValue& result)
+  {
+    // Vary how long calls take, so that they finish out of order
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int&>(params[0]) % 3));
+    result = params[0];
+  }
+};
+
+/* Echoes once opened, after telling that it was entered */
+class Gate : public XmlRpcServerMethod2
+{
+public:
+  explicit Gate(XmlRpcServer* server) : XmlRpcServerMethod2("gate", server), entered(0), open(false) {}
+
+  ~Gate()
+  {
+    release();
+  }
+
+  void execute(XmlRpc::XmlRpcValue& params, ClientInfo&, XmlRpc::XmlRpcValue& result)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ++entered;
+    changed.notify_all();
+    changed.wait(lock, [this] { return open; });
+    result = params[0];
+  }
+
+  bool waitEntered(int calls = 1)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, std::chrono::seconds(5), [this, calls] { return entered >= calls; });
+  }
+
+  void release()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    open = true;
+    changed.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  int entered;
+  bool open;
+};
+
+/* Removes itself from the server, then echoes */
+class RemoveSelf : public XmlRpcServerMethod2
+{
+public:
+  explicit RemoveSelf(XmlRpcServer* server) : XmlRpcServerMethod2("remove_self", server) {}
+
+  void execute(XmlRpc::XmlRpcValue& params, ClientInfo&, XmlRpc::XmlRpcValue& result)
+  {
+    _server->removeMethod(this);
+    result = params[0];
+  }
+};
+
+/* A keep-alive client connection */
+struct Client
+{
+  explicit Client(XmlRpcServer& server)
+  {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.get_port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+    timeval timeout = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+
+  ~Client()
+  {
+    close(fd);
+  }
+
+  void send(std::string const& method, int n)
+  {
+    std::string const body = "<?xml version=\"1.0\"?><methodCall><methodName>" + method +
+                             "</methodName><params><param><value><i4>" + std::to_string(n) +
+                             "</i4></value></param></params></methodCall>";
+    std::string const request =
+        "POST / HTTP/1.1\r\nContent-length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    EXPECT_EQ(ssize_t(request.size()), write(fd, request.data(), request.size()));
+  }
+
+  /* The body of the next response, or nothing if none comes within 5 seconds */
+  std::string receive()
+  {
+    for (;;)
+    {
+      size_t const end = buffered.find("\r\n\r\n");
+      size_t const length = buffered.find("Content-length: ");
+      if (end != std::string::npos && length != std::string::npos && length < end)
+      {
+        size_t const size = std::stoul(buffered.substr(length + 16));
+        if (buffered.size() >= end + 4 + size)
+        {
+          std::string const body = buffered.substr(end + 4, size);
+          buffered.erase(0, end + 4 + size);
+          return body;
+        }
+      }
+      char chunk[4096];
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n <= 0)
+        return std::string();
+      buffered.append(chunk, n);
+    }
+  }
+
+  /* Whether the server closed the connection, without answering */
+  bool closed()
+  {
+    char byte;
+    return buffered.empty() && read(fd, &byte, 1) == 0;
+  }
+
+  int fd;
+  std::string buffered;
+};
+
+std::string answer(int n)
+{
+  return "<value><i4>" + std::to_string(n) + "</i4></value>";
+}
+
+bool contains(std::string const& body, std::string const& what)
+{
+  return body.find(what) != std::string::npos;
+}
+}
+
+TEST(XmlRpcServer, SlowMethodDoesNotHoldUpOtherClients)
+{
+  RunningServer running(2);
+  Gate gate(&running.server);
+  Echo echo(&running.server);
+  running.start();
+
+  Client slow(running.server), fast(running.server);
+  slow.send("gate", 1);
+  ASSERT_TRUE(gate.waitEntered());
+  fast.send("echo", 2);
+  EXPECT_TRUE(contains(fast.receive(), answer(2)));
+
+  gate.release();
+  EXPECT_TRUE(contains(slow.receive(), answer(1)));
+}
+
+TEST(XmlRpcServer, ResponsesReachTheirConnections)
+{
+  RunningServer running(4);
+  Echo echo(&running.server);
+  running.start();
+
+  std::vector<std::unique_ptr<Client>> clients;
+  for (int i = 0; i < 8; ++i)
+    clients.emplace_back(new Client(running.server));
+  for (int round = 0; round < 20; ++round)
+  {
+    for (size_t i = 0; i < clients.size(); ++i)
+      clients[i]->send("echo", round * 100 + int(i));
+    for (size_t i = 0; i < clients.size(); ++i)
+      EXPECT_TRUE(contains(clients[i]->receive(), answer(round * 100 + int(i)))) << round << " " << i;
+  }
+}
+
+TEST(XmlRpcServer, RemoveMethodWaitsForTheRunningCall)
+{
+  RunningServer running(2);
+  Gate gate(&running.server);
+  running.start();
+
+  Client client(running.server);
+  client.send("gate", 1);
+  ASSERT_TRUE(gate.waitEntered());
+
+  std::future<void> removed = std::async(std::launch::async, [&] { running.server.removeMethod(&gate); });
+  EXPECT_EQ(std::future_status::timeout, removed.wait_for(std::chrono::milliseconds(200)));
+  EXPECT_EQ(nullptr, running.server.findMethod("gate"));
+
+  gate.release();
+  EXPECT_EQ(std::future_status::ready, removed.wait_for(std::chrono::seconds(5)));
+  EXPECT_TRUE(contains(client.receive(), answer(1)));
+}
+
+TEST(XmlRpcServer, MethodRemovingItselfDoesNotWaitForItself)
+{
+  for (unsigned workers = 0; workers < 2; ++workers)
+  {
+    RunningServer running(workers);
+    RemoveSelf method(&running.server);
+    running.start();
+
+    Client client(running.server);
+    client.send("remove_self", 7);
+    EXPECT_TRUE(contains(client.receive(), answer(7))) << workers << " workers";
+    EXPECT_EQ(nullptr, running.server.findMethod("remove_self"));
+  }
+}
+
+TEST(XmlRpcServer, RequestsLeftByTheWorkersRunWithoutThem)
+{
+  RunningServer running(1);
+  Gate gate(&running.server);
+  Echo echo(&running.server);
+  running.start();
+
+  // The only worker runs the first request, the second waits for it
+  Client first(running.server), second(running.server);
+  first.send("gate", 1);
+  ASSERT_TRUE(gate.waitEntered());
+  second.send("echo", 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  running.pause();
+  std::thread release([&gate] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    gate.release();
+  });
+  running.server.setWorkerThreads(0);
+  release.join();
+  running.start();
+
+  EXPECT_TRUE(contains(first.receive(), answer(1)));
+  EXPECT_TRUE(contains(second.receive(), answer(2)));
+
+  // And later requests run in work()
+  second.send("echo", 3);
+  EXPECT_TRUE(contains(second.receive(), answer(3)));
+}
+
+TEST(XmlRpcServer, ShutdownClosesConnectionsWithPendingRequests)
+{
+  RunningServer running(1);
+  Gate gate(&running.server);
+  Echo echo(&running.server);
+  running.start();
+
+  Client first(running.server), second(running.server);
+  first.send("gate", 1);
+  ASSERT_TRUE(gate.waitEntered());
+  second.send("echo", 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  running.pause();
+  std::thread release([&gate] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    gate.release();
+  });
+  running.server.shutdown();
+  release.join();
+
+  EXPECT_TRUE(first.closed());
+  EXPECT_TRUE(second.closed());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
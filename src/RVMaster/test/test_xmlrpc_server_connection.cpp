@@ -0,0 +1,126 @@
+/* Requests a client sends before the answer to the previous one, with each
+ * backend of the dispatcher and without worker threads
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "rv/XmlRpcDispatch.h"
+#include "rv/XmlRpcServer.h"
+#include "rv/XmlRpcServerMethod.h"
+
+using namespace rv;
+
+namespace
+{
+class Echo : public XmlRpcServerMethod2
+{
+public:
+  explicit Echo(XmlRpcServer* server) : XmlRpcServerMethod2("echo", server) {}
+
+  void execute(XmlRpc::XmlRpcValue& params, ClientInfo&, XmlRpc::XmlRpcValue& result)
+  {
+    result = params[0];
+  }
+};
+
+std::string request(std::string const& body)
+{
+  return "POST / HTTP/1.1\r\nContent-length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string echo(int n)
+{
+  return request("<?xml version=\"1.0\"?><methodCall><methodName>echo</methodName><params><param><value>" +
+                 std::to_string(n) + "</value></param></params></methodCall>");
+}
+
+size_t count(std::string const& s, std::string const& what)
+{
+  size_t n = 0;
+  for (size_t at = s.find(what); at != std::string::npos; at = s.find(what, at + 1))
+    ++n;
+  return n;
+}
+
+class PipelinedRequests : public testing::TestWithParam<XmlRpcDispatch::Backend>
+{
+protected:
+  /* Send requests in one write and read until count answers arrived or
+   * nothing arrives for a second
+   */
+  std::string exchange(std::string const& requests, size_t answers)
+  {
+    XmlRpcDispatch::setDefaultBackend(GetParam());
+    XmlRpcServer server;
+    Echo method(&server);
+    EXPECT_TRUE(server.bindAndListen(0));
+    std::atomic<bool> stopping(false);
+    std::thread worker([&] {
+      while (!stopping)
+        server.work(0.05);
+    });
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.get_port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+    timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    EXPECT_EQ(ssize_t(requests.size()), write(fd, requests.data(), requests.size()));
+
+    std::string received;
+    char buffer[4096];
+    while (count(received, "HTTP/1.1 200 OK") < answers)
+    {
+      ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n <= 0)
+        break;
+      received.append(buffer, n);
+    }
+
+    close(fd);
+    stopping = true;
+    worker.join();
+    return received;
+  }
+};
+}
+
+TEST_P(PipelinedRequests, AllAreAnswered)
+{
+  std::string const received = exchange(echo(1) + echo(2) + echo(3), 3);
+  EXPECT_EQ(3u, count(received, "HTTP/1.1 200 OK")) << received;
+  size_t const first = received.find(">1<"), second = received.find(">2<"), third = received.find(">3<");
+  ASSERT_NE(std::string::npos, third) << received;
+  EXPECT_LT(first, second);
+  EXPECT_LT(second, third);
+}
+
+TEST_P(PipelinedRequests, MalformedRequestGetsAFault)
+{
+  std::string const malformed = request("<methodCall><methodName>echo</methodName><params><param><value><i4>x</i4>"
+                                        "</value></param></params></methodCall>");
+  std::string const received = exchange(malformed + echo(2), 2);
+  EXPECT_EQ(2u, count(received, "HTTP/1.1 200 OK")) << received;
+  EXPECT_EQ(1u, count(received, "<name>faultCode</name>")) << received;
+  EXPECT_NE(std::string::npos, received.find(">2<")) << received;
+}
+
+INSTANTIATE_TEST_CASE_P(XmlRpcServerConnection, PipelinedRequests,
+                        testing::Values(XmlRpcDispatch::SelectBackend, XmlRpcDispatch::EpollBackend,
+                                        XmlRpcDispatch::EpollEdgeBackend));
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+/* Non-blocking reads and writes of rv::XmlRpcSocket on a socket pair */
+
+#include <csignal>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "rv/XmlRpcSocket.h"
+
+using rv::XmlRpcSocket;
+
+namespace
+{
+struct SocketPair
+{
+  SocketPair()
+  {
+    EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    // A small send buffer, so that large writes are partial
+    int size = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    EXPECT_TRUE(XmlRpcSocket::setNonBlocking(fds[0]));
+    EXPECT_TRUE(XmlRpcSocket::setNonBlocking(fds[1]));
+  }
+  ~SocketPair()
+  {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+
+  /* Read what is available at the other end */
+  std::string drain()
+  {
+    std::string received;
+    bool eof;
+    EXPECT_TRUE(XmlRpcSocket::nbRead(fds[1], received, &eof));
+    return received;
+  }
+
+  int fds[2];
+};
+
+std::string pattern(char first, size_t length)
+{
+  std::string s(length, ' ');
+  for (size_t i = 0; i < length; ++i)
+  {
+    s[i] = char(first + i % 23);
+  }
+  return s;
+}
+
+struct iovec part(std::string const& s)
+{
+  struct iovec v;
+  v.iov_base = const_cast<char*>(s.data());
+  v.iov_len = s.size();
+  return v;
+}
+}
+
+TEST(XmlRpcSocket, WritevResumesAfterPartialWrites)
+{
+  SocketPair sockets;
+  std::string const header = "HTTP/1.1 200 OK\r\nContent-length: 123456\r\n\r\n";
+  std::string const prologue = "<?xml version=\"1.0\"?>\r\n<methodResponse><params><param>\r\n\t";
+  std::string const body = pattern('a', 300000);
+  std::string const epilogue = "\r\n</param></params></methodResponse>\r\n";
+  struct iovec const parts[] = { part(header), part(prologue), part(body), part(epilogue) };
+  std::string const expected = header + prologue + body + epilogue;
+
+  std::string received;
+  int bytesWritten = 0;
+  int writes = 0;
+  while (bytesWritten < int(expected.size()))
+  {
+    ASSERT_TRUE(XmlRpcSocket::nbWrite(sockets.fds[0], parts, 4, &bytesWritten));
+    ASSERT_LE(bytesWritten, int(expected.size()));
+    ++writes;
+    received += sockets.drain();
+    ASSERT_LT(writes, 100000);
+  }
+  received += sockets.drain();
+  EXPECT_GT(writes, 1);
+  EXPECT_EQ(int(expected.size()), bytesWritten);
+  EXPECT_EQ(expected, received);
+}
+
+TEST(XmlRpcSocket, WritevSkipsTheBytesAlreadyWritten)
+{
+  std::string const strings[] = { "header|", "", "prologue|", "body|", "epilogue" };
+  struct iovec const parts[] = { part(strings[0]), part(strings[1]), part(strings[2]), part(strings[3]), part(strings[4]) };
+  std::string const whole = strings[0] + strings[1] + strings[2] + strings[3] + strings[4];
+
+  // Resuming at every offset, including part boundaries and an empty part
+  for (int offset = 0; offset <= int(whole.size()); ++offset)
+  {
+    SocketPair sockets;
+    int bytesWritten = offset;
+    ASSERT_TRUE(XmlRpcSocket::nbWrite(sockets.fds[0], parts, 5, &bytesWritten));
+    EXPECT_EQ(int(whole.size()), bytesWritten);
+    EXPECT_EQ(whole.substr(offset), sockets.drain()) << offset;
+  }
+}
+
+TEST(XmlRpcSocket, WriteFailsOnAClosedPeer)
+{
+  SocketPair sockets;
+  ::close(sockets.fds[1]);
+  sockets.fds[1] = socket(AF_UNIX, SOCK_STREAM, 0);
+  std::string const message = "lost";
+  struct iovec const parts[] = { part(message) };
+  int bytesWritten = 0;
+  signal(SIGPIPE, SIG_IGN);
+  EXPECT_FALSE(XmlRpcSocket::nbWrite(sockets.fds[0], parts, 1, &bytesWritten));
+}
+
+TEST(XmlRpcSocket, ReadStopsAtTheExpectedLength)
+{
+  SocketPair sockets;
+  std::string first = pattern('A', 1000), second = pattern('a', 500);
+  std::string both = first + second;
+  int bytesWritten = 0;
+  ASSERT_TRUE(XmlRpcSocket::nbWrite(sockets.fds[0], both, &bytesWritten));
+
+  std::string received;
+  bool eof;
+  ASSERT_TRUE(XmlRpcSocket::nbRead(sockets.fds[1], received, &eof, first.size()));
+  EXPECT_FALSE(eof);
+  EXPECT_EQ(first.size(), received.size());
+  EXPECT_EQ(first, received.substr(0, first.size()));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
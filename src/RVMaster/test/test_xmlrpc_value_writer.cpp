@@ -0,0 +1,118 @@
+/* rv::XmlRpcValueWriter against XmlRpcValue::toXml, which it replaces when
+ * RVMaster writes responses.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <time.h>
+#include <gtest/gtest.h>
+#include "XmlRpcValue.h"
+#include "rv/XmlRpcValueWriter.h"
+
+using XmlRpc::XmlRpcValue;
+
+namespace
+{
+std::string write(XmlRpcValue& value)
+{
+  std::string xml;
+  rv::XmlRpcValueWriter::append(value, xml);
+  return xml;
+}
+
+XmlRpcValue dateTime()
+{
+  struct tm t = {};
+  t.tm_year = 2024;
+  t.tm_mon = 1;
+  t.tm_mday = 31;
+  t.tm_hour = 23;
+  t.tm_min = 5;
+  t.tm_sec = 9;
+  return XmlRpcValue(&t);
+}
+}
+
+TEST(XmlRpcValueWriter, ScalarsMatchToXml)
+{
+  // Doubles that print the same at any precision
+  XmlRpcValue values[] = { XmlRpcValue(true), XmlRpcValue(false), XmlRpcValue(-42), XmlRpcValue(0.5),
+                           XmlRpcValue(-1250.0), XmlRpcValue(std::string("/rvmaster")),
+                           XmlRpcValue(std::string("a < b && c > 'd' \"e\"")), XmlRpcValue(std::string()),
+                           dateTime() };
+  for (XmlRpcValue& value : values)
+  {
+    EXPECT_EQ(value.toXml(), write(value));
+  }
+}
+
+TEST(XmlRpcValueWriter, ContainersMatchToXml)
+{
+  // A getSystemState answer
+  XmlRpcValue state;
+  state[0] = 1;
+  state[1] = std::string("current system state");
+  for (int kind = 0; kind < 3; ++kind)
+  {
+    XmlRpcValue& topics = state[2][kind];
+    topics.setSize(0);
+    for (int i = 0; i < 4; ++i)
+    {
+      topics[i][0] = "/topic_" + std::to_string(i);
+      topics[i][1][0] = std::string("/node_a");
+      topics[i][1][1] = std::string("/node_<b>");
+    }
+  }
+  EXPECT_EQ(state.toXml(), write(state));
+
+  XmlRpcValue params;
+  params["gain"] = 0.25;
+  params["label & name"] = std::string("joint");
+  params["nested"]["flag"] = true;
+  params["nested"]["list"][0] = 3;
+  EXPECT_EQ(params.toXml(), write(params));
+
+  XmlRpcValue empty;
+  empty.setSize(0);
+  EXPECT_EQ(empty.toXml(), write(empty));
+}
+
+TEST(XmlRpcValueWriter, DoublesRoundTrip)
+{
+  double const doubles[] = { 0.1, 1.0 / 3.0, -2.5e-300, 6.02214076e23 };
+  for (double d : doubles)
+  {
+    XmlRpcValue value(d);
+    std::string const xml = write(value);
+    std::string const open = "<value><double>";
+    ASSERT_EQ(0u, xml.find(open)) << xml;
+    EXPECT_EQ(d, std::strtod(xml.c_str() + open.size(), nullptr)) << xml;
+  }
+}
+
+TEST(XmlRpcValueWriter, Base64)
+{
+  char const bytes[] = "hello world";
+  XmlRpcValue padded2((void*)bytes, 11), padded1((void*)bytes, 10), unpadded((void*)bytes, 9), empty((void*)bytes, 0);
+  EXPECT_EQ("<value><base64>aGVsbG8gd29ybGQ=</base64></value>", write(padded2));
+  EXPECT_EQ("<value><base64>aGVsbG8gd29ybA==</base64></value>", write(padded1));
+  EXPECT_EQ("<value><base64>aGVsbG8gd29y</base64></value>", write(unpadded));
+  EXPECT_EQ("<value><base64></base64></value>", write(empty));
+}
+
+TEST(XmlRpcValueWriter, AppendsToTheBuffer)
+{
+  XmlRpcValue one(1), two(std::string("two"));
+  std::string xml = "<params><param>";
+  rv::XmlRpcValueWriter::append(one, xml);
+  xml += "</param><param>";
+  rv::XmlRpcValueWriter::append(two, xml);
+  xml += "</param></params>";
+  EXPECT_EQ("<params><param><value><i4>1</i4></value></param><param><value>two</value></param></params>", xml);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
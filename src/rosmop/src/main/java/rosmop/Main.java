@@ -28,6 +28,7 @@ import com.runtimeverification.rvmonitor.logicrepository.plugins.LogicPluginFact
 import com.runtimeverification.rvmonitor.util.RVMException;
 
 import rosmop.codegen.CppGenerator;
+import rosmop.codegen.GeneratorUtil;
 import rosmop.codegen.HeaderGenerator;
 import rosmop.parser.ast.ROSEvent;
 import rosmop.parser.ast.MonitorFile;
@@ -67,6 +68,12 @@ public class Main {
                                 .hasArg().argName("path-prefix")
                                 .build()
                          );
+        options.addOption(Option.builder()
+                                .longOpt("dl-scalar")
+                                .desc("Scalar type of dL monitors: float, double or long-double (default).")
+                                .hasArg().argName("type")
+                                .build()
+                         );
         CommandLineParser parser = new DefaultParser();
         CommandLine line = null; 
         try { line = parser.parse(options, argv); }
@@ -77,6 +84,9 @@ public class Main {
             System.exit(1);
         }
         monitorAsRosNode = line.hasOption("monitor-as-node");
+        if (line.hasOption("dl-scalar")) {
+            GeneratorUtil.dlScalar = parseDLScalar(line.getOptionValue("dl-scalar"));
+        }
         String outputPrefix = null;
         if (line.hasOption("output-prefix")) {
             outputPrefix = line.getOptionValue("output-prefix");
@@ -92,6 +102,15 @@ public class Main {
         process(parsed, outputPrefix);
     }
 
+    private static String parseDLScalar(String name)
+        throws ROSMOPException
+    {
+        for (String[] scalar : GeneratorUtil.DL_SCALARS) {
+            if (scalar[0].equals(name)) return scalar[1];
+        }
+        throw new ROSMOPException("Unknown dL scalar type: " + name);
+    }
+
     /**
      * Replace each directory in the input args with the list of files it contains
      */
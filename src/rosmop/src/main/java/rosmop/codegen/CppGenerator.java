@@ -3,6 +3,8 @@ package rosmop.codegen;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.util.*;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
 
 import org.apache.commons.io.FilenameUtils;
 
@@ -11,6 +13,7 @@ import rosmop.RVParserAdapter;
 import rosmop.parser.ast.ROSEvent;
 import rosmop.parser.ast.Specification;
 import rosmop.parser.ast.Variable;
+import rosmop.util.AccessAnalyzer;
 import rosmop.util.MessageParser;
 import rosmop.util.Tool;
 
@@ -45,6 +48,13 @@ public class CppGenerator {
         return "callback_" + e.getName();
     }
 
+    /**
+     * The label of an event's handler in the monitor's latency statistics.
+     */
+    public static String handlerNameForEvent(String specName, Event e) {
+        return "\"" + specName + "::" + e.getName() + "\"";
+    }
+
     public static String getPatternForParameter(Event e, Variable v) {
         ROSEvent event = (ROSEvent) e;
         return event.getPattern().get(v.getDeclaredName());
@@ -61,9 +71,198 @@ public class CppGenerator {
         events.sort(Comparator.comparing(x -> x.getName()));
         return events;
     }
+
+    /**
+     * Groups the events of a specification by topic, keeping the order of
+     * {@link CppGenerator#getEventsForCSpecification(CSpecification)} within each topic.
+     */
+    public static Map<String, List<Event>> getEventsByTopic(CSpecification cspec) {
+        Map<String, List<Event>> eventsByTopic = new LinkedHashMap<>();
+        for (Event event : getEventsForCSpecification(cspec)) {
+            eventsByTopic.computeIfAbsent(getTopicForEvent(event), t -> new ArrayList<>()).add(event);
+        }
+        return eventsByTopic;
+    }
+
+    /**
+     * Registers the per-message handlers of a topic as a compile-time rv::monitor::EventList,
+     * so that the monitor calls them directly instead of through std::function.
+     * The handlers of a read-only topic take const messages, which is how the monitor
+     * knows it may forward the topic's messages as received.
+     */
+    public static void printEventListRegistration(String specName, String topic, List<Event> events) {
+        String msgType = getMessageTypeForTopic(topic);
+        List<Event> messageEvents = new ArrayList<>();
+        for (Event event : events) {
+            if (!((ROSEvent) event).isBatch()) messageEvents.add(event);
+        }
+        if (messageEvents.isEmpty()) return;
+        List<String> names = new ArrayList<>();
+        for (Event event : messageEvents) {
+            names.add(handlerNameForEvent(specName, event));
+        }
+        String arguments = "\"" + topic + "\", this, " + selectorArgument(specName, topic, events)
+                         + ", {" + String.join(", ", names) + "}";
+        printer.printLn("monitor.registerEvents<" + msgType);
+        printer.indent();
+        printer.print(", rv::monitor::EventList<" + specName + ", " + handlerMessageType(topic, events));
+        for (Event event : messageEvents) {
+            printer.printLn();
+            printer.print("    , &" + specName + "::" + callbackNameForEvent(event));
+        }
+        printer.printLn(">");
+        printer.printLn(">(" + arguments + ");");
+        printer.unindent();
+    }
+
+    /**
+     * Registers the batch events of a topic, each with its own batch.
+     */
+    public static void printBatchRegistrations(String specName, String topic, List<Event> events) {
+        for (Event e : events) {
+            ROSEvent event = (ROSEvent) e;
+            if (!event.isBatch()) continue;
+            printer.printLn("monitor.registerBatchEvent<" + getMessageTypeForTopic(topic) + ">(\"" + topic + "\", this"
+                            + ", &" + specName + "::" + callbackNameForEvent(event)
+                            + ", " + event.getBatchOptions() + ", " + selectorArgument(specName, topic, events)
+                            + ", " + handlerNameForEvent(specName, event) + ");");
+        }
+    }
+
+    /**
+     * Declares dl_state_batch, the structure-of-arrays rv::dl::StateBatch of the spec's states,
+     * and push_state(), which appends the current pair of states to one.
+     */
+    public static void printDLStateBatch(List<String> variables) {
+        printer.printLn("using dl_state_batch = rv::dl::StateBatch< modelplex_generated::state, modelplex_generated::scalar");
+        printer.printLn("                                         , " + variables.size() + ", 64>;");
+        printer.printLn("void push_state(dl_state_batch& batch) const");
+        printer.printLn("{");
+        printer.indent();
+        printer.printLn("static modelplex_generated::scalar modelplex_generated::state::* const fields[] = {");
+        printer.indent();
+        for (int i = 0; i < variables.size(); ++i) {
+            printer.printLn("&modelplex_generated::state::" + variables.get(i) + (i + 1 < variables.size() ? "," : ""));
+        }
+        printer.unindent();
+        printer.printLn("};");
+        printer.printLn("batch.push(monitorState.prevState, monitorState.currState, fields);");
+        printer.unindent();
+        printer.printLn("}");
+    }
+
+    private static final Pattern DL_STATE_LOOKUP = Pattern.compile("(prevStateMap|currStateMap)\\[\\s*\"(\\w+)\"\\s*\\]");
+
+    /**
+     * Replaces the by-name lookups of the DL plugin's functions in rv::dl::MonitorState
+     * with enumerators of dl_variable, so that they compile to a bit index.
+     * Adds the variables to the list in order of first use.
+     */
+    public static String indexDLVariables(String generatedFunctions, List<String> variables) {
+        Matcher lookup = DL_STATE_LOOKUP.matcher(generatedFunctions);
+        StringBuffer indexed = new StringBuffer();
+        while (lookup.find()) {
+            String variable = lookup.group(2);
+            if (!variables.contains(variable)) variables.add(variable);
+            lookup.appendReplacement(indexed, Matcher.quoteReplacement(
+                    lookup.group(1) + "[size_t(dl_variable::" + variable + ")]"));
+        }
+        lookup.appendTail(indexed);
+        return indexed.toString();
+    }
+
+    /**
+     * The field selector argument of a topic's registrations, nullptr if it has none.
+     */
+    public static String selectorArgument(String specName, String topic, List<Event> events) {
+        if (isReadOnly(events) && getFieldPathsForEvents(events) != null) {
+            return "&" + specName + "::" + selectorNameForTopic(topic);
+        }
+        return "nullptr";
+    }
+
+    /**
+     * Sets the queue policy of a topic if one of its events names one.
+     * The first such event wins; ~queues/ parameters override it at run time.
+     */
+    public static void printQueueOptions(String topic, List<Event> events) {
+        for (Event event : events) {
+            String options = ((ROSEvent) event).getQueueOptions();
+            if (options != null) {
+                printer.printLn("monitor.setQueueOptions(\"" + topic + "\", " + options + ");");
+                return;
+            }
+        }
+    }
+
+    public static boolean isReadOnly(List<Event> events) {
+        return events.stream().allMatch(e -> ((ROSEvent) e).isReadOnly());
+    }
+
+    /**
+     * The type of the message the handlers of a topic take by reference: const if
+     * all the topic's events are read-only, so that a write the analysis misses
+     * fails to compile instead of being dropped when the message is forwarded.
+     */
+    public static String handlerMessageType(String topic, List<Event> events) {
+        return getMessageTypeForTopic(topic) + (isReadOnly(events) ? " const" : "");
+    }
+
+    public static String selectorNameForTopic(String topic) {
+        return "fields_" + getCNameForTopic(topic).replaceAll("\\W", "_");
+    }
+
+    /**
+     * Collects the message fields that a group of events reads: the fields their
+     * parameters are bound to and the fields their actions access through message.
+     * Indexed fields are read as a whole.
+     * @return The field paths, or null if some event uses the whole message
+     */
+    public static Set<String> getFieldPathsForEvents(List<Event> events) {
+        Set<String> paths = new LinkedHashSet<>();
+        for (Event e : events) {
+            ROSEvent event = (ROSEvent) e;
+            // Batch events without parameters collect whole messages
+            if (event.isBatch() && event.getParameters() == null) return null;
+            if (event.getParameters() != null) {
+                for (Variable parameter : event.getParameters()) {
+                    paths.add(getPatternForParameter(event, parameter).split("\\[")[0]);
+                }
+            }
+            if (event.isBatch()) continue;
+            Set<String> messagePaths = AccessAnalyzer.fieldPaths(event.getAction(), "message");
+            if (messagePaths == null) return null;
+            paths.addAll(messagePaths);
+        }
+        return paths;
+    }
+
+    /**
+     * Prints a field selector for each read-only topic of a specification, so that
+     * the monitor decodes only the fields its events read.
+     */
+    public static void printFieldSelectors(CSpecification cspec) {
+        for (Map.Entry<String, List<Event>> entry : getEventsByTopic(cspec).entrySet()) {
+            Set<String> paths = getFieldPathsForEvents(entry.getValue());
+            if (!isReadOnly(entry.getValue()) || paths == null) continue;
+            printer.printLn("/* Fields of " + entry.getKey() + " read by the events */");
+            printer.printLn("static void " + selectorNameForTopic(entry.getKey())
+                            + "(rv::monitor::FieldSelection& fields, "
+                            + getMessageTypeForTopic(entry.getKey()) + " const& message)");
+            printer.printLn("{");
+            printer.indent();
+            paths.forEach(path -> printer.printLn("fields.add(message." + path + ");"));
+            printer.unindent(); printer.printLn("}");
+        }
+    }
+
     public static void printParameterBindingsForEvent(ROSEvent event) {
+        if (event.getParameters() == null) return;
+        // Read-only events bind const references so that missed writes fail to compile
+        String qualifier = event.isReadOnly() ? "const " : "";
         for (Variable parameter : event.getParameters()) {
             printer.printLn();
+            printer.print(qualifier);
 
             if (parameter.getType().endsWith("[]")) {
                 printer.print("vector<" + parameter.getType().replace("[]", "")
@@ -76,6 +275,97 @@ public class CppGenerator {
         }
     }
 
+    /**
+     * Prints the batch type of a batch event: the bound fields of its messages
+     * as arrays, or the messages themselves if it binds no parameters.
+     */
+    public static void printBatchType(ROSEvent event) {
+        String msgType = getMessageTypeForTopic(event.getTopic());
+        String batchType = batchTypeForEvent(event);
+        List<String> names = new ArrayList<>();
+        List<String> sources = new ArrayList<>();
+        printer.printLn("/* " + event.getName() + ": one element per message of a batch */");
+        printer.printLn("struct " + batchType);
+        printer.printLn("{");
+        printer.indent();
+        if (event.getParameters() == null) {
+            printer.printLn("vector<" + msgType + "> messages;");
+            names.add("messages");
+            sources.add("message");
+        } else {
+            for (Variable parameter : event.getParameters()) {
+                printer.printLn("vector<" + elementTypeForParameter(parameter) + "> " + parameter.getDeclaredName() + ";");
+                names.add(parameter.getDeclaredName());
+                sources.add("message." + event.getPattern().get(parameter.getDeclaredName()));
+            }
+        }
+        printer.printLn("size_t size() const { return " + names.get(0) + ".size(); }");
+        printer.print("void clear() {");
+        names.forEach(name -> printer.print(" " + name + ".clear();"));
+        printer.printLn(" }");
+        printer.printLn("static void append(" + batchType + "& batch, " + msgType + " const& message)");
+        printer.printLn("{");
+        printer.indent();
+        for (int i = 0; i < names.size(); ++i) {
+            printer.printLn("batch." + names.get(i) + ".push_back(" + sources.get(i) + ");");
+        }
+        printer.unindent(); printer.printLn("}");
+        printer.unindent(); printer.printLn("};");
+    }
+
+    public static String batchTypeForEvent(Event e) {
+        return "batch_" + e.getName();
+    }
+
+    private static String elementTypeForParameter(Variable parameter) {
+        if (parameter.getType().endsWith("[]")) {
+            return "vector<" + parameter.getType().replace("[]", "") + ">";
+        }
+        return parameter.getType();
+    }
+
+    public static void printBatchBindingsForEvent(ROSEvent event) {
+        if (event.getParameters() == null) {
+            printer.printLn("const vector<" + getMessageTypeForTopic(event.getTopic())
+                            + ">& messages = batch.messages;");
+            return;
+        }
+        for (Variable parameter : event.getParameters()) {
+            printer.printLn("const vector<" + elementTypeForParameter(parameter) + ">& "
+                            + parameter.getDeclaredName() + " = batch." + parameter.getDeclaredName() + ";");
+        }
+    }
+
+    /**
+     * Prints a nodelet hosting all specifications, for monitors built with
+     * RV_MONITOR_NODELET defined to the name of the nodelet class.
+     */
+    public static void printNodelet(Set<CSpecification> cspecs) {
+        printer.printLn("#include <rv/monitor_nodelet.h>");
+        printer.printLn();
+        printer.printLn("namespace rosmop_generated");
+        printer.printLn("{"); printer.indent();
+        printer.printLn("struct Specs");
+        printer.printLn("{"); printer.indent();
+        List<String> initializers = new ArrayList<>();
+        for (CSpecification cspec : cspecs) {
+            printer.printLn("rosmop_generated::" + cspec.getSpecName() + " " + cspec.getSpecName() + ";");
+            initializers.add(cspec.getSpecName() + "(monitor)");
+        }
+        printer.printLn();
+        printer.printLn("Specs(rv::monitor::Monitor& monitor)");
+        for (int i = 0; i < initializers.size(); ++i) {
+            printer.printLn((i == 0 ? "    : " : "    , ") + initializers.get(i));
+        }
+        printer.printLn("{");
+        printer.printLn("}");
+        printer.unindent(); printer.printLn("};");
+        printer.printLn();
+        printer.printLn("struct RV_MONITOR_NODELET : rv::monitor::MonitorNodelet<Specs> {};");
+        printer.unindent(); printer.printLn("}");
+        printer.printLn("PLUGINLIB_EXPORT_CLASS(rosmop_generated::RV_MONITOR_NODELET, nodelet::Nodelet)");
+    }
+
     public static void generateCpp(HashMap<CSpecification, LogicPluginShellResult> toWrite,
                                    String outputPath, boolean monitorAsNode)
         throws FileNotFoundException, ROSMOPException, java.io.IOException
@@ -102,15 +392,48 @@ public class CppGenerator {
 
             printer.printLn(cspec.getDeclarations());
 
+            DLConjuncts conjuncts = null;
 
             // DL Specific Code
             // Todo: Make this generic by passing ToolName via rv-monitor
             if(!isRawSpec && cspec.getFormalism().equalsIgnoreCase("DL")) {
-                printer.printLn("rv::dl::MonitorState< modelplex_generated::state" + "\n" +
-                        "                                 , modelplex_generated::parameters> monitorState;");
-
                 // DL Plugin generated code
                 String generatedFunctions = (String) shellResult.properties.getOrDefault("generated functions", "");
+                generatedFunctions = GeneratorUtil.withDLScalar(generatedFunctions, "modelplex_generated::scalar");
+                if (!GeneratorUtil.dlScalar.equals("long double")) {
+                    System.err.println("rosmop: warning: " + cspec.getSpecName() + " checks its dL formula in "
+                                       + GeneratorUtil.dlScalar + " instead of long double. Rounding may accept "
+                                       + "states closer to the boundary of the safe region than the model allows.");
+                }
+                DLConjuncts formula = DLConjuncts.find((String) shellResult.properties.getOrDefault("monitoring body", ""));
+                if (formula != null && formula.incremental()) {
+                    conjuncts = formula;
+                    generatedFunctions = conjuncts.withCache(generatedFunctions, "dl_conjuncts");
+                }
+                List<String> variables = new ArrayList<>();
+                generatedFunctions = indexDLVariables(generatedFunctions, variables);
+                if (variables.size() > 64) {
+                    throw new ROSMOPException("dL specification " + cspec.getSpecName()
+                                              + " has more than 64 variables");
+                }
+                if (!variables.isEmpty()) {
+                    printer.printLn("enum class dl_variable : size_t { " + String.join(", ", variables) + " };");
+                }
+
+                printer.printLn("rv::dl::MonitorState< modelplex_generated::state" + "\n" +
+                        "                                 , modelplex_generated::parameters" + "\n" +
+                        "                                 , modelplex_generated::scalar> monitorState;");
+                if (!variables.isEmpty()) {
+                    printDLStateBatch(variables);
+                    if (formula == null || !formula.printBatchKernel(printer, variables, GeneratorUtil.dlScalar)) {
+                        System.err.println("rosmop: warning: the dL formula of " + cspec.getSpecName()
+                                           + " cannot be checked in batches; check_states() is not generated.");
+                    }
+                }
+                if (conjuncts != null) {
+                    printer.printLn(conjuncts.cacheType("modelplex_generated::scalar") + " dl_conjuncts;");
+                }
+
                 Arrays.asList(generatedFunctions.split("\n")).forEach(line -> printer.printLn(line));
             }
 
@@ -123,29 +446,43 @@ public class CppGenerator {
             }
             */
 
+            Map<String, List<Event>> eventsByTopic = getEventsByTopic(cspec);
             for (Event event : getEventsForCSpecification(cspec)) {
+                if (((ROSEvent) event).isBatch()) {
+                    printBatchType((ROSEvent) event);
+                    printer.printLn("void " + callbackNameForEvent(event) + "(" + batchTypeForEvent(event) + "& batch)");
+                    printer.printLn("{");
+                    printer.indent();
+                    printBatchBindingsForEvent((ROSEvent) event);
+                    String action = conjuncts == null ? event.getAction() : conjuncts.withCache(event.getAction(), "dl_conjuncts");
+                    Arrays.stream(action.substring(1,action.length()-1).split("\n"))
+                          .forEach(x -> printer.printLn(x.trim()));
+                    printer.unindent(); printer.printLn("}");
+                    continue;
+                }
                 printer.printLn("/* " + event.getName() + " */");
+                String topic = getTopicForEvent(event);
                 printer.printLn("void " + callbackNameForEvent(event) +
-                                "(" + getMessageTypeForTopic(getTopicForEvent(event)) + "& message)");
+                                "(" + handlerMessageType(topic, eventsByTopic.get(topic)) + "& message)");
                 printer.printLn("{");
                 printer.indent();
                 printParameterBindingsForEvent((ROSEvent) event);
-                String action = event.getAction();
+                String action = conjuncts == null ? event.getAction() : conjuncts.withCache(event.getAction(), "dl_conjuncts");
                 Arrays.stream(action.substring(1,action.length()-1).split("\n"))
                       .forEach(x -> printer.printLn(x.trim()));
                 printer.unindent(); printer.printLn("}");
             }
 
+            printFieldSelectors(cspec);
+
             // Spec's constructor
             printer.printLn();
             printer.printLn(cspec.getSpecName() + "(rv::monitor::Monitor& monitor) {");
             printer.indent();
-            for (Event event : getEventsForCSpecification(cspec)) {
-                String topic = getTopicForEvent(event);
-                printer.printLn("monitor.registerEvent<" + getMessageTypeForTopic(topic) + ">(" +
-                                          "\"" + topic + "\", this, "
-                                          + " &" + cspec.getSpecName() + "::" + callbackNameForEvent(event)
-                                          + ");");
+            for (Map.Entry<String, List<Event>> entry : eventsByTopic.entrySet()) {
+                printQueueOptions(entry.getKey(), entry.getValue());
+                printEventListRegistration(cspec.getSpecName(), entry.getKey(), entry.getValue());
+                printBatchRegistrations(cspec.getSpecName(), entry.getKey(), entry.getValue());
             }
 
             // Any Generated Code to be inserted into constructor
@@ -165,6 +502,9 @@ public class CppGenerator {
         printer.unindent(); printer.printLn("};");
 
         printer.printLn();
+        printer.printLn("#ifdef RV_MONITOR_NODELET");
+        printNodelet(toWrite.keySet());
+        printer.printLn("#else");
         printer.printLn("int main(int argc, char ** argv) {");
         printer.indent();
         printer.printLn("rv::monitor::Monitor monitor(argc, argv, \"rvmonitor\");");
@@ -173,6 +513,7 @@ public class CppGenerator {
         }
         printer.printLn("return monitor.run();");
         printer.unindent(); printer.printLn("};");
+        printer.printLn("#endif");
 
         Tool.writeFile(printer.getSource(), outputPath);
     }
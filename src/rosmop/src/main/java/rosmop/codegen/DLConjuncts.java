@@ -0,0 +1,257 @@
+package rosmop.codegen;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+/**
+ * The top-level conjuncts of the ModelPlex monitor function of a dL specification,
+ * with the inputs each of them reads.
+ *
+ * The DL plugin emits the monitor as a function of the previous state, the current
+ * state and a pointer to the parameters that returns one boolean expression. Most
+ * of that expression is a chain of &&, and many of its conjuncts read only a few
+ * of the variables. The header declares an overload of the monitor that caches the
+ * value of each conjunct in an rv::dl::ConjunctCache and re-evaluates a conjunct
+ * only when one of its inputs has changed since the previous check.
+ */
+public final class DLConjuncts {
+
+    private static final Pattern MONITOR = Pattern.compile(
+            "bool\\s+(\\w+)\\s*\\(\\s*((?:const\\s+)?state\\s*&?\\s*(\\w+)\\s*,"
+            + "\\s*(?:const\\s+)?state\\s*&?\\s*(\\w+)\\s*,"
+            + "\\s*(?:const\\s+)?parameters\\s*\\*\\s*(?:const\\s+)?(\\w+))\\s*\\)"
+            + "\\s*\\{\\s*return\\s+([^;]*);\\s*\\}");
+
+    /** A floating point literal, with its suffix if any */
+    private static final Pattern FLOATING_LITERAL = Pattern.compile(
+            "(?<![\\w.])(?:(?:\\d+\\.\\d*|\\.\\d+)(?:[eE][+-]?\\d+)?|\\d+[eE][+-]?\\d+)[fFlL]?(?![\\w.])");
+
+    /** Name of the monitor function */
+    public final String name;
+
+    /** Parameter list of the monitor function */
+    public final String parameters;
+
+    /** Names of the previous state, the current state and the parameters in the monitor function */
+    private String prev, curr, params;
+
+    /** Fields of the states and parameters the formula reads, e.g. "pre.l" or "params->m" */
+    public final List<String> inputs = new ArrayList<>();
+
+    /** The conjuncts, in order of evaluation */
+    public final List<String> conjuncts = new ArrayList<>();
+
+    /** For each conjunct, a bit mask of the inputs it reads */
+    public final List<Long> depends = new ArrayList<>();
+
+    private DLConjuncts(String name, String parameters) {
+        this.name = name;
+        this.parameters = parameters;
+    }
+
+    /**
+     * Splits the monitor function of the DL plugin's monitoring body into conjuncts
+     * @param monitoringBody The plugin's C++ code
+     * @return The conjuncts, or null if the body has no monitor function of the
+     * expected shape, or it reads no input, or more than 64 inputs or conjuncts
+     */
+    public static DLConjuncts find(String monitoringBody) {
+        Matcher monitor = MONITOR.matcher(monitoringBody);
+        if (!monitor.find()) {
+            return null;
+        }
+        DLConjuncts result = new DLConjuncts(monitor.group(1), monitor.group(2));
+        result.prev = monitor.group(3);
+        result.curr = monitor.group(4);
+        result.params = monitor.group(5);
+        split(monitor.group(6), result.conjuncts);
+        if (result.conjuncts.size() > 64) {
+            return null;
+        }
+
+        Pattern input = Pattern.compile("\\b(?:(?:" + monitor.group(3) + "|" + monitor.group(4) + ")\\s*\\.|"
+                                        + monitor.group(5) + "\\s*->)\\s*\\w+");
+        for (String conjunct : result.conjuncts) {
+            long mask = 0;
+            Matcher read = input.matcher(conjunct);
+            while (read.find()) {
+                String field = read.group().replaceAll("\\s+", "");
+                if (!result.inputs.contains(field)) {
+                    result.inputs.add(field);
+                }
+                int index = result.inputs.indexOf(field);
+                if (index >= 64) {
+                    return null;
+                }
+                mask |= 1L << index;
+            }
+            result.depends.add(mask);
+        }
+        return result.inputs.isEmpty() ? null : result;
+    }
+
+    /**
+     * Whether caching the conjuncts can save work, that is whether there are several
+     */
+    public boolean incremental() {
+        return conjuncts.size() > 1;
+    }
+
+    /**
+     * Adds the cache argument to the calls of the monitor function in code
+     */
+    public String withCache(String code, String cache) {
+        return code.replaceAll("\\b" + name + "\\s*\\(([^()]*(?:\\([^()]*\\)[^()]*)*)\\)",
+                               Matcher.quoteReplacement(name) + "($1, " + Matcher.quoteReplacement(cache) + ")");
+    }
+
+    /**
+     * The C++ type of the cache
+     * @param scalar The scalar type of the monitor
+     */
+    public String cacheType(String scalar) {
+        return "rv::dl::ConjunctCache<" + inputs.size() + ", " + scalar + ">";
+    }
+
+    /**
+     * Prints the overload of the monitor function that takes the cache
+     */
+    public void printIncrementalMonitor(SourcePrinter printer) {
+        List<String> masks = new ArrayList<>();
+        for (long mask : depends) {
+            masks.add("0x" + Long.toHexString(mask));
+        }
+        printer.printLn("/* " + name + ", re-evaluating only the conjuncts whose inputs changed since the previous check */");
+        printer.printLn("inline bool " + name + "(" + parameters + ", " + cacheType("scalar") + "& conjuncts)");
+        printer.printLn("{");
+        printer.indent();
+        printer.printLn("static uint64_t const depends[] = { " + String.join(", ", masks) + " };");
+        printer.printLn("scalar const inputs[] = { " + String.join(", ", inputs) + " };");
+        printer.printLn("conjuncts.observe(inputs, depends);");
+        for (int i = 0; i < conjuncts.size(); ++i) {
+            printer.printLn((i == 0 ? "return " : "    && ") + "conjuncts.holds(" + i + ", [&] { return "
+                            + conjuncts.get(i) + "; })" + (i + 1 == conjuncts.size() ? ";" : ""));
+        }
+        printer.unindent();
+        printer.printLn("}");
+    }
+
+    /**
+     * Prints dl_batch_kernel, the monitor function as the kernel of rv::dl::StateBatch::check(),
+     * and check_states(), which evaluates it over a dl_state_batch with the monitor's parameters.
+     * The kernel reads the states by dl_variable and combines conditions with & and |, so that
+     * it also evaluates SIMD vectors of states. Its floating point literals are cast to scalar:
+     * GCC does not combine a vector with a constant that its element type cannot represent exactly.
+     * @param variables The enumerators of dl_variable
+     * @param scalar The element type of the state vectors
+     * @return False, printing nothing, if the formula calls a function, reads a state variable
+     * that is not one of variables, or reads no state at all
+     */
+    public boolean printBatchKernel(SourcePrinter printer, List<String> variables, String scalar) {
+        Pattern read = Pattern.compile("\\b(" + prev + "|" + curr + ")\\s*\\.\\s*(\\w+)|\\b" + params + "\\s*->\\s*(\\w+)");
+        List<String> vectorized = new ArrayList<>();
+        boolean readsState = false;
+        for (String conjunct : conjuncts) {
+            if (Pattern.compile("\\w\\s*\\(|\\?").matcher(conjunct).find()) {
+                return false;
+            }
+            Matcher field = read.matcher(conjunct);
+            StringBuffer kernel = new StringBuffer();
+            while (field.find()) {
+                String replacement;
+                if (field.group(1) != null) {
+                    if (!variables.contains(field.group(2))) {
+                        return false;
+                    }
+                    readsState = true;
+                    replacement = field.group(1) + "[size_t(dl_variable::" + field.group(2) + ")]";
+                } else {
+                    replacement = params + "." + field.group(3);
+                }
+                field.appendReplacement(kernel, Matcher.quoteReplacement(replacement));
+            }
+            field.appendTail(kernel);
+            String typed = FLOATING_LITERAL.matcher(kernel).replaceAll(Matcher.quoteReplacement("(" + scalar + ")") + "$0");
+            vectorized.add(typed.replace("&&", "&").replace("||", "|"));
+        }
+        if (!readsState) {
+            return false;
+        }
+
+        printer.printLn("/* " + name + " over the states of a dl_state_batch, see check_states() */");
+        printer.printLn("struct dl_batch_kernel");
+        printer.printLn("{");
+        printer.indent();
+        printer.printLn("template <typename V, typename P>");
+        printer.printLn("auto operator()(V const* " + prev + ", V const* " + curr + ", P const& " + params + ") const");
+        printer.printLn("    -> decltype(" + prev + "[0] <= " + prev + "[0])");
+        printer.printLn("{");
+        printer.indent();
+        for (int i = 0; i < vectorized.size(); ++i) {
+            printer.printLn((i == 0 ? "return " : "    & ") + vectorized.get(i) + (i + 1 == vectorized.size() ? ";" : ""));
+        }
+        printer.unindent();
+        printer.printLn("}");
+        printer.unindent();
+        printer.printLn("};");
+        printer.printLn("/* Store in verdicts whether each pair of states in batch satisfies " + name
+                        + ", and return the number of violations */");
+        printer.printLn("size_t check_states(dl_state_batch const& batch, bool* verdicts) const");
+        printer.printLn("{");
+        printer.indent();
+        printer.printLn("return batch.check(monitorState.params, dl_batch_kernel(), verdicts);");
+        printer.unindent();
+        printer.printLn("}");
+        return true;
+    }
+
+    /** Adds the top-level conjuncts of expression to conjuncts, flattening nested chains of && */
+    private static void split(String expression, List<String> conjuncts) {
+        String inner = unwrap(expression.trim());
+        List<String> parts = new ArrayList<>();
+        int depth = 0;
+        int start = 0;
+        for (int i = 0; i < inner.length(); ++i) {
+            char c = inner.charAt(i);
+            if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                --depth;
+            } else if (depth == 0 && inner.startsWith("&&", i)) {
+                parts.add(inner.substring(start, i));
+                start = i + 2;
+                ++i;
+            }
+        }
+        if (parts.isEmpty()) {
+            conjuncts.add("(" + inner + ")");
+            return;
+        }
+        parts.add(inner.substring(start));
+        for (String part : parts) {
+            split(part, conjuncts);
+        }
+    }
+
+    /** Removes the parentheses around all of expression, if any */
+    private static String unwrap(String expression) {
+        while (expression.startsWith("(") && expression.endsWith(")")) {
+            int depth = 0;
+            for (int i = 0; i < expression.length() - 1; ++i) {
+                char c = expression.charAt(i);
+                if (c == '(') {
+                    ++depth;
+                } else if (c == ')') {
+                    --depth;
+                }
+                if (depth == 0) {
+                    return expression;
+                }
+            }
+            expression = expression.substring(1, expression.length() - 1).trim();
+        }
+        return expression;
+    }
+}
@@ -34,4 +34,16 @@ public final class GeneratorUtil {
 	public static final String MONITOR_COPY_MSG_NAME = "rv_msg";
 
 	public static final String MONITOR_TOPICS_AND_TYPES = "topicsAndTypes";
+
+	/** Scalar types of dL monitors, by value of --dl-scalar */
+	public static final String[][] DL_SCALARS = { {"float", "float"}, {"double", "double"},
+	                                              {"long-double", "long double"} };
+
+	/** The C++ type of the ModelPlex variables of dL monitors (see rv::dl::MonitorState) */
+	public static String dlScalar = "long double";
+
+	/** Replaces the long double of the DL plugin's code with type */
+	public static String withDLScalar(String code, String type) {
+		return code.replaceAll("\\blong\\s+double\\b", type);
+	}
 }
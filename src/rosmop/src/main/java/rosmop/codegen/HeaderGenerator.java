@@ -56,11 +56,18 @@ public class HeaderGenerator {
 			boolean isRawSpec = (toWrite.get(rvcParser) == null);
 
 			if(!isRawSpec && rvcParser.getFormalism().equalsIgnoreCase("DL")) {
+				printer.printLn("#include <rv/dl.h>");
 				printer.printLn("namespace modelplex_generated");
 				printer.printLn("{");
 				printer.indent();
+				printer.printLn("using scalar = " + GeneratorUtil.dlScalar + ";");
 				String modelplexCpp = (String) toWrite.get(rvcParser).properties.getOrDefault("monitoring body", "\n");
+				modelplexCpp = GeneratorUtil.withDLScalar(modelplexCpp, "scalar");
 				Arrays.asList(modelplexCpp.split("\n")).forEach(l -> printer.printLn(l));
+				DLConjuncts conjuncts = DLConjuncts.find(modelplexCpp);
+				if (conjuncts != null && conjuncts.incremental()) {
+					conjuncts.printIncrementalMonitor(printer);
+				}
 			 	printer.unindent();
 				printer.printLn("};");
 			}
@@ -4,8 +4,11 @@ import java.util.ArrayList;
 import java.util.Collections;
 import java.util.HashMap;
 import java.util.List;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
 
 import rosmop.codegen.GeneratorUtil;
+import rosmop.util.AccessAnalyzer;
 import com.runtimeverification.rvmonitor.core.ast.Event;
 
 /**
@@ -237,6 +240,72 @@ public class ROSEvent extends Event {
         return parameters;
     }
 
+    /**
+     * An event is read-only if its action never modifies its bound parameters
+     * or the intercepted message; batch events always are. Topics whose events
+     * are all read-only are republished without being deserialized and
+     * serialized again.
+     * @return True if the action only reads the message
+     */
+    public boolean isReadOnly() {
+        if (isBatch()) return true;
+        String action = getAction();
+        if (parameters != null) {
+            for (Variable parameter : parameters) {
+                if (AccessAnalyzer.mayWrite(action, parameter.getDeclaredName(), false))
+                    return false;
+            }
+        }
+        return !AccessAnalyzer.mayWrite(action, "message", true);
+    }
+
+    /**
+     * The queue policy of the event's topic, given as one of the event modifiers
+     * keep_latest, drop_oldest_N, byte_budget_N or block_N.
+     * @return A C++ expression of type rv::monitor::QueueOptions, or null if
+     * no modifier sets the policy
+     */
+    public String getQueueOptions() {
+        for (String modifier : getModifiers()) {
+            if (modifier.equals("keep_latest"))
+                return "rv::monitor::QueueOptions::keepLatest()";
+            Matcher m = QUEUE_MODIFIER.matcher(modifier);
+            if (m.matches()) {
+                String factory = m.group(1).equals("drop_oldest") ? "dropOldest"
+                               : m.group(1).equals("byte_budget") ? "byteBudget" : "block";
+                return "rv::monitor::QueueOptions::" + factory + "(" + m.group(2) + ")";
+            }
+        }
+        return null;
+    }
+
+    /**
+     * Batch events are called with the bound fields of several messages at once,
+     * laid out as arrays. They are declared with one of the event modifiers
+     * batch_N (every N messages), batch_Tms (every T milliseconds) or batch_N_Tms.
+     * @return A C++ expression of type rv::monitor::BatchOptions, or null if
+     * this is not a batch event
+     */
+    public String getBatchOptions() {
+        for (String modifier : getModifiers()) {
+            Matcher m = BATCH_MODIFIER.matcher(modifier);
+            if (m.matches() && (m.group(1) != null || m.group(2) != null)) {
+                String count = m.group(1) != null ? m.group(1) : "0";
+                String period = m.group(2) != null ? m.group(2) : "0";
+                return "rv::monitor::BatchOptions(" + count + ", std::chrono::milliseconds(" + period + "))";
+            }
+        }
+        return null;
+    }
+
+    public boolean isBatch() {
+        return getBatchOptions() != null;
+    }
+
+    private static final Pattern BATCH_MODIFIER = Pattern.compile("batch(?:_([1-9][0-9]*))?(?:_([1-9][0-9]*)ms)?");
+
+    private static final Pattern QUEUE_MODIFIER = Pattern.compile("(drop_oldest|byte_budget|block)_([1-9][0-9]*)");
+
     public List<ROSEvent> getPublishKeywordEvents() {
         return publishKeywordEvents;
     }
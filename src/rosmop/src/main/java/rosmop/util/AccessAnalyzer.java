@@ -0,0 +1,93 @@
+package rosmop.util;
+
+import java.util.Arrays;
+import java.util.HashSet;
+import java.util.LinkedHashSet;
+import java.util.Set;
+import java.util.regex.Matcher;
+import java.util.regex.Pattern;
+
+/**
+ * Conservative syntactic check of whether an event action may modify a name
+ * (a bound parameter or the message itself).
+ *
+ * Events found read-only bind their parameters as const references, and the
+ * handlers of topics whose events are all read-only take the message as a
+ * const reference, so a write the analysis misses is rejected by the C++
+ * compiler instead of being silently dropped by the pass-through republisher.
+ */
+public class AccessAnalyzer {
+
+    /** Member functions that are known not to modify their object */
+    private static final Set<String> CONST_METHODS = new HashSet<String>(Arrays.asList(
+            "c_str", "data", "size", "length", "empty", "find", "rfind", "substr", "compare",
+            "count", "toSec", "toNSec", "isZero", "isValid"));
+
+    private static final String MEMBER_PATH = "(?:\\s*\\[[^\\]]*\\]|\\s*\\.\\s*\\w+)*";
+
+    private static final String ASSIGNMENT = "\\s*(?:[-+*/%&|^]|<<|>>)?=(?!=)";
+
+    /**
+     * Removes comments, string and character literals from an action
+     * @param action Action source of an event
+     * @return The action with literals and comments blanked out
+     */
+    public static String stripLiterals(String action) {
+        return action.replaceAll("/\\*(?:[^*]|\\*+[^*/])*\\*+/", " ")
+                     .replaceAll("//[^\\n]*", " ")
+                     .replaceAll("\"(?:[^\"\\\\]|\\\\.)*\"", "\"\"")
+                     .replaceAll("'(?:[^'\\\\]|\\\\.)*'", "''");
+    }
+
+    /**
+     * Checks whether an action may write to a name
+     * @param action Action source of an event
+     * @param name Name of a bound parameter or of the message
+     * @param byReference True if passing the name to a function may modify it
+     * @return False only if every use of name is a read
+     */
+    public static boolean mayWrite(String action, String name, boolean byReference) {
+        String code = stripLiterals(action);
+        String n = "(?<![\\w.>:])" + Pattern.quote(name) + "\\b";
+
+        if (Pattern.compile(n + MEMBER_PATH + ASSIGNMENT).matcher(code).find()) return true;
+        if (Pattern.compile(n + MEMBER_PATH + "\\s*(?:\\+\\+|--)").matcher(code).find()) return true;
+        if (Pattern.compile("(?:\\+\\+|--)\\s*" + n).matcher(code).find()) return true;
+        if (Pattern.compile("[(,=]\\s{0,16}&\\s*" + n).matcher(code).find()) return true;
+        if (byReference && Pattern.compile("[(,]\\s*" + n + MEMBER_PATH + "\\s*[),]").matcher(code).find()) return true;
+
+        // A non-const reference bound to the name, e.g. auto& p = message.pose
+        Matcher alias = Pattern.compile("(\\bconst\\b[\\w\\s:<>,]*)?&\\s*\\w+\\s*=\\s*" + n).matcher(code);
+        while (alias.find()) {
+            if (alias.group(1) == null) return true;
+        }
+
+        Matcher call = Pattern.compile(n + "(?:\\s*\\[[^\\]]*\\]|\\s*\\.\\s*\\w+)*?\\s*\\.\\s*(\\w+)\\s*\\(").matcher(code);
+        while (call.find()) {
+            if (!CONST_METHODS.contains(call.group(1))) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Collects the field paths through which an action reads a name,
+     * e.g. "header.stamp" for message.header.stamp.toSec()
+     * @param action Action source of an event
+     * @param name Name of the message
+     * @return The field paths, or null if the action uses the name as a whole
+     */
+    public static Set<String> fieldPaths(String action, String name) {
+        String code = stripLiterals(action);
+        Set<String> paths = new LinkedHashSet<String>();
+        Matcher use = Pattern.compile("(?<![\\w.>:])" + Pattern.quote(name) + "\\b((?:\\s*\\.\\s*\\w+)*)(\\s*\\()?")
+                             .matcher(code);
+        while (use.find()) {
+            String path = use.group(1).replaceAll("\\s", "");
+            // A trailing member followed by a parenthesis is a method call
+            if (use.group(2) != null && path.contains(".")) path = path.substring(0, path.lastIndexOf('.'));
+            if (path.isEmpty()) return null;
+            paths.add(path.substring(1));
+        }
+        return paths;
+    }
+}
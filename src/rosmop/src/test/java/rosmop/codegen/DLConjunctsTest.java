@@ -0,0 +1,28 @@
+package rosmop.codegen;
+
+import org.junit.*;
+
+import java.util.Arrays;
+
+import static org.assertj.core.api.Assertions.assertThat;
+
+
+public class DLConjunctsTest {
+
+    private static final String MONITOR =
+            "bool monitorSatisfied(state pre, state curr, const parameters* const params) {\n"
+            + "  return (0<=curr.l && curr.l<=params->m*0.1) && pre.l<=curr.l+1e-3L;\n"
+            + "}\n";
+
+    @Test
+    public void batchKernelCastsFloatingLiteralsToTheScalar() {
+        DLConjuncts conjuncts = DLConjuncts.find(MONITOR);
+        SourcePrinter printer = new SourcePrinter();
+        assertThat(conjuncts.printBatchKernel(printer, Arrays.asList("l"), "float")).isTrue();
+
+        String kernel = printer.getSource();
+        assertThat(kernel).contains("return (0<=curr[size_t(dl_variable::l)])");
+        assertThat(kernel).contains("& (curr[size_t(dl_variable::l)]<=params.m*(float)0.1)");
+        assertThat(kernel).contains("& (pre[size_t(dl_variable::l)]<=curr[size_t(dl_variable::l)]+(float)1e-3L);");
+    }
+}
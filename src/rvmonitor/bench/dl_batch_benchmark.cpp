@@ -0,0 +1,113 @@
+/* Throughput of the watertank dL check one state at a time, through the
+ * monitor function the dL plugin emits, and batched with rv::dl::StateBatch,
+ * through the kernel rosmop derives from that function.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <rv/dl.h>
+#include <rv/dl_batch.h>
+
+namespace
+{
+enum class dl_variable : size_t
+{
+  f,
+  l,
+  c
+};
+
+template <typename T>
+struct State
+{
+  T f, l, c;
+};
+
+template <typename T>
+struct Params
+{
+  T m, ep;
+};
+
+/* The controller monitor of specs/dl-watertank.rv as the dL plugin emits it */
+template <typename T>
+bool monitorSatisfied(State<T> pre, State<T> curr, Params<T> const* const params)
+{
+  return ((0.0) <= (pre.l)) && (((pre.l) <= (params->m)) && (((-1.0) <= (curr.f)) && ((curr.f) <= ((params->m)-(pre.l))/(params->ep))));
+}
+
+/* The kernel DLConjuncts::printBatchKernel() prints for monitorSatisfied */
+struct dl_batch_kernel
+{
+  template <typename V, typename P>
+  auto operator()(V const* pre, V const* curr, P const& params) const
+      -> decltype(pre[0] <= pre[0])
+  {
+    return ((0.0) <= (pre[size_t(dl_variable::l)]))
+        & ((pre[size_t(dl_variable::l)]) <= (params.m))
+        & ((-1.0) <= (curr[size_t(dl_variable::f)]))
+        & ((curr[size_t(dl_variable::f)]) <= ((params.m)-(pre[size_t(dl_variable::l)]))/(params.ep));
+  }
+};
+
+template <typename T>
+void run(char const* name, int rounds)
+{
+  size_t const capacity = 1024;
+  using Batch = rv::dl::StateBatch<State<T>, T, 3, capacity>;
+  static T State<T>::*const fields[] = { &State<T>::f, &State<T>::l, &State<T>::c };
+
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> level(0.0, 1.0);
+  std::normal_distribution<double> offset(0.0, 1e-3);
+  std::vector<State<T>> prev(capacity), curr(capacity);
+  Batch batch;
+  for (size_t i = 0; i < capacity; ++i)
+  {
+    prev[i].l = curr[i].l = T(level(random));
+    curr[i].f = T((1.0 - level(random)) / 5.0 + offset(random));
+    curr[i].c = T(0);
+    batch.push(prev[i], curr[i], fields);
+  }
+  Params<T> const params{ T(1.0), T(5.0) };
+  dl_batch_kernel const kernel;
+
+  std::vector<char> verdicts(capacity);
+  size_t violations = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round)
+  {
+    for (size_t i = 0; i < capacity; ++i)
+    {
+      verdicts[i] = monitorSatisfied(prev[i], curr[i], &params);
+      violations += !verdicts[i];
+    }
+  }
+  std::chrono::duration<double> const scalar = std::chrono::steady_clock::now() - start;
+
+  static bool batched[capacity];
+  size_t batch_violations = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round)
+  {
+    batch_violations += batch.check(params, kernel, batched);
+  }
+  std::chrono::duration<double> const vectorized = std::chrono::steady_clock::now() - start;
+
+  double const checks = double(capacity) * rounds;
+  std::printf("%-12s %zu lanes: one at a time %7.1f Mchecks/s, batched %7.1f Mchecks/s%s\n", name,
+              rv::dl::Lanes<T>::width, checks / scalar.count() / 1e6, checks / vectorized.count() / 1e6,
+              violations == batch_violations ? "" : " (VERDICTS DIFFER)");
+}
+}
+
+int main()
+{
+  int const rounds = 20000;
+  run<float>("float", rounds);
+  run<double>("double", rounds);
+  run<long double>("long double", rounds);
+  return 0;
+}
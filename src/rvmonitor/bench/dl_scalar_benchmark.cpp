@@ -0,0 +1,104 @@
+/* Throughput of a ModelPlex style dL check in float, double and long double.
+ *
+ * The check is the controller monitor of specs/dl-watertank.rv: the flow
+ * chosen for the next cycle must keep the level within [0, m] for ep seconds.
+ * Each scalar type checks the same states, and the verdicts that differ from
+ * long double are counted.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <rv/dl.h>
+
+namespace
+{
+template <typename T>
+struct State
+{
+  T f, l, c;
+};
+
+template <typename T>
+struct Params
+{
+  T m, ep;
+};
+
+template <typename T>
+bool checkViolation(rv::dl::MonitorState<State<T>, Params<T>, T> const& monitorState)
+{
+  State<T> const& prev = monitorState.prevState;
+  State<T> const& curr = monitorState.currState;
+  Params<T> const& params = monitorState.params;
+  return T(0) <= prev.l && prev.l <= params.m && T(0) < params.ep && T(-1) <= curr.f &&
+         curr.f <= (params.m - prev.l) / params.ep && curr.c == T(0) && curr.l == prev.l;
+}
+
+struct Sample
+{
+  double l, f;
+};
+
+template <typename T>
+std::vector<bool> run(char const* name, std::vector<Sample> const& samples, int rounds)
+{
+  rv::dl::MonitorState<State<T>, Params<T>, T> monitorState;
+  monitorState.params.m = T(1.0);
+  monitorState.params.ep = T(5.0);
+
+  std::vector<bool> verdicts(samples.size());
+  size_t accepted = 0;
+  auto const start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round)
+  {
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+      monitorState.prevState.l = T(samples[i].l);
+      monitorState.currState.l = T(samples[i].l);
+      monitorState.currState.f = T(samples[i].f);
+      monitorState.currState.c = T(0);
+      bool const verdict = checkViolation(monitorState);
+      accepted += verdict;
+      verdicts[i] = verdict;
+    }
+  }
+  std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+  double const checks = double(samples.size()) * rounds;
+  std::printf("%-12s %8.1f Mchecks/s  (%zu accepted)\n", name, checks / elapsed.count() / 1e6, accepted);
+  return verdicts;
+}
+
+size_t differences(std::vector<bool> const& a, std::vector<bool> const& b)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    count += a[i] != b[i];
+  }
+  return count;
+}
+}
+
+int main()
+{
+  // Flows cluster around the bound (m - l) / ep, where rounding matters
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> level(0.0, 1.0);
+  std::normal_distribution<double> offset(0.0, 1e-7);
+  std::vector<Sample> samples(1 << 16);
+  for (Sample& sample : samples)
+  {
+    sample.l = level(random);
+    sample.f = (1.0 - sample.l) / 5.0 + offset(random);
+  }
+
+  int const rounds = 200;
+  std::vector<bool> const reference = run<long double>("long double", samples, rounds);
+  std::vector<bool> const doubles = run<double>("double", samples, rounds);
+  std::vector<bool> const floats = run<float>("float", samples, rounds);
+  std::printf("verdicts differing from long double: double %zu, float %zu of %zu\n",
+              differences(doubles, reference), differences(floats, reference), samples.size());
+  return 0;
+}
@@ -3,7 +3,12 @@
 
 #include<vector>
 #include<string>
-#include<map>
+#include<cstddef>
+#include<cstdint>
+#include<stdexcept>
+#include<type_traits>
+#include<rv/dl_batch.h>
+#include<rv/state_history.h>
 
 
 namespace rv
@@ -11,62 +16,185 @@ namespace rv
 namespace dl
 {
 
-template <typename S, typename P>
+/* Which of up to 64 logical variables have been set, one bit each.
+ *
+ * Variables are indexed by position, as in the enum rosmop generates for
+ * the ModelPlex variables of a specification. Looking a variable up by name
+ * is kept for code that still does; a name seen for the first time gets the
+ * next free bit. Either way the variable becomes part of known().
+ */
+class VariableMask
+{
+public:
+    class Bit
+    {
+    public:
+	Bit(uint64_t& word, uint64_t bit) : word(word), bit(bit) {}
+
+	operator bool() const { return (word & bit) != 0; }
+
+	Bit& operator=(bool value) {
+	    word = value ? (word | bit) : (word & ~bit);
+	    return *this;
+	}
+
+	Bit& operator=(Bit const& other) { return *this = bool(other); }
+
+    private:
+	uint64_t& word;
+	uint64_t const bit;
+    };
+
+    VariableMask(std::vector<std::string>& names) : names(names), bits(0), knownBits(0) {}
+
+    Bit operator[](size_t index) {
+	knownBits |= uint64_t(1) << index;
+	return Bit(bits, uint64_t(1) << index);
+    }
+
+    Bit operator[](std::string const& name) {
+	return (*this)[indexOf(name)];
+    }
+
+    uint64_t set() const { return bits; }
+    uint64_t known() const { return knownBits; }
+
+    void clear() {
+	bits = 0;
+	knownBits = 0;
+    }
+
+private:
+    size_t indexOf(std::string const& name) {
+	for(size_t i = 0; i < names.size(); ++i) {
+	    if(names[i] == name)
+		return i;
+	}
+	if(names.size() == 64)
+	    throw std::length_error("rv::dl::VariableMask: more than 64 variables");
+	names.push_back(name);
+	return names.size() - 1;
+    }
+
+    std::vector<std::string>& names;
+    uint64_t bits;
+    uint64_t knownBits;
+};
+
+/* The last Capacity states of a monitor, e.g.
+ * StateHistory<modelplex_generated::state, 16>, pushed from its actions
+ */
+template <typename S, size_t Capacity>
+using StateHistory = monitor::StateHistory<S, Capacity>;
+
+/* The values of up to 64 conjuncts of a ModelPlex formula, as of the last
+ * check that evaluated them.
+ *
+ * A check passes the Inputs fields of the states and parameters it reads to
+ * observe(), with a mask of the inputs each conjunct depends on. Conjuncts
+ * whose inputs compare unequal to the previous check's are forgotten, and
+ * holds() evaluates a conjunct only if it has no value. Changes are found by
+ * value, so states assigned directly by actions are tracked too.
+ */
+template <size_t Inputs, typename Scalar>
+class ConjunctCache
+{
+public:
+    static_assert(Inputs > 0 && Inputs <= 64, "rv::dl::ConjunctCache tracks 1 to 64 inputs");
+
+    ConjunctCache() : primed(false), known(0), values(0) {}
+
+    template <size_t Conjuncts>
+    void observe(Scalar const (&inputs)[Inputs], uint64_t const (&depends)[Conjuncts]) {
+	static_assert(Conjuncts <= 64, "rv::dl::ConjunctCache caches up to 64 conjuncts");
+
+	uint64_t changed = primed ? 0 : ~uint64_t(0);
+	for(size_t i = 0; i < Inputs; ++i) {
+	    // NaN never compares equal, so it is always re-evaluated
+	    if(!(inputs[i] == last[i])) {
+		changed |= uint64_t(1) << i;
+		last[i] = inputs[i];
+	    }
+	}
+	primed = true;
+	for(size_t c = 0; c < Conjuncts; ++c) {
+	    if(depends[c] & changed)
+		known &= ~(uint64_t(1) << c);
+	}
+    }
+
+    template <typename F>
+    bool holds(size_t conjunct, F const& evaluate) {
+	uint64_t const bit = uint64_t(1) << conjunct;
+	if(!(known & bit)) {
+	    values = evaluate() ? (values | bit) : (values & ~bit);
+	    known |= bit;
+	}
+	return (values & bit) != 0;
+    }
+
+    void clear() {
+	primed = false;
+	known = 0;
+    }
+
+private:
+    bool primed;
+    uint64_t known;
+    uint64_t values;
+    Scalar last[Inputs];
+};
+
+/* S and P hold the ModelPlex variables and parameters as Scalar. A
+ * narrower Scalar checks faster, and float and double vectorize, but
+ * comparisons near the boundaries of the formula lose precision.
+ */
+template <typename S, typename P, typename Scalar = long double>
 struct MonitorState
 {
-    P params;
-    S prevState, currState;
+    static_assert(std::is_floating_point<Scalar>::value, "rv::dl::MonitorState needs a floating point scalar");
 
+    using scalar = Scalar;
 
-    std::map<std::string, bool> prevStateMap;
-    std::map<std::string, bool> currStateMap;
+    P params;
+    S prevState, currState;
 
     std::vector<std::string> logicalVariables;
 
-    bool prevStateExistsFlag;
-    bool isInitializedFlag;
+    /* Whether each variable has a previous and a current value */
+    VariableMask prevStateMap;
+    VariableMask currStateMap;
+
 
+    MonitorState() : prevStateMap(logicalVariables), currStateMap(logicalVariables) {}
 
-    void initialize(std::vector<std::string> variables) {
-	this->logicalVariables = variables;
+    MonitorState(MonitorState const&) = delete;
+    MonitorState& operator=(MonitorState const&) = delete;
 
-	this->prevStateExistsFlag = false;
-	this->isInitializedFlag = false;
+    void initialize(std::vector<std::string> const& variables) {
+	logicalVariables.clear();
+	prevStateMap.clear();
+	currStateMap.clear();
 
-	for(auto variable : variables) {
+	for(auto const& variable : variables) {
 	    prevStateMap[variable] = false;
 	    currStateMap[variable] = false;
 	}
     }
 
-    bool prevStateExists() {
-	if(!prevStateExistsFlag) {
-	    bool status = true;
-	    for(auto variableStatus : prevStateMap) {
-		status = status && variableStatus.second;
-	    }
-	    if(status)
-		prevStateExistsFlag = true;
-	    return status;
-	}
-	return true;
+    /* Record a new value of variable: its current value becomes the previous one */
+    void update(size_t variable) {
+	prevStateMap[variable] = bool(currStateMap[variable]);
+	currStateMap[variable] = true;
     }
 
-    bool isInitialized() {
-	if(!isInitializedFlag) {
-	    if(!prevStateExists()) {
-		return false;
-	    } else {
-	    bool status = true;
-	    for(auto variableStatus : currStateMap) {
-		status = status && variableStatus.second;
-	    }
-	    if(status)
-		isInitializedFlag = true;
-	    return status;
-	    }
-	}
-	return true;
+    bool prevStateExists() const {
+	return (prevStateMap.set() & prevStateMap.known()) == prevStateMap.known();
+    }
+
+    bool isInitialized() const {
+	return prevStateExists()
+	    && (currStateMap.set() & currStateMap.known()) == currStateMap.known();
     }
 };
 
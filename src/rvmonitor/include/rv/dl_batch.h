@@ -0,0 +1,148 @@
+#ifndef RV_DL_BATCH_H
+#define RV_DL_BATCH_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace rv {
+namespace dl {
+
+/* The widest SIMD vector of Scalar the target supports. Without SSE2 or AVX,
+ * and for long double, a single scalar.
+ */
+template<typename Scalar>
+struct Lanes
+{
+    using type = Scalar;
+    static constexpr size_t width = 1;
+};
+
+#if defined(__AVX__)
+template<> struct Lanes<float>  { typedef float  type __attribute__((vector_size(32))); static constexpr size_t width = 8; };
+template<> struct Lanes<double> { typedef double type __attribute__((vector_size(32))); static constexpr size_t width = 4; };
+#elif defined(__SSE2__)
+template<> struct Lanes<float>  { typedef float  type __attribute__((vector_size(16))); static constexpr size_t width = 4; };
+template<> struct Lanes<double> { typedef double type __attribute__((vector_size(16))); static constexpr size_t width = 2; };
+#endif
+
+/* Up to Capacity (prev, curr) state pairs of a dL monitor, stored as one
+ * array per variable so that a check can load a SIMD vector of each.
+ *
+ * Variables are indexed like rv::dl::VariableMask, by the dl_variable enum
+ * rosmop generates; fields maps each index to its member of the state S.
+ * The arrays live in one cache line aligned buffer allocated on
+ * construction, as in rv::monitor::StateHistory, so a batch can be a member
+ * of a specification allocated anywhere.
+ */
+template<typename S, typename Scalar, size_t Variables, size_t Capacity>
+class StateBatch
+{
+public:
+    static_assert(Capacity % 8 == 0, "StateBatch capacity must be a multiple of the widest vector");
+
+    using Fields = Scalar S::* const[Variables];
+
+    static constexpr size_t CacheLine = 64;
+
+    StateBatch()
+        : m_buffer(new unsigned char[2 * Variables * Capacity * sizeof(Scalar) + CacheLine])
+        , m_size(0)
+    {
+        void* start = m_buffer.get();
+        size_t space = 2 * Variables * Capacity * sizeof(Scalar) + CacheLine;
+        m_prev = static_cast<Scalar*>(std::align(CacheLine, 2 * Variables * Capacity * sizeof(Scalar), start, space));
+        m_curr = m_prev + Variables * Capacity;
+    }
+
+    StateBatch(StateBatch const&) = delete;
+    StateBatch& operator=(StateBatch const&) = delete;
+
+    size_t size() const { return m_size; }
+    bool full() const { return m_size == Capacity; }
+    void clear() { m_size = 0; }
+
+    void push(S const& prev, S const& curr, Fields& fields) {
+        if (full())
+            throw std::length_error("rv::dl::StateBatch is full");
+        for (size_t v = 0; v < Variables; ++v) {
+            row(m_prev, v)[m_size] = prev.*fields[v];
+            row(m_curr, v)[m_size] = curr.*fields[v];
+        }
+        ++m_size;
+    }
+
+    /* Evaluate kernel over every pair and store its verdicts, true where the
+     * formula holds. Returns the number of violations.
+     *
+     * kernel is called as kernel(prev, curr, params), where prev and curr
+     * point to one value per variable. Its arithmetic and comparisons must
+     * work on SIMD vectors as well as on Scalar, so it combines conditions
+     * with & and | rather than && and ||; Scalar constants are broadcast.
+     * Pairs that do not fill a whole vector are checked one at a time.
+     */
+    template<typename P, typename Kernel>
+    size_t check(P const& params, Kernel const& kernel, bool* verdicts) const {
+        using Vectorized = std::integral_constant<bool, (Lanes<Scalar>::width > 1)>;
+        size_t i = 0;
+        size_t violations = checkVectors(params, kernel, verdicts, i, Vectorized());
+        for (; i < m_size; ++i) {
+            Scalar prev[Variables], curr[Variables];
+            for (size_t v = 0; v < Variables; ++v) {
+                prev[v] = row(m_prev, v)[i];
+                curr[v] = row(m_curr, v)[i];
+            }
+            verdicts[i] = kernel(prev, curr, params);
+            violations += !verdicts[i];
+        }
+        return violations;
+    }
+
+private:
+    static Scalar* row(Scalar* rows, size_t variable) { return rows + variable * Capacity; }
+    static Scalar const* row(Scalar const* rows, size_t variable) { return rows + variable * Capacity; }
+
+    template<typename P, typename Kernel>
+    size_t checkVectors(P const&, Kernel const&, bool*, size_t&, std::false_type) const {
+        return 0;
+    }
+
+    template<typename P, typename Kernel>
+    size_t checkVectors(P const& params, Kernel const& kernel, bool* verdicts, size_t& i, std::true_type) const {
+        using Vector = typename Lanes<Scalar>::type;
+        size_t const width = Lanes<Scalar>::width;
+        size_t violations = 0;
+        for (; i + width <= m_size; i += width) {
+            // Rows are aligned to the vector size, since Capacity is a multiple of its
+            // width; loading through memcpy does not rely on it
+            Vector prev[Variables], curr[Variables];
+            for (size_t v = 0; v < Variables; ++v) {
+                std::memcpy(&prev[v], row(m_prev, v) + i, sizeof(Vector));
+                std::memcpy(&curr[v], row(m_curr, v) + i, sizeof(Vector));
+            }
+            auto const holds = kernel(prev, curr, params);
+            typename std::decay<decltype(holds[0])>::type mask[width];
+            std::memcpy(mask, &holds, sizeof(mask));
+            for (size_t lane = 0; lane < width; ++lane) {
+                verdicts[i + lane] = mask[lane] != 0;
+                violations += mask[lane] == 0;
+            }
+        }
+        return violations;
+    }
+
+    std::unique_ptr<unsigned char[]> m_buffer;
+    Scalar* m_prev;  // Variables rows of Capacity values each
+    Scalar* m_curr;
+    size_t m_size;
+};
+
+template<typename S, typename Scalar, size_t Variables, size_t Capacity>
+constexpr size_t StateBatch<S, Scalar, Variables, Capacity>::CacheLine;
+
+}
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef RV_EVENT_BATCH_H
+#define RV_EVENT_BATCH_H
+
+#include <chrono>
+#include <cstddef>
+
+namespace rv {
+namespace monitor {
+
+/* A batch event fires once count messages have accumulated, and every
+ * period if it holds any messages. Zero disables either trigger.
+ */
+struct BatchOptions
+{
+    size_t count;
+    std::chrono::milliseconds period;
+
+    BatchOptions(size_t count, std::chrono::milliseconds period = std::chrono::milliseconds(0))
+        : count(count)
+        , period(period)
+    {
+    }
+};
+
+template<class MessageType>
+struct EventBatchErased
+{
+    explicit EventBatchErased(BatchOptions const& options)
+        : options(options)
+    {
+    }
+
+    virtual ~EventBatchErased() = default;
+
+    virtual void append(MessageType const& message) = 0;
+
+    /* Call the handler with the messages appended since the last flush, if any */
+    virtual void flush() = 0;
+
+    BatchOptions const options;
+};
+
+/* Accumulates messages into a Batch and hands it to a handler all at once.
+ *
+ * Batch is typically generated by rosmop and holds the bound fields of the
+ * messages as arrays, one element per message. It provides
+ *   static void append(Batch&, MessageType const&);
+ *   size_t size() const;
+ *   void clear();
+ * The batch is cleared, not reallocated, after each flush, so its arrays
+ * keep their capacity from one batch to the next.
+ */
+template<class MessageType, class Batch, class Owner>
+struct EventBatch
+    : EventBatchErased<MessageType>
+{
+    EventBatch(Owner* owner, void (Owner::*handler)(Batch&), BatchOptions const& options)
+        : EventBatchErased<MessageType>(options)
+        , m_owner(owner)
+        , m_handler(handler)
+    {
+    }
+
+    void append(MessageType const& message) override {
+        Batch::append(m_batch, message);
+        if (this->options.count && m_batch.size() >= this->options.count)
+            flush();
+    }
+
+    void flush() override {
+        if (m_batch.size() == 0)
+            return;
+        (m_owner->*m_handler)(m_batch);
+        m_batch.clear();
+    }
+
+private:
+    Owner* const m_owner;
+    void (Owner::* const m_handler)(Batch&);
+    Batch m_batch;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef RV_EVENT_LIST_H
+#define RV_EVENT_LIST_H
+
+#include <chrono>
+#include <cstddef>
+#include <rv/latency_histogram.h>
+
+namespace rv {
+namespace monitor {
+
+/* A list of event handlers fixed at compile time.
+ *
+ * rosmop knows every event of a specification when it generates code, so it
+ * registers the handlers of each topic as template arguments. dispatch()
+ * calls them in order through constant member pointers, which lets the
+ * compiler inline the handlers instead of going through std::function.
+ *
+ * A list whose MessageType is const holds read-only handlers. The monitor
+ * may then forward the topic's messages as received.
+ */
+template<class OwnerType, class MessageType, void (OwnerType::*... Handlers)(MessageType&)>
+struct EventList
+{
+    using Owner = OwnerType;
+    using Message = MessageType;
+
+    static constexpr size_t size = sizeof...(Handlers);
+
+    static void dispatch(void* owner, MessageType& message) {
+        Owner* self = static_cast<Owner*>(owner);
+        (void) self;  // Unused for an empty list
+        using expand = int[];
+        (void) expand{ 0, ((self->*Handlers)(message), 0)... };
+    }
+
+    /* Like dispatch(), recording the time each handler takes into the
+     * histogram at the same position of histograms.
+     */
+    static void dispatchTimed(void* owner, MessageType& message, LatencyHistogram* histograms) {
+        Owner* self = static_cast<Owner*>(owner);
+        (void) self;
+        using expand = int[];
+        (void) expand{ 0, (callTimed<Handlers>(self, message, *histograms++), 0)... };
+    }
+
+private:
+    template<void (OwnerType::*Handler)(MessageType&)>
+    static void callTimed(Owner* self, MessageType& message, LatencyHistogram& histogram) {
+        auto const start = std::chrono::steady_clock::now();
+        (self->*Handler)(message);
+        histogram.record(std::chrono::steady_clock::now() - start);
+    }
+};
+
+}
+}
+
+#endif
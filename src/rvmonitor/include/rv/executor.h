@@ -0,0 +1,123 @@
+#ifndef RV_EXECUTOR_H
+#define RV_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <ros/callback_queue_interface.h>
+
+namespace rv {
+namespace monitor {
+
+class TopicExecutor;
+
+/* Callback queue for a single monitored topic.
+ *
+ * Callbacks are run by the workers of a TopicExecutor. At most one worker
+ * services a queue at any time, so messages of a topic are handled in the
+ * order they arrived while different topics run in parallel.
+ */
+class TopicCallbackQueue : public ros::CallbackQueueInterface
+{
+public:
+  TopicCallbackQueue(TopicExecutor& executor, std::string const& topic);
+
+  void addCallback(ros::CallbackInterfacePtr const& callback, uint64_t owner_id = 0) override;
+  void removeByID(uint64_t owner_id) override;
+
+  std::string const& topic() const;
+
+private:
+  friend class TopicExecutor;
+
+  /* What a queue has left after a batch */
+  enum class BatchResult
+  {
+    Idle,     // Nothing: it is no longer scheduled
+    More,     // More callbacks to run: schedule it again
+    NotReady  // A callback that is not ready, or asked to be tried again: retry later
+  };
+
+  /* Run up to max_callbacks callbacks */
+  BatchResult runBatch(size_t max_callbacks);
+
+  struct Entry
+  {
+    ros::CallbackInterfacePtr callback;
+    uint64_t owner_id;
+  };
+
+  TopicExecutor& executor;
+  std::string const topic_name;
+
+  std::mutex mutex;
+  std::deque<Entry> callbacks;
+  bool scheduled;
+
+  std::mutex call_mutex;
+  std::atomic<std::thread::id> calling_thread;
+};
+
+using TopicCallbackQueuePtr = boost::shared_ptr<TopicCallbackQueue>;
+
+/* A fixed pool of workers servicing per-topic callback queues.
+ *
+ * Each worker owns a deque of topic queues that are ready to run. A queue
+ * that still has work after a batch goes back to the deque of the worker
+ * that ran it; idle workers steal ready queues from the other workers.
+ */
+class TopicExecutor
+{
+public:
+  explicit TopicExecutor(unsigned worker_count, size_t batch_size = 16);
+  ~TopicExecutor();
+
+  TopicExecutor(TopicExecutor const&) = delete;
+  TopicExecutor& operator=(TopicExecutor const&) = delete;
+
+  /* Returns the callback queue of topic, creating it on first use */
+  TopicCallbackQueuePtr queueForTopic(std::string const& topic);
+
+  void start();
+  void stop();
+
+  unsigned workerCount() const;
+
+private:
+  friend class TopicCallbackQueue;
+
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<TopicCallbackQueue*> ready;
+  };
+
+  void schedule(TopicCallbackQueue* queue);
+  TopicCallbackQueue* take(unsigned index);
+  void workerLoop(unsigned index);
+
+  size_t const batch_size;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex queues_mutex;
+  std::map<std::string, TopicCallbackQueuePtr> queues;
+
+  std::mutex idle_mutex;
+  std::condition_variable idle_cv;
+  size_t pending;
+  std::atomic<bool> running;
+  std::atomic<unsigned> next_worker;
+};
+
+}
+}
+
+#endif
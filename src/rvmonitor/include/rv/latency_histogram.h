@@ -0,0 +1,113 @@
+#ifndef RV_LATENCY_HISTOGRAM_H
+#define RV_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace rv {
+namespace monitor {
+
+struct LatencySummary {
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+/* A histogram of latencies in nanoseconds, in the style of HdrHistogram.
+ *
+ * Values below 2^SubBucketBits have a bucket each; above that, every power
+ * of two is split into 2^(SubBucketBits - 1) buckets, so a value is known to
+ * within 1/32 of itself over the whole 64 bit range. Recording is a couple of
+ * relaxed atomic increments, so any number of threads may record while
+ * another one reads a summary.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned SubBucketBits = 6;
+    static constexpr unsigned SubBucketCount = 1u << SubBucketBits;
+    static constexpr unsigned HalfCount = SubBucketCount / 2;
+    static constexpr unsigned BucketCount = SubBucketCount + (64 - SubBucketBits) * HalfCount;
+
+    LatencyHistogram()
+        : m_count(0)
+        , m_total(0)
+        , m_max(0)
+    {
+        for (std::atomic<uint64_t>& bucket: m_buckets) { bucket.store(0, std::memory_order_relaxed); }
+    }
+
+    LatencyHistogram(LatencyHistogram const&) = delete;
+    LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+    void record(uint64_t ns) {
+        m_buckets[indexOf(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+    }
+
+    void record(std::chrono::nanoseconds duration) {
+        record(uint64_t(std::max<std::chrono::nanoseconds::rep>(duration.count(), 0)));
+    }
+
+    /* Percentiles are reported as the upper bound of their bucket */
+    LatencySummary summary() const {
+        LatencySummary ret{};
+        ret.count = m_count.load(std::memory_order_relaxed);
+        if (ret.count == 0)
+            return ret;
+        ret.mean_ns = m_total.load(std::memory_order_relaxed) / ret.count;
+        ret.max_ns = m_max.load(std::memory_order_relaxed);
+
+        // Concurrent records may make the buckets disagree slightly with count
+        uint64_t const targets[] = { (ret.count + 1) / 2, (ret.count * 9 + 9) / 10
+                                   , (ret.count * 99 + 99) / 100, (ret.count * 999 + 999) / 1000 };
+        uint64_t* const results[] = { &ret.p50_ns, &ret.p90_ns, &ret.p99_ns, &ret.p999_ns };
+        unsigned next = 0;
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < BucketCount && next < 4; ++i) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            while (next < 4 && seen >= targets[next]) {
+                *results[next++] = std::min(highestEquivalent(i), ret.max_ns);
+            }
+        }
+        while (next < 4) { *results[next++] = ret.max_ns; }
+        return ret;
+    }
+
+    static unsigned indexOf(uint64_t ns) {
+        if (ns < SubBucketCount)
+            return unsigned(ns);
+        unsigned const msb = 63 - __builtin_clzll(ns);
+        unsigned const shift = msb - SubBucketBits + 1;
+        return SubBucketCount + (shift - 1) * HalfCount + unsigned(ns >> shift) - HalfCount;
+    }
+
+    /* The largest value recorded into bucket index */
+    static uint64_t highestEquivalent(unsigned index) {
+        if (index < SubBucketCount)
+            return index;
+        unsigned const shift = (index - SubBucketCount) / HalfCount + 1;
+        uint64_t const top = (index - SubBucketCount) % HalfCount + HalfCount;
+        return ((top + 1) << shift) - 1;
+    }
+
+private:
+    std::atomic<uint64_t> m_buckets[BucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_total;
+    std::atomic<uint64_t> m_max;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef RV_LATENCY_STATS_H
+#define RV_LATENCY_STATS_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <ros/node_handle.h>
+#include <ros/publisher.h>
+#include <ros/service_server.h>
+#include <ros/wall_timer.h>
+#include <rv/latency_histogram.h>
+#include <rv/message_pool.h>
+#include <rv/subscription_shim.h>
+#include <rv/topic_queue.h>
+#include <std_srvs/Trigger.h>
+
+namespace rv {
+namespace monitor {
+
+/* Latencies a monitor adds to one of its topics. Only created when
+ * statistics are enabled, so that the topic skips all timing otherwise.
+ */
+struct TopicLatency
+{
+  explicit TopicLatency(std::vector<std::string> handler_names);
+
+  /* From receiving a message to republishing it */
+  LatencyHistogram receive_to_publish;
+
+  /* From the stamp in the message's header to republishing it */
+  LatencyHistogram end_to_end;
+
+  /* Time spent in each handler, in registration order */
+  std::vector<std::string> const handler_names;
+  std::unique_ptr<LatencyHistogram[]> const handlers;
+};
+
+struct TopicStats
+{
+  std::string topic;
+  MessagePoolStats pool;
+  QueueStats queue;
+  TopicLatency const* latency;
+  ConnectionStats connections;
+};
+
+/* Publishes the statistics of a monitor's topics on /rv/stats every period
+ * and answers /rv/get_stats with a text summary of them.
+ */
+class StatsReporter
+{
+public:
+  StatsReporter(ros::NodeHandle& n, ros::WallDuration period, std::function<std::vector<TopicStats>()> collect);
+
+  /* A human readable summary, one line per topic and histogram */
+  std::string summary() const;
+
+private:
+  void publish(ros::WallTimerEvent const&);
+  bool trigger(std_srvs::Trigger::Request&, std_srvs::Trigger::Response& response);
+
+  std::function<std::vector<TopicStats>()> const collect;
+  ros::Publisher publisher;
+  ros::ServiceServer service;
+  ros::WallTimer timer;
+};
+
+}
+}
+
+#endif
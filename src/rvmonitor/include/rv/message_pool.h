@@ -0,0 +1,98 @@
+#ifndef RV_MESSAGE_POOL_H
+#define RV_MESSAGE_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+namespace rv {
+namespace monitor {
+
+struct MessagePoolStats {
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/* A bounded free list of messages of a single type.
+ *
+ * Messages handed out by acquire() go back to the pool when their last
+ * reference is dropped, so the next deserialization reuses the same object
+ * and the capacity of its vectors and strings. A pool must be owned by a
+ * boost::shared_ptr; messages outliving it are simply deleted.
+ */
+template<class MessageType>
+struct MessagePool
+    : boost::enable_shared_from_this<MessagePool<MessageType>>
+{
+    using Ptr = boost::shared_ptr<MessagePool<MessageType>>;
+
+    explicit MessagePool(size_t capacity)
+        : m_capacity(capacity)
+        , m_hits(0)
+        , m_misses(0)
+    {
+        m_free.reserve(capacity);
+    }
+
+    MessagePool(MessagePool const&) = delete;
+    MessagePool& operator=(MessagePool const&) = delete;
+
+    ~MessagePool() {
+        for (MessageType* msg: m_free) { delete msg; }
+    }
+
+    boost::shared_ptr<MessageType> acquire() {
+        MessageType* msg = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty()) {
+                msg = m_free.back();
+                m_free.pop_back();
+            }
+        }
+        if (msg) {
+            ++m_hits;
+        }
+        else {
+            ++m_misses;
+            msg = new MessageType();
+        }
+
+        boost::weak_ptr<MessagePool<MessageType>> pool = this->shared_from_this();
+        return boost::shared_ptr<MessageType>(msg, [pool](MessageType* released) {
+            if (auto owner = pool.lock()) { owner->release(released); }
+            else { delete released; }
+        });
+    }
+
+    MessagePoolStats stats() const {
+        return MessagePoolStats{ m_hits.load(), m_misses.load() };
+    }
+
+private:
+    void release(MessageType* msg) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_free.size() < m_capacity) {
+                m_free.push_back(msg);
+                return;
+            }
+        }
+        delete msg;
+    }
+
+    size_t const m_capacity;
+    std::mutex m_mutex;
+    std::vector<MessageType*> m_free;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
+
+}
+}
+
+#endif
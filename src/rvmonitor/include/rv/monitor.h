@@ -2,10 +2,29 @@
 #define RV_MONITOR_H
 
 #include <string>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <list>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <type_traits>
 #include <ros/ros.h> // TODO: Use more specific headers
+#include <ros/callback_queue.h>
 #include <rv/subscription_shim.h>
 #include <rv/pub_update_shim.h>
+#include <rv/message_pool.h>
+#include <rv/executor.h>
+#include <rv/event_list.h>
+#include <rv/event_batch.h>
+#include <rv/raw_message.h>
+#include <rv/partial_decoder.h>
+#include <rv/topic_queue.h>
+#include <rv/latency_stats.h>
+#include <rv/state_history.h>
+#include <rv/shm_ring.h>
+#include <rv/shm_transport.h>
 #include <boost/optional.hpp>
 #include <ros/console.h>
 
@@ -20,6 +39,9 @@ struct ROSInit {
     {
         ros::init(argc, argv, node_name);  
     }
+
+    /* For monitors hosted in a process that has already initialized ROS */
+    ROSInit() = default;
 };
 
 struct MonitorTopicErased
@@ -28,13 +50,36 @@ struct MonitorTopicErased
     ros::Subscriber subscriber;
     rv::SubscriptionShim subscription_shim;
 
-    MonitorTopicErased(std::string const& topic, ros::Publisher pub, ros::Subscriber sub)
-        : publisher(pub)
-        , subscriber(sub)
-        , subscription_shim(topic, getMonitorSubscribedTopicForTopic(topic))
+    /* How the monitor subscribes to the topic, and so how the shim connects
+     * to its publishers (see rv::TransportOptions)
+     */
+    TransportOptions transport;
+
+    MonitorTopicErased(std::string const& topic)
+        : subscription_shim(topic, getMonitorSubscribedTopicForTopic(topic))
     {
     }
 
+    /* Advertise and subscribe once all events are registered */
+    virtual void start(QueueOptions const& options) = 0;
+
+    /* Stop receiving messages and wait for the handlers running, then
+     * handle the messages still queued and flush partial batches
+     */
+    virtual void shutdown() = 0;
+
+    /* Record latency histograms from now on. Must be called before start(). */
+    virtual void enableLatencyStats() = 0;
+
+    /* Also republish into a shared memory ring offered by server */
+    virtual void serveSharedMemory(ShmTopicServer& server) = 0;
+
+    virtual MessagePoolStats poolStats() const = 0;
+    virtual QueueStats queueStats() const = 0;
+
+    /* Null unless latency statistics are enabled */
+    virtual TopicLatency const* latency() const = 0;
+
     virtual ~MonitorTopicErased() = default;
 };
 
@@ -46,40 +91,433 @@ struct MonitorTopic
 {
     using Ptr = boost::shared_ptr<MonitorTopic<MessageType>>;
 
-    MonitorTopic(ros::NodeHandle& n, std::string const& topic, uint queue_len)
-        : MonitorTopicErased
-            ( topic
-            , n.advertise<MessageType>(getMonitorAdvertisedTopicForTopic(topic), queue_len, true)
-            , n.subscribe( getMonitorSubscribedTopicForTopic(topic)
-                                 , queue_len
-                                 , &MonitorTopic<MessageType>::callback
-                                 , this
-            )            )
+    /* A message as received: serialized, or shared with an in-process publisher.
+     * received_at is only set when latency statistics are enabled.
+     */
+    struct Received {
+        boost::shared_ptr<RawMessage<MessageType> const> raw;
+        boost::shared_ptr<MessageType const> message;
+        std::chrono::steady_clock::time_point received_at;
+    };
+
+    /* Callbacks go to callback_queue, or to the node handle's queue when it is null.
+     * With intra_process, messages from publishers in the same process are
+     * received as pointers instead of serialized.
+     */
+    MonitorTopic( ros::NodeHandle& n, std::string const& topic, uint pool_size
+                , ros::CallbackQueueInterface* callback_queue = nullptr
+                , bool intra_process = false
+                )
+        : MonitorTopicErased(topic)
+        , m_node_handle(n)
+        , m_topic(topic)
+        , m_callback_queue(callback_queue ? callback_queue : n.getCallbackQueue())
+        , m_intra_process(intra_process)
+        , m_receiving(false)
+        , m_pool(boost::make_shared<MessagePool<MessageType>>(pool_size))
+        , m_read_only(true)
+        , m_process(boost::make_shared<FunctionCallback>(std::bind(&MonitorTopic<MessageType>::process, this)))
+    {
+    }
+
+    ~MonitorTopic() {
+        shutdown();
+    }
+
+    void shutdown() override {
+        // A blocking receive callback may be waiting for room that nothing
+        // makes anymore, and unsubscribing waits for it: release it first
+        m_receiving = false;
+        if (m_queue)
+            m_queue->close();
+        subscriber.shutdown();
+        if (m_receive_thread.joinable())
+            m_receive_thread.join();
+        m_batch_timers.clear();
+        m_callback_queue->removeByID(reinterpret_cast<uint64_t>(this));
+
+        // Nothing else processes the topic from here on, so what it received
+        // is handled on this thread, and batches are not left half full
+        if (m_queue) {
+            while (m_queue->stats().messages > 0)
+                process();
+        }
+        for (auto const& batch: m_batches)
+            batch->flush();
+        if (m_shm)
+            m_shm->close();
+    }
+
+    void serveSharedMemory(ShmTopicServer& server) override {
+        m_shm = ShmRing::create(shmSegmentForTopic(m_topic), transport.shm_slots, transport.shm_slot_size);
+        if (!m_shm) {
+            ROS_WARN("Cannot create %u shared memory slots of %u bytes for [%s], serving it over sockets only"
+                    , transport.shm_slots, transport.shm_slot_size, m_topic.c_str());
+            return;
+        }
+        server.add( getMonitorAdvertisedTopicForTopic(m_topic), m_shm->name()
+                  , ros::message_traits::MD5Sum<MessageType>::value()
+                  , ros::message_traits::DataType<MessageType>::value());
+    }
+
+    /* Register a single handler chosen at run time. A handler taking a
+     * const message is read-only.
+     */
+    template<class T>
+    void registerEvent(T* owner, void (T::*callback)(MessageType&))
     {
+        m_dynamic_events.push_back([owner, callback](MessageType& msg) { (owner->*callback)(msg); });
+        m_events.push_back(EventEntry{ &m_dynamic_events.back(), &callDynamicEvent, nullptr, nullptr, nullptr, 1 });
+        m_read_only = false;
+        m_selectors.push_back(nullptr);
+        m_handler_names.push_back(handlerName(""));
     }
 
     template<class T>
-    void registerEvent( T* owner
-                      , void (T::*callback)(MessageType&)
-                      )
+    void registerEvent(T* owner, void (T::*callback)(MessageType const&))
+    {
+        m_dynamic_const_events.push_back([owner, callback](MessageType const& msg) { (owner->*callback)(msg); });
+        m_events.push_back(EventEntry{ &m_dynamic_const_events.back(), nullptr, nullptr
+                                     , &callDynamicConstEvent, nullptr, 1 });
+        m_selectors.push_back(nullptr);
+        m_handler_names.push_back(handlerName(""));
+    }
+
+    /* Register a compile-time list of handlers (see rv::monitor::EventList).
+     * A list over const messages is read-only, and may name the fields its
+     * handlers read with a selector. Names label the handlers' latency
+     * statistics.
+     */
+    template<class Events>
+    void registerEvents( typename Events::Owner* owner
+                       , FieldSelector<MessageType> selector = nullptr
+                       , std::vector<std::string> const& names = {})
+    {
+        using Message = typename Events::Message;
+        static_assert( std::is_same<typename std::remove_const<Message>::type, MessageType>::value
+                     , "Event list is for a different message type");
+        m_events.push_back(eventEntry<Events>(owner, std::is_const<Message>()));
+        m_read_only = m_read_only && std::is_const<Message>::value;
+        m_selectors.push_back(selector);
+        for (size_t i = 0; i < size_t(Events::size); ++i) {
+            m_handler_names.push_back(handlerName(i < names.size() ? names[i] : ""));
+        }
+    }
+
+    /* Register a handler called with batches of messages (see rv::monitor::EventBatch).
+     * Batch handlers never modify the messages.
+     */
+    template<class Batch, class T>
+    void registerBatchEvent( T* owner, void (T::*handler)(Batch&), BatchOptions const& options
+                           , FieldSelector<MessageType> selector = nullptr, std::string const& name = "")
     {
-        auto cb = [owner, callback](MessageType& msg) -> void { (owner->*callback)(msg); };
-        m_events.push_back(cb);
+        m_batches.emplace_back(new EventBatch<MessageType, Batch, T>(owner, handler, options));
+        m_events.push_back(EventEntry{ m_batches.back().get(), nullptr, nullptr, &appendToBatch, nullptr, 1 });
+        m_selectors.push_back(selector);
+        m_handler_names.push_back(handlerName(name));
     }
 
-    void callback(boost::shared_ptr<const MessageType> ptr) {
-        MessageType copy = *ptr;
-        for (auto event_cb: m_events) { event_cb(copy); }
-        publisher.publish(copy);
+    void enableLatencyStats() override {
+        m_latency.reset(new TopicLatency(m_handler_names));
+    }
+
+    /* Messages are received serialized and queued under the topic's
+     * QueueOptions on the receiving thread, then handled one at a time from
+     * the callback queue (see process()). Topics that block get a receiving
+     * thread of their own, so that waiting for their handlers does not stall
+     * roscpp's, which receives every other topic.
+     */
+    void start(QueueOptions const& options) override {
+        if (m_read_only && std::find(m_selectors.begin(), m_selectors.end(), nullptr) == m_selectors.end()) {
+            MessageType prototype;
+            FieldSelection selection(&prototype);
+            for (FieldSelector<MessageType> selector: m_selectors) { selector(selection, prototype); }
+            if (m_latency) {
+                // End-to-end latency is measured from the header stamp
+                if (ros::Time const* stamp = ros::message_traits::timeStamp(prototype))
+                    selection.add(*stamp);
+            }
+            m_decoder.emplace(selection);
+        }
+        m_queue.emplace(options);
+
+        // Both ends of the topic hold as many messages as its own queue
+        uint32_t const queue_len = options.policy == QueuePolicy::ByteBudget
+                                 ? 1000 : std::max<size_t>(options.depth, 1);
+        publisher = m_node_handle.advertise<MessageType>(getMonitorAdvertisedTopicForTopic(m_topic), queue_len, true);
+
+        ros::SubscribeOptions ops;
+        if (m_intra_process) {
+            // Const messages are shared with in-process publishers without a copy
+            ops.template initByFullCallbackType<boost::shared_ptr<MessageType const> const&>
+                ( getMonitorSubscribedTopicForTopic(m_topic)
+                , queue_len
+                , boost::bind(&MonitorTopic<MessageType>::receiveShared, this, _1)
+                );
+        }
+        else {
+            ops.template initByFullCallbackType<boost::shared_ptr<RawMessage<MessageType> const> const&>
+                ( getMonitorSubscribedTopicForTopic(m_topic)
+                , queue_len
+                , boost::bind(&MonitorTopic<MessageType>::receive, this, _1)
+                );
+        }
+        if (options.policy == QueuePolicy::Block) {
+            ops.callback_queue = &m_blocking_receive_queue;
+            m_receiving = true;
+            m_receive_thread = std::thread([this] {
+                while (m_receiving)
+                    m_blocking_receive_queue.callAvailable(ros::WallDuration(0.1));
+            });
+        }
+        else {
+            ops.callback_queue = &m_receive_queue;
+        }
+        ops.transport_hints = transport.hints;
+        ops.allow_concurrent_callbacks = true;
+        subscriber = m_node_handle.subscribe(ops);
+
+        // Timed flushes go through the topic's callback queue, so they never
+        // run concurrently with the messages being appended.
+        for (auto const& batch: m_batches) {
+            if (batch->options.period.count() == 0)
+                continue;
+            ros::WallTimerOptions timer_ops( ros::WallDuration(batch->options.period.count() / 1000.0)
+                                           , boost::bind(&EventBatchErased<MessageType>::flush, batch.get())
+                                           , m_callback_queue);
+            m_batch_timers.push_back(m_node_handle.createWallTimer(timer_ops));
+        }
+    }
+
+    void receive(boost::shared_ptr<RawMessage<MessageType> const> const& raw) {
+        if (m_queue->push(Received{ raw, nullptr, receivedAt() }, raw->size))
+            m_callback_queue->addCallback(m_process, reinterpret_cast<uint64_t>(this));
+    }
+
+    void receiveShared(boost::shared_ptr<MessageType const> const& msg) {
+        // Only a byte budget needs the size of the message
+        size_t const size = m_queue->getOptions().policy == QueuePolicy::ByteBudget
+                          ? ros::serialization::serializationLength(*msg) : 0;
+        if (m_queue->push(Received{ nullptr, msg, receivedAt() }, size))
+            m_callback_queue->addCallback(m_process, reinterpret_cast<uint64_t>(this));
+    }
+
+    /* If every handler is read-only, the serialized message is forwarded
+     * as received and only decoded for the handlers. Otherwise messages are
+     * deserialized straight into messages taken from m_pool, mutated in place
+     * by the events and handed to the publisher without a copy. Either way
+     * they return to the pool once nothing references them anymore.
+     * When every read-only handler has a field selector, only the selected
+     * fields are decoded.
+     */
+    void process() {
+        Received received;
+        if (!m_queue->pop(received))
+            return;
+        if (received.message) {
+            processShared(received);
+            return;
+        }
+        if (m_read_only) {
+            passThrough(received);
+            return;
+        }
+        boost::shared_ptr<MessageType> msg = m_pool->acquire();
+        received.raw->deserialize(*msg);
+        dispatch(*msg);
+        publisher.publish(msg);
+        publishSharedMemory(*msg);
+        recordLatency(received, *msg);
+    }
+
+    /* Read-only handlers see the publisher's own message, which is then
+     * handed on to in-process subscribers as is. Other handlers get a copy.
+     */
+    void processShared(Received const& received) {
+        boost::shared_ptr<MessageType const> const& shared = received.message;
+        if (m_read_only) {
+            dispatchReadOnly(*shared);
+            publisher.publish(shared);
+            publishSharedMemory(*shared);
+            recordLatency(received, *shared);
+            return;
+        }
+        boost::shared_ptr<MessageType> msg = m_pool->acquire();
+        *msg = *shared;
+        dispatch(*msg);
+        publisher.publish(msg);
+        publishSharedMemory(*msg);
+        recordLatency(received, *msg);
+    }
+
+    /* The message is republished as received, so its latency is recorded
+     * once the stamp is decoded and does not include the handlers.
+     */
+    void passThrough(Received const& received) {
+        RawMessage<MessageType> const& raw = *received.raw;
+        publisher.publish(raw);
+        if (m_shm && !m_shm->write(raw.data.get(), raw.size))
+            warnTooLarge(raw.size);
+        boost::shared_ptr<MessageType> msg = m_pool->acquire();
+        if (m_decoder)
+            m_decoder->decode(raw.data.get(), raw.size, *msg);
+        else
+            raw.deserialize(*msg);
+        recordLatency(received, *msg);
+        dispatchReadOnly(*msg);
+    }
+
+    MessagePoolStats poolStats() const override {
+        return m_pool->stats();
+    }
+
+    QueueStats queueStats() const override {
+        return m_queue ? m_queue->stats() : QueueStats();
+    }
+
+    TopicLatency const* latency() const override {
+        return m_latency.get();
     }
 
 private:
-    std::vector<std::function<void (MessageType&)>> m_events;
+    /* Read-only handlers only have the const entry points, others only the
+     * mutable ones. Handlers without a timed entry point are timed as a whole.
+     */
+    struct EventEntry {
+        void* owner;
+        void (*dispatch)(void*, MessageType&);
+        void (*dispatch_timed)(void*, MessageType&, LatencyHistogram*);
+        void (*dispatch_const)(void*, MessageType const&);
+        void (*dispatch_const_timed)(void*, MessageType const&, LatencyHistogram*);
+        size_t handler_count;
+    };
+
+    template<class Events>
+    static EventEntry eventEntry(void* owner, std::false_type /* const */) {
+        return EventEntry{ owner, &Events::dispatch, &Events::dispatchTimed, nullptr, nullptr, size_t(Events::size) };
+    }
+
+    template<class Events>
+    static EventEntry eventEntry(void* owner, std::true_type /* const */) {
+        return EventEntry{ owner, nullptr, nullptr, &Events::dispatch, &Events::dispatchTimed, size_t(Events::size) };
+    }
+
+    static void callDynamicEvent(void* event, MessageType& msg) {
+        (*static_cast<std::function<void (MessageType&)>*>(event))(msg);
+    }
+
+    static void callDynamicConstEvent(void* event, MessageType const& msg) {
+        (*static_cast<std::function<void (MessageType const&)>*>(event))(msg);
+    }
+
+    static void appendToBatch(void* batch, MessageType const& msg) {
+        static_cast<EventBatchErased<MessageType>*>(batch)->append(msg);
+    }
+
+    /* Call every handler with a message they may modify */
+    void dispatch(MessageType& msg) {
+        LatencyHistogram* histograms = m_latency ? m_latency->handlers.get() : nullptr;
+        for (EventEntry const& event: m_events) {
+            if (event.dispatch)
+                call(event.dispatch, event.dispatch_timed, event.owner, msg, histograms);
+            else
+                call<MessageType const>(event.dispatch_const, event.dispatch_const_timed, event.owner, msg, histograms);
+            histograms += histograms ? event.handler_count : 0;
+        }
+    }
+
+    /* Call the handlers of a read-only topic, which all take const messages */
+    void dispatchReadOnly(MessageType const& msg) {
+        LatencyHistogram* histograms = m_latency ? m_latency->handlers.get() : nullptr;
+        for (EventEntry const& event: m_events) {
+            call(event.dispatch_const, event.dispatch_const_timed, event.owner, msg, histograms);
+            histograms += histograms ? event.handler_count : 0;
+        }
+    }
+
+    template<class Message>
+    static void call( void (*dispatch)(void*, Message&)
+                    , void (*dispatch_timed)(void*, Message&, LatencyHistogram*)
+                    , void* owner, Message& msg, LatencyHistogram* histograms) {
+        if (!histograms) {
+            dispatch(owner, msg);
+        }
+        else if (dispatch_timed) {
+            dispatch_timed(owner, msg, histograms);
+        }
+        else {
+            auto const start = std::chrono::steady_clock::now();
+            dispatch(owner, msg);
+            histograms->record(std::chrono::steady_clock::now() - start);
+        }
+    }
+
+    std::chrono::steady_clock::time_point receivedAt() const {
+        return m_latency ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    }
+
+    /* Messages are serialized straight into their slot of the ring */
+    void publishSharedMemory(MessageType const& msg) {
+        if (!m_shm)
+            return;
+        uint32_t const size = ros::serialization::serializationLength(msg);
+        uint8_t* slot = m_shm->beginWrite(size);
+        if (!slot) {
+            warnTooLarge(size);
+            return;
+        }
+        ros::serialization::OStream stream(slot, size);
+        ros::serialization::serialize(stream, msg);
+        m_shm->commitWrite();
+    }
+
+    void warnTooLarge(uint32_t size) {
+        ROS_WARN_THROTTLE(10, "A %u byte message on [%s] does not fit in a %u byte shared memory slot; "
+                              "subscribers over shared memory miss it", size, m_topic.c_str(), m_shm->slotSize());
+    }
+
+    void recordLatency(Received const& received, MessageType const& msg) {
+        if (!m_latency)
+            return;
+        m_latency->receive_to_publish.record(std::chrono::steady_clock::now() - received.received_at);
+        ros::Time const* stamp = ros::message_traits::timeStamp(msg);
+        if (stamp && !stamp->isZero())
+            m_latency->end_to_end.record(std::chrono::nanoseconds((ros::Time::now() - *stamp).toNSec()));
+    }
+
+    std::string handlerName(std::string const& name) const {
+        return name.empty() ? "handler " + std::to_string(m_handler_names.size()) : name;
+    }
+
+    ros::NodeHandle m_node_handle;
+    std::string const m_topic;
+    ros::CallbackQueueInterface* const m_callback_queue;
+    bool const m_intra_process;
+    InlineCallbackQueue m_receive_queue;
+    ros::CallbackQueue m_blocking_receive_queue;
+    std::atomic<bool> m_receiving;
+    std::thread m_receive_thread;
+    boost::optional<TopicQueue<Received>> m_queue;
+    typename MessagePool<MessageType>::Ptr m_pool;
+    std::vector<EventEntry> m_events;
+    std::list<std::function<void (MessageType&)>> m_dynamic_events;
+    std::list<std::function<void (MessageType const&)>> m_dynamic_const_events;
+    std::list<std::unique_ptr<EventBatchErased<MessageType>>> m_batches;
+    std::vector<ros::WallTimer> m_batch_timers;
+    bool m_read_only;
+    std::vector<FieldSelector<MessageType>> m_selectors;
+    boost::optional<PartialDecoder<MessageType>> m_decoder;
+    std::vector<std::string> m_handler_names;
+    std::unique_ptr<TopicLatency> m_latency;
+    std::unique_ptr<ShmRing> m_shm;
+    ros::CallbackInterfacePtr const m_process;
 };
 
 struct Monitor {
     Monitor(int argc, char** argv, std::string const& node_name)
         : ros_init(argc, argv, "rvmonitor")
+        , private_node_handle("~")
+        , intra_process(false)
     {
         std::cerr << "Monitor constructed " << "\n";
         std::cerr << "argv: " << argv[0] << '\n';
@@ -90,6 +528,27 @@ struct Monitor {
         if( ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Debug) ) {
                ros::console::notifyLoggerLevelsChanged();
         }
+
+        initExecutor();
+    }
+
+    /* A monitor hosted in a process that already runs ROS, e.g. by
+     * rv::monitor::MonitorNodelet. Publishers in the same process hand their
+     * messages to it as pointers. Parameters are read from private_n.
+     */
+    Monitor(ros::NodeHandle const& n, ros::NodeHandle const& private_n)
+        : node_handle(n)
+        , private_node_handle(private_n)
+        , intra_process(true)
+    {
+        initExecutor();
+    }
+
+    void initExecutor() {
+        int executor_threads;
+        private_node_handle.param<int>("executor_threads", executor_threads, 0);
+        if (executor_threads > 0)
+            executor.emplace(executor_threads);
     }
 
     /* Create a MonitorTopic, make sure that it is of the right message type */
@@ -97,8 +556,13 @@ struct Monitor {
     typename MonitorTopic<MessageType>::Ptr withTopic(std::string const& topic) {
         typename MonitorTopic<MessageType>::Ptr ret = nullptr;
         if (monitored_topics.find(topic) == monitored_topics.end()) {
-            unsigned int const queue_len = 1000;
-            ret = boost::make_shared<MonitorTopic<MessageType>>(node_handle, topic, queue_len);
+            int pool_size;
+            private_node_handle.param<int>("message_pool_size", pool_size, 8);
+            ros::CallbackQueueInterface* callback_queue = nullptr;
+            if (executor)
+                callback_queue = executor->queueForTopic(topic).get();
+            ret = boost::make_shared<MonitorTopic<MessageType>>( node_handle, topic, pool_size
+                                                               , callback_queue, intra_process);
             monitored_topics.insert({topic, ret});
         }
         else {
@@ -114,6 +578,36 @@ struct Monitor {
         monitor_topic->registerEvent(owner, callback);
     }
 
+    /* Register a read-only handler for a topic */
+    template<class MessageType, class T>
+    void registerEvent(std::string const& topic, T* owner, void (T::*callback)(MessageType const&)) {
+        auto monitor_topic = withTopic<MessageType>(topic);
+        monitor_topic->registerEvent(owner, callback);
+    }
+
+    /* Register a handler for batches of a topic's messages */
+    template<class MessageType, class Batch, class T>
+    void registerBatchEvent( std::string const& topic, T* owner, void (T::*handler)(Batch&)
+                           , BatchOptions const& options, FieldSelector<MessageType> selector = nullptr
+                           , std::string const& name = "") {
+        auto monitor_topic = withTopic<MessageType>(topic);
+        monitor_topic->registerBatchEvent(owner, handler, options, selector, name);
+    }
+
+    /* Register a compile-time list of handlers for a topic */
+    template<class MessageType, class Events>
+    void registerEvents( std::string const& topic, typename Events::Owner* owner
+                       , FieldSelector<MessageType> selector = nullptr
+                       , std::vector<std::string> const& names = {}) {
+        auto monitor_topic = withTopic<MessageType>(topic);
+        monitor_topic->template registerEvents<Events>(owner, selector, names);
+    }
+
+    /* Queue options for a topic, used unless overridden by ~queues/<topic>/ parameters */
+    void setQueueOptions(std::string const& topic, QueueOptions const& options) {
+        queue_options[topic] = options;
+    }
+
     void enable_rvmaster_shims()
     {
         std::cerr << "Shim enabled\n";
@@ -124,15 +618,98 @@ struct Monitor {
         return monitored_topics.find(topic) != monitored_topics.end();
     }
 
+    /* With ~executor_threads set, topics are handled by the executor's workers
+     * and the spinning thread only services the global callback queue.
+     */
     int run() {
+        start();
         ros::spin();
+        stop();
         return 0;
     }
 
+    /* Start monitoring once all events are registered. With ~stats_period
+     * set, latency statistics are recorded and published every that many
+     * seconds (see rv::monitor::StatsReporter).
+     */
+    void start() {
+        double stats_period;
+        private_node_handle.param<double>("stats_period", stats_period, 0);
+        for (auto const& entry: monitored_topics) {
+            if (stats_period > 0)
+                entry.second->enableLatencyStats();
+            entry.second->transport = TransportOptions::fromParams(private_node_handle, entry.first);
+            if (entry.second->transport.shared_memory) {
+                entry.second->subscription_shim.offerSharedMemory(true);
+                if (!shm_server)
+                    shm_server.emplace();
+                entry.second->serveSharedMemory(*shm_server);
+            }
+            QueueOptions options;
+            auto it = queue_options.find(entry.first);
+            if (it != queue_options.end())
+                options = it->second;
+            entry.second->start(QueueOptions::fromParams(private_node_handle, entry.first, options));
+        }
+        if (executor)
+            executor->start();
+        if (stats_period > 0)
+            stats_reporter.emplace(node_handle, ros::WallDuration(stats_period), [this] { return collectStats(); });
+    }
+
+    /* Stop monitoring. No handler runs once this returns. */
+    void stop() {
+        if (executor)
+            executor->stop();
+        for (auto const& entry: monitored_topics)
+            entry.second->shutdown();
+        logStats();
+        if (stats_reporter) {
+            ROS_INFO("Latency statistics:\n%s", stats_reporter->summary().c_str());
+            stats_reporter = boost::none;
+        }
+        shm_server = boost::none;
+    }
+
+    /* Report message pool hits and misses so that ~message_pool_size can be
+     * tuned, and the messages each topic's queue dropped.
+     */
+    void logStats() const {
+        for (auto const& entry: monitored_topics) {
+            MessagePoolStats stats = entry.second->poolStats();
+            ROS_INFO("Message pool for [%s]: %lu hits, %lu misses", entry.first.c_str(),
+                     (unsigned long) stats.hits, (unsigned long) stats.misses);
+            QueueStats queue = entry.second->queueStats();
+            ROS_INFO("Queue for [%s]: %lu received, %lu dropped, peak %lu messages, %lu bytes",
+                     entry.first.c_str(), (unsigned long) queue.received, (unsigned long) queue.dropped,
+                     (unsigned long) queue.peak_messages, (unsigned long) queue.peak_bytes);
+            ConnectionStats links = entry.second->subscription_shim.connectionStats();
+            ROS_INFO("Links for [%s]: %lu publishers, %lu duplicate links, %lu connects, %lu disconnects, "
+                     "%lu reconnects", entry.first.c_str(), (unsigned long) links.publishers,
+                     (unsigned long) (links.links - links.publishers), (unsigned long) links.connects,
+                     (unsigned long) links.disconnects, (unsigned long) links.reconnects);
+        }
+    }
+
+    std::vector<TopicStats> collectStats() const {
+        std::vector<TopicStats> stats;
+        for (auto const& entry: monitored_topics) {
+            stats.push_back(TopicStats{ entry.first, entry.second->poolStats(), entry.second->queueStats()
+                                      , entry.second->latency(), entry.second->subscription_shim.connectionStats() });
+        }
+        return stats;
+    }
+
     ROSInit ros_init;
     ros::NodeHandle node_handle;
+    ros::NodeHandle private_node_handle;
+    bool const intra_process;
     boost::optional<PubUpdateShim> pub_update_shim;
+    boost::optional<TopicExecutor> executor;
+    std::map<std::string, QueueOptions> queue_options;
     std::map<std::string, MonitorTopicErasedPtr> monitored_topics;
+    boost::optional<StatsReporter> stats_reporter;
+    boost::optional<ShmTopicServer> shm_server;
 };
 
 }
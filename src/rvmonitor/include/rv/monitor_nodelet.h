@@ -0,0 +1,44 @@
+#ifndef RV_MONITOR_NODELET_H
+#define RV_MONITOR_NODELET_H
+
+#include <boost/optional.hpp>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <rv/monitor.h>
+
+namespace rv {
+namespace monitor {
+
+/* Hosts the specifications Specs in a nodelet manager.
+ *
+ * Specs is constructed from the rv::monitor::Monitor, like the generated
+ * specification structs. Publishers loaded into the same manager and
+ * remapped to /rv/monitored/<topic> hand their messages to the monitor as
+ * pointers, and the monitor hands them on to subscribers in the manager the
+ * same way, instead of each hop going through TCPROS.
+ */
+template<class Specs>
+class MonitorNodelet
+    : public nodelet::Nodelet
+{
+public:
+    ~MonitorNodelet() {
+        if (m_monitor)
+            m_monitor->stop();
+    }
+
+private:
+    void onInit() override {
+        m_monitor.emplace(getNodeHandle(), getPrivateNodeHandle());
+        m_specs.emplace(*m_monitor);
+        m_monitor->start();
+    }
+
+    boost::optional<Monitor> m_monitor;
+    boost::optional<Specs> m_specs;
+};
+
+}
+}
+
+#endif
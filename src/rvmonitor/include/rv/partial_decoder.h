@@ -0,0 +1,223 @@
+#ifndef RV_PARTIAL_DECODER_H
+#define RV_PARTIAL_DECODER_H
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <boost/array.hpp>
+#include <ros/duration.h>
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <ros/time.h>
+
+namespace rv {
+namespace monitor {
+
+/* The fields of a message that its handlers read, kept as byte ranges
+ * relative to the start of the message object so that they apply to any
+ * instance of the message type.
+ */
+class FieldSelection
+{
+public:
+    struct Range {
+        size_t offset;
+        size_t size;
+    };
+
+    explicit FieldSelection(void const* message)
+        : m_base(static_cast<char const*>(message))
+    {
+    }
+
+    template<class Field>
+    void add(Field const& field) {
+        m_ranges.push_back(Range{ size_t(reinterpret_cast<char const*>(&field) - m_base), sizeof(Field) });
+    }
+
+    std::vector<Range> const& ranges() const {
+        return m_ranges;
+    }
+
+private:
+    char const* m_base;
+    std::vector<Range> m_ranges;
+};
+
+/* Adds the fields that a group of handlers reads from a message */
+template<class MessageType>
+using FieldSelector = void (*)(FieldSelection&, MessageType const&);
+
+namespace detail {
+
+namespace ser = ros::serialization;
+
+template<class T>
+struct IsFixed
+    : std::integral_constant<bool, std::is_arithmetic<T>::value || ros::message_traits::IsFixedSize<T>::value>
+{};
+template<> struct IsFixed<ros::Time> : std::true_type {};
+template<> struct IsFixed<ros::Duration> : std::true_type {};
+template<class T, size_t N> struct IsFixed<boost::array<T, N>> : IsFixed<T> {};
+template<class T, class A> struct IsFixed<std::vector<T, A>> : std::false_type {};
+template<class C, class Tr, class A> struct IsFixed<std::basic_string<C, Tr, A>> : std::false_type {};
+
+/* Serialized size of a fixed-size type, computed once per type */
+template<class T>
+uint32_t fixedLength() {
+    static uint32_t const length = ser::serializationLength(T());
+    return length;
+}
+
+/* Advance a stream past a serialized value without storing it. The value
+ * argument only selects the overload and is never written.
+ */
+template<class T> void skip(ser::IStream& in, T& value);
+template<class C, class Tr, class A> void skip(ser::IStream& in, std::basic_string<C, Tr, A>& value);
+template<class T, class A> void skip(ser::IStream& in, std::vector<T, A>& value);
+template<class T, size_t N> void skip(ser::IStream& in, boost::array<T, N>& value);
+
+/* Walks a message's fields through its serializer, skipping each of them */
+struct SkipStream
+{
+    ser::IStream& in;
+
+    template<class T>
+    void next(T& field) {
+        skip(in, field);
+    }
+};
+
+template<class T>
+void skipElements(ser::IStream& in, uint32_t count) {
+    if (IsFixed<T>::value) {
+        in.advance(count * fixedLength<T>());
+        return;
+    }
+    T scratch;
+    for (uint32_t i = 0; i < count; ++i) { skip(in, scratch); }
+}
+
+template<class T>
+void skipValue(ser::IStream& in, T&, std::true_type) {
+    in.advance(fixedLength<T>());
+}
+
+template<class T>
+void skipValue(ser::IStream& in, T& value, std::false_type) {
+    SkipStream stream{ in };
+    ser::Serializer<T>::read(stream, value);
+}
+
+template<class T>
+void skip(ser::IStream& in, T& value) {
+    skipValue(in, value, std::integral_constant<bool, IsFixed<T>::value>());
+}
+
+template<class C, class Tr, class A>
+void skip(ser::IStream& in, std::basic_string<C, Tr, A>&) {
+    uint32_t length;
+    in.next(length);
+    in.advance(length);
+}
+
+template<class T, class A>
+void skip(ser::IStream& in, std::vector<T, A>&) {
+    uint32_t count;
+    in.next(count);
+    skipElements<T>(in, count);
+}
+
+template<class T, size_t N>
+void skip(ser::IStream& in, boost::array<T, N>&) {
+    skipElements<T>(in, N);
+}
+
+/* A stream for a message's serializer that decodes the selected fields,
+ * descends into messages containing a selected field and skips the rest.
+ */
+class PartialIStream
+{
+public:
+    PartialIStream( uint8_t* data, uint32_t size, void const* root, size_t root_size
+                  , std::vector<FieldSelection::Range> const& ranges)
+        : m_in(data, size)
+        , m_root(static_cast<char const*>(root))
+        , m_root_size(root_size)
+        , m_ranges(ranges)
+    {
+    }
+
+    template<class T>
+    void next(T& field) {
+        switch (classify(&field, sizeof(T))) {
+            case Decode:  m_in.next(field); break;
+            case Descend: ser::Serializer<T>::read(*this, field); break;
+            case Skip:    skip(m_in, field); break;
+        }
+    }
+
+    uint8_t* advance(uint32_t length) { return m_in.advance(length); }
+    uint8_t* getData() { return m_in.getData(); }
+    uint32_t getLength() { return m_in.getLength(); }
+
+private:
+    enum Action { Decode, Descend, Skip };
+
+    Action classify(void const* field, size_t size) const {
+        char const* address = static_cast<char const*>(field);
+        // Locals of the serializers and elements of containers are not part of
+        // the message object; they belong to a value being decoded.
+        if (address < m_root || address + size > m_root + m_root_size) {
+            return Decode;
+        }
+        size_t const offset = address - m_root;
+        bool descend = false;
+        for (FieldSelection::Range const& range: m_ranges) {
+            if (range.offset <= offset && offset + size <= range.offset + range.size) {
+                return Decode;
+            }
+            if (offset <= range.offset && range.offset + range.size <= offset + size) {
+                descend = true;
+            }
+        }
+        return descend ? Descend : Skip;
+    }
+
+    ser::IStream m_in;
+    char const* const m_root;
+    size_t const m_root_size;
+    std::vector<FieldSelection::Range> const& m_ranges;
+};
+
+}
+
+/* Decodes only the selected fields of a serialized MessageType.
+ *
+ * Fixed-size fields that are not selected are skipped with a single
+ * precomputed advance, strings and arrays by reading their length only.
+ * Fields that are not selected keep whatever value the target held before.
+ */
+template<class MessageType>
+class PartialDecoder
+{
+public:
+    explicit PartialDecoder(FieldSelection const& selection)
+        : m_ranges(selection.ranges())
+    {
+    }
+
+    void decode(uint8_t* data, uint32_t size, MessageType& message) const {
+        detail::PartialIStream stream(data, size, &message, sizeof(MessageType), m_ranges);
+        stream.next(message);
+    }
+
+private:
+    std::vector<FieldSelection::Range> m_ranges;
+};
+
+}
+}
+
+#endif
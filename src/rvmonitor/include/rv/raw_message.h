@@ -0,0 +1,92 @@
+#ifndef RV_RAW_MESSAGE_H
+#define RV_RAW_MESSAGE_H
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <boost/shared_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+
+namespace rv {
+namespace monitor {
+
+/* The serialized bytes of a MessageType.
+ *
+ * Like topic_tools::ShapeShifter, but typed: it advertises the MD5 sum,
+ * data type and definition of MessageType, so it can be subscribed to and
+ * published on a MessageType topic while only ever copying bytes.
+ */
+template<class MessageType>
+struct RawMessage
+{
+    boost::shared_array<uint8_t> data;
+    uint32_t size = 0;
+
+    boost::shared_ptr<std::map<std::string, std::string>> __connection_header;
+
+    void deserialize(MessageType& message) const {
+        ros::serialization::IStream stream(data.get(), size);
+        ros::serialization::deserialize(stream, message);
+    }
+};
+
+}
+}
+
+namespace ros {
+namespace message_traits {
+
+template<class M>
+struct IsMessage<rv::monitor::RawMessage<M>> : TrueType {};
+
+template<class M>
+struct MD5Sum<rv::monitor::RawMessage<M>>
+{
+    static const char* value() { return MD5Sum<M>::value(); }
+    static const char* value(rv::monitor::RawMessage<M> const&) { return value(); }
+};
+
+template<class M>
+struct DataType<rv::monitor::RawMessage<M>>
+{
+    static const char* value() { return DataType<M>::value(); }
+    static const char* value(rv::monitor::RawMessage<M> const&) { return value(); }
+};
+
+template<class M>
+struct Definition<rv::monitor::RawMessage<M>>
+{
+    static const char* value() { return Definition<M>::value(); }
+    static const char* value(rv::monitor::RawMessage<M> const&) { return value(); }
+};
+
+}
+
+namespace serialization {
+
+template<class M>
+struct Serializer<rv::monitor::RawMessage<M>>
+{
+    template<typename Stream>
+    inline static void write(Stream& stream, rv::monitor::RawMessage<M> const& m) {
+        std::memcpy(stream.advance(m.size), m.data.get(), m.size);
+    }
+
+    template<typename Stream>
+    inline static void read(Stream& stream, rv::monitor::RawMessage<M>& m) {
+        m.size = stream.getLength();
+        m.data.reset(new uint8_t[m.size]);
+        std::memcpy(m.data.get(), stream.advance(m.size), m.size);
+    }
+
+    inline static uint32_t serializedLength(rv::monitor::RawMessage<M> const& m) {
+        return m.size;
+    }
+};
+
+}
+}
+
+#endif
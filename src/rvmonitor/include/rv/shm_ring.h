@@ -0,0 +1,118 @@
+#ifndef RV_SHM_RING_H
+#define RV_SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace rv
+{
+/* A ring of fixed size message slots in a POSIX shared memory segment, with
+ * one writer and any number of readers in other processes of the host.
+ *
+ * The writer never waits for readers: like UDPROS, a reader that falls more
+ * than a ring behind loses the oldest messages. Readers sleep on a futex in
+ * the segment, which the writer only wakes when someone waits. Each message
+ * is copied once into its slot and once out of it, without system calls.
+ */
+class ShmRing
+{
+public:
+  static constexpr uint32_t DefaultSlots = 16;
+  static constexpr uint32_t DefaultSlotSize = 4 << 20;
+
+  /* Where a reader is in the ring */
+  struct Cursor
+  {
+    uint64_t next = 0;
+    uint64_t lost = 0;
+  };
+
+  enum class ReadResult
+  {
+    Message,
+    Timeout,
+    Closed
+  };
+
+  /* Create and own the segment name, removing it on destruction. A segment
+   * of that name left behind by a process that is gone is replaced. Returns
+   * nullptr if the segment is in use, or its memory cannot be allocated.
+   */
+  static std::unique_ptr<ShmRing> create(std::string const& name, uint32_t slots = DefaultSlots,
+                                         uint32_t slot_size = DefaultSlotSize);
+
+  /* Map an existing segment to read from it. Returns nullptr if it does not
+   * exist or is not a ring.
+   */
+  static std::unique_ptr<ShmRing> open(std::string const& name);
+
+  ShmRing(ShmRing const&) = delete;
+  ShmRing& operator=(ShmRing const&) = delete;
+  ~ShmRing();
+
+  std::string const& name() const
+  {
+    return segment_name;
+  }
+  uint32_t slotSize() const;
+
+  /* Writer: reserve a slot for a message of size bytes, fill it and commit.
+   * Returns nullptr if the message does not fit in a slot.
+   */
+  uint8_t* beginWrite(uint32_t size);
+  void commitWrite();
+  bool write(void const* data, uint32_t size);
+
+  /* Writer: wake all readers and make them return Closed */
+  void close();
+
+  /* A cursor at the next message to be written */
+  Cursor tail() const;
+
+  /* Reader: wait up to timeout_ms for the message at cursor and copy it out
+   * with allocate(size), which returns where to copy to.
+   */
+  template <typename Allocate>
+  ReadResult read(Cursor& cursor, Allocate allocate, int timeout_ms)
+  {
+    uint32_t size;
+    uint8_t const* data;
+    ReadResult result;
+    while ((result = acquire(cursor, data, size, timeout_ms)) == ReadResult::Message)
+    {
+      uint8_t* target = allocate(size);
+      std::memcpy(target, data, size);
+      if (release(cursor))
+      {
+        return result;
+      }
+    }
+    return result;
+  }
+
+private:
+  struct Header;
+  struct Slot;
+
+  ShmRing(std::string const& name, int owner_fd, void* memory, size_t length);
+
+  Slot& slot(uint64_t index) const;
+  ReadResult acquire(Cursor& cursor, uint8_t const*& data, uint32_t& size, int timeout_ms);
+  bool release(Cursor& cursor);
+
+  std::string const segment_name;
+  /* The creator keeps the segment open and locked, so that other processes
+   * can tell it is in use; -1 for readers
+   */
+  int const owner_fd;
+  void* const memory;
+  size_t const length;
+  Header* const header;
+};
+}
+
+#endif
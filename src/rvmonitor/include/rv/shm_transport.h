@@ -0,0 +1,65 @@
+#ifndef RV_SHM_TRANSPORT_H
+#define RV_SHM_TRANSPORT_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <ros/forwards.h>
+#include <xmlrpcpp/XmlRpcValue.h>
+
+/* SHMROS: messages of a topic passed through an rv::ShmRing between processes
+ * on one host.
+ *
+ * A subscriber offers ["SHMROS", <host identity>] in requestTopic. A
+ * publisher on the same host that serves the topic from a ring answers with
+ * ["SHMROS", <segment name>, <connection header>], and the subscriber then
+ * reads the ring instead of opening a socket. Both ends are monitors of
+ * this runtime; other nodes keep using TCPROS or UDPROS.
+ */
+namespace rv
+{
+/* Equal for processes that share the POSIX shared memory of one host */
+std::string shmHostIdentity();
+
+/* The name of the ring a monitor of this process republishes topic into */
+std::string shmSegmentForTopic(std::string const& topic);
+
+/* Answers requestTopic for the topics this process serves from a ring, and
+ * hands every other request to roscpp.
+ */
+class ShmTopicServer
+{
+public:
+  ShmTopicServer();
+  ~ShmTopicServer();
+
+  ShmTopicServer(ShmTopicServer const&) = delete;
+  ShmTopicServer& operator=(ShmTopicServer const&) = delete;
+
+  /* Offer topic from the ring segment, whose messages have the given md5sum and type */
+  void add(std::string const& topic, std::string const& segment, std::string const& md5sum,
+           std::string const& type);
+
+private:
+  void requestTopic(XmlRpc::XmlRpcValue& params, XmlRpc::XmlRpcValue& result);
+
+  struct Served
+  {
+    std::string segment;
+    XmlRpc::XmlRpcValue header;
+  };
+
+  std::mutex mutex;
+  std::map<std::string, Served> served;
+  ros::TopicManagerPtr topic_manager;
+};
+
+/* Feed the messages of the ring named in an SHMROS answer to subscription,
+ * from a thread of its own, as a publisher link for xmlrpc_uri. Returns the
+ * link, or null if the ring cannot be opened.
+ */
+ros::PublisherLinkPtr connectSharedMemory(ros::SubscriptionPtr const& subscription, std::string const& xmlrpc_uri,
+                                          XmlRpc::XmlRpcValue& proto);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef RV_STATE_HISTORY_H
+#define RV_STATE_HISTORY_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+namespace rv {
+namespace monitor {
+
+/* The last Capacity states pushed, for properties over a bounded window of
+ * the past such as bounded-time response or derivative estimates.
+ *
+ * The states live in one cache line aligned buffer allocated on
+ * construction; push() overwrites the oldest state once the history is
+ * full and never allocates. history[0] is the newest state and
+ * history[size() - 1] the oldest.
+ */
+template<typename S, size_t Capacity>
+class StateHistory
+{
+public:
+    static_assert(Capacity > 0, "StateHistory needs room for at least one state");
+
+    static constexpr size_t CacheLine = 64;
+
+    StateHistory()
+        : m_buffer(new unsigned char[Capacity * sizeof(S) + CacheLine])
+        , m_next(0)
+        , m_size(0)
+    {
+        void* start = m_buffer.get();
+        size_t space = Capacity * sizeof(S) + CacheLine;
+        m_states = static_cast<S*>(std::align(CacheLine, Capacity * sizeof(S), start, space));
+    }
+
+    StateHistory(StateHistory const&) = delete;
+    StateHistory& operator=(StateHistory const&) = delete;
+
+    ~StateHistory() { clear(); }
+
+    size_t size() const { return m_size; }
+    static constexpr size_t capacity() { return Capacity; }
+    bool empty() const { return m_size == 0; }
+    bool full() const { return m_size == Capacity; }
+
+    void push(S const& state) {
+        if (full()) {
+            m_states[m_next] = state;
+        }
+        else {
+            new (&m_states[m_next]) S(state);
+            ++m_size;
+        }
+        m_next = m_next + 1 == Capacity ? 0 : m_next + 1;
+    }
+
+    /* The state pushed age pushes ago, 0 being the newest */
+    S& operator[](size_t age) { return m_states[slot(age)]; }
+    S const& operator[](size_t age) const { return m_states[slot(age)]; }
+
+    S const& at(size_t age) const {
+        if (age >= m_size) {
+            throw std::out_of_range("rv::monitor::StateHistory::at");
+        }
+        return (*this)[age];
+    }
+
+    S const& newest() const { return (*this)[0]; }
+    S const& oldest() const { return (*this)[m_size - 1]; }
+
+    void clear() {
+        for (size_t age = 0; age < m_size; ++age) {
+            (*this)[age].~S();
+        }
+        m_next = 0;
+        m_size = 0;
+    }
+
+private:
+    size_t slot(size_t age) const {
+        return m_next > age ? m_next - 1 - age : m_next + Capacity - 1 - age;
+    }
+
+    std::unique_ptr<unsigned char[]> m_buffer;
+    S* m_states;
+    size_t m_next;
+    size_t m_size;
+};
+
+template<typename S, size_t Capacity>
+constexpr size_t StateHistory<S, Capacity>::CacheLine;
+
+}
+}
+
+#endif
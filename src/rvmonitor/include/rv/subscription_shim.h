@@ -1,11 +1,56 @@
 #ifndef RV_SUBSCRIPTION_SHIM
 #define RV_SUBSCRIPTION_SHIM
 
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 #include "ros/ros.h"
+#include "rv/shm_ring.h"
 
 namespace rv { class SubscriptionShim; }
 
+namespace rv
+{
+struct TransportOptions
+{
+  ros::TransportHints hints;
+
+  /* Offer SHMROS before the transports of hints, and serve the topic's
+   * republications over SHMROS (see rv/shm_transport.h)
+   */
+  bool shared_memory = false;
+  uint32_t shm_slots = ShmRing::DefaultSlots;
+  uint32_t shm_slot_size = ShmRing::DefaultSlotSize;
+
+  /* The transports of topic from the private parameter ~transports/<topic>:
+   * "shm", "udp", "tcp" or "tcp_nodelay", or several of them separated by
+   * spaces in order of preference. Defaults to TCP. The ring of a shared
+   * memory topic has ~shm/<topic>/slots slots of ~shm/<topic>/slot_size
+   * bytes.
+   */
+  static TransportOptions fromParams(ros::NodeHandle const& private_n, std::string const& topic);
+};
+
+struct ConnectionStats
+{
+  /* Publishers linked to, and links to them; any excess are duplicates */
+  size_t publishers;
+  size_t links;
+  /* Links made and dropped by SubscriptionShim::reconcile */
+  uint64_t connects;
+  uint64_t disconnects;
+  /* Attempts to connect again after a failure, and publishers waiting for one */
+  uint64_t reconnects;
+  size_t retrying;
+};
+}
+
 /* This shim creates connections to nodes for a topic (connectTopic) that
  * this node is not subscribed to. A second topic (handlerTopic) is used
  * to handle these connections.
@@ -14,18 +59,90 @@ struct rv::SubscriptionShim
 {
 public:
   SubscriptionShim(std::string const& connectTopic, std::string const& handlerTopic);
+  ~SubscriptionShim();
+
+  /* Publishers are asked for a connection at most this many at a time,
+   * each with RequestTimeout seconds to answer.
+   */
+  static constexpr size_t MaxInFlight = 8;
+  static constexpr double RequestTimeout = 5.0;
+
+  /* A publisher that could not be reached, or whose connection dropped, is
+   * connected to again after a backoff that starts at MinBackoff seconds and
+   * doubles up to MaxBackoff, halved at random to spread the attempts of many
+   * monitors. At most MaxRetries publishers wait for an attempt at a time;
+   * the others are left to the next publisherUpdate.
+   */
+  static constexpr double MinBackoff = 0.1;
+  static constexpr double MaxBackoff = 20.0;
+  static constexpr size_t MaxRetries = 32;
 
   bool connect(std::string const& uri);
+
+  /* Connect to each of uris. The requestTopic round trips run concurrently,
+   * so this takes about as long as the slowest publisher. Returns the number
+   * of publishers connected to.
+   */
+  size_t connectAll(std::vector<std::string> const& uris);
   bool connectToPublishers();
 
+  /* Make uris the exact set of publishers the shim links to: connect to the
+   * ones without a link, and drop its links to publishers not in uris as
+   * well as duplicate links. Links the subscription made itself are left
+   * alone unless they go to a publisher in uris. Only publishers in uris are
+   * retried. Returns the number of new connections.
+   */
+  size_t reconcile(std::vector<std::string> const& uris);
+
+  ConnectionStats connectionStats();
+
+  void offerSharedMemory(bool offer) { shared_memory = offer; }
+
 private:
-  ros::SubscriptionPtr getSubscriptionForTopic(std::string const& topic);
-  bool executeRequestTopic(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue& proto);
-  bool startROSTCPConnection(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue proto);
+  struct Reconnects;
+
+  /* Connects to the publishers whose backoff ran out until destruction */
+  void retryLoop();
+  /* Publishers the shim has a link to */
+  std::set<std::string> linkedPublishers(ros::SubscriptionPtr const& subscription);
+  /* Record link as made by the shim, rather than by the subscription for handlerTopic */
+  void adopt(ros::PublisherLinkPtr const& link);
+  bool owns(ros::PublisherLinkPtr const& link);
+  /* Drop the link when its connection drops and schedule a new connection,
+   * rather than leave the link to retry with the header of handlerTopic.
+   */
+  void watchConnection(ros::ConnectionPtr const& connection, ros::PublisherLinkPtr const& link,
+                       std::string const& xmlrpc_uri);
+
+  /* The subscription to handlerTopic, looked up once and again only after
+   * it is dropped.
+   */
+  ros::SubscriptionPtr getSubscription();
+  bool executeRequestTopic(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue& proto,
+                           ros::TransportUDPPtr& udp_transport);
+  bool callRequestTopic(std::string const& host, uint32_t port, XmlRpc::XmlRpcValue const& params,
+                        XmlRpc::XmlRpcValue& result);
+  bool startConnection(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue proto,
+                       ros::TransportUDPPtr udp_transport);
+  bool startROSTCPConnection(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue& proto);
+  bool startUDPROSConnection(ros::SubscriptionPtr subscription, std::string const& xmlrpc_uri, XmlRpc::XmlRpcValue& proto,
+                             ros::TransportUDPPtr udp_transport);
 
   std::string const connectTopic;
   std::string const handlerTopic;
   ros::TopicManagerPtr topic_manager;
+  ros::SubscriptionWPtr handler_subscription;
+  std::atomic<uint64_t> connects;
+  std::atomic<uint64_t> disconnects;
+  std::atomic<uint64_t> reconnects_made;
+  bool shared_memory;
+  /* Serializes reconcile and the connections of retryLoop */
+  std::mutex connect_mutex;
+  /* Taken inside the subscription's publisher_links_mutex_ */
+  std::mutex links_mutex;
+  std::map<ros::PublisherLink const*, ros::PublisherLinkWPtr> own_links;
+  std::shared_ptr<Reconnects> reconnects;
+  std::thread retry_thread;
 };
 
 
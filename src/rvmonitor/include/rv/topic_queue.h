@@ -0,0 +1,211 @@
+#ifndef RV_TOPIC_QUEUE_H
+#define RV_TOPIC_QUEUE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <ros/callback_queue_interface.h>
+#include <ros/init.h>
+#include <ros/node_handle.h>
+
+namespace rv {
+namespace monitor {
+
+/* What a monitored topic does with a message that arrives while its queue is full */
+enum class QueuePolicy
+{
+  KeepLatest,  // Hold only the newest message
+  DropOldest,  // Hold up to depth messages, dropping the oldest
+  ByteBudget,  // Hold up to byte_budget serialized bytes, dropping the oldest
+  Block        // Hold up to depth messages, stalling the receiving thread
+};
+
+/* A depth of 0 holds a single message, as keep_latest does */
+struct QueueOptions
+{
+  QueuePolicy policy;
+  size_t depth;
+  size_t byte_budget;
+
+  /* Drop the oldest of 1000 messages, as roscpp does by default */
+  QueueOptions();
+
+  static QueueOptions keepLatest();
+  static QueueOptions dropOldest(size_t depth);
+  static QueueOptions byteBudget(size_t bytes);
+  static QueueOptions block(size_t depth);
+
+  /* Override options with the private parameters ~queues/<topic>/policy,
+   * ~queues/<topic>/depth and ~queues/<topic>/bytes, if set.
+   */
+  static QueueOptions fromParams(ros::NodeHandle const& private_n, std::string const& topic, QueueOptions options);
+};
+
+/* Returns false if name is not one of keep_latest, drop_oldest, byte_budget or block */
+bool parseQueuePolicy(std::string const& name, QueuePolicy& policy);
+char const* queuePolicyName(QueuePolicy policy);
+
+struct QueueStats
+{
+  uint64_t received;
+  uint64_t dropped;
+  size_t messages;  // Currently queued
+  size_t bytes;
+  size_t peak_messages;
+  size_t peak_bytes;
+};
+
+/* Bounded queue of received messages of a single topic.
+ *
+ * Messages are pushed by the thread receiving them and popped by the thread
+ * handling the topic. Pushing never grows the queue past its options: the
+ * oldest messages are dropped, or with QueuePolicy::Block the receiving
+ * thread waits for the handler to catch up. A blocking topic must therefore
+ * be received on a thread of its own (see MonitorTopic::start()). The wait
+ * gives up once the queue is closed or ROS is shutting down.
+ */
+template<class Item>
+class TopicQueue
+{
+public:
+  explicit TopicQueue(QueueOptions const& options)
+    : options(options)
+    , bytes(0)
+    , pending_pops(0)
+    , closed(false)
+    , counters()
+  {
+  }
+
+  /* Returns true if the caller must schedule a pop() for the new item */
+  bool push(Item item, size_t size)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ++counters.received;
+    if (options.policy == QueuePolicy::Block)
+    {
+      while (items.size() >= limit() && !closed && !ros::isShuttingDown())
+      {
+        space.wait_for(lock, std::chrono::milliseconds(100));
+      }
+    }
+    while (!items.empty() && full(size))
+    {
+      bytes -= items.front().second;
+      items.pop_front();
+      ++counters.dropped;
+    }
+
+    items.emplace_back(std::move(item), size);
+    bytes += size;
+    counters.peak_messages = std::max(counters.peak_messages, items.size());
+    counters.peak_bytes = std::max(counters.peak_bytes, bytes);
+
+    // Dropped messages leave their pops scheduled, so schedule at most one per item
+    if (pending_pops >= items.size())
+    {
+      return false;
+    }
+    ++pending_pops;
+    return true;
+  }
+
+  /* Take the oldest item. Call once for every push() that returned true. */
+  bool pop(Item& item)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    --pending_pops;
+    if (items.empty())
+    {
+      return false;
+    }
+    item = std::move(items.front().first);
+    bytes -= items.front().second;
+    items.pop_front();
+    space.notify_one();
+    return true;
+  }
+
+  /* Stop waiting for room in push(). Later pushes drop the oldest message instead. */
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    space.notify_all();
+  }
+
+  QueueOptions const& getOptions() const
+  {
+    return options;
+  }
+
+  QueueStats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    QueueStats ret = counters;
+    ret.messages = items.size();
+    ret.bytes = bytes;
+    return ret;
+  }
+
+private:
+  size_t limit() const
+  {
+    return options.policy == QueuePolicy::KeepLatest ? 1 : std::max<size_t>(options.depth, 1);
+  }
+
+  bool full(size_t size) const
+  {
+    if (options.policy == QueuePolicy::ByteBudget)
+    {
+      return bytes + size > options.byte_budget;
+    }
+    return items.size() >= limit();
+  }
+
+  QueueOptions const options;
+
+  mutable std::mutex mutex;
+  std::condition_variable space;
+  std::deque<std::pair<Item, size_t>> items;
+  size_t bytes;
+  size_t pending_pops;
+  bool closed;
+  QueueStats counters;
+};
+
+/* Callback queue that runs callbacks as soon as they are added.
+ *
+ * A subscription using it hands every message to its callback on the thread
+ * that received it, leaving all queueing to a TopicQueue.
+ */
+class InlineCallbackQueue : public ros::CallbackQueueInterface
+{
+public:
+  void addCallback(ros::CallbackInterfacePtr const& callback, uint64_t owner_id = 0) override;
+  void removeByID(uint64_t owner_id) override;
+};
+
+/* Callback running a function, added to a callback queue once per message to handle */
+class FunctionCallback : public ros::CallbackInterface
+{
+public:
+  explicit FunctionCallback(std::function<void()> function);
+
+  CallResult call() override;
+
+private:
+  std::function<void()> function;
+};
+
+}
+}
+
+#endif
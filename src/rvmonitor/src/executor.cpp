@@ -0,0 +1,259 @@
+#include "rv/executor.h"
+
+#include <chrono>
+#include <boost/make_shared.hpp>
+#include <ros/callback_queue_interface.h>
+#include <ros/console.h>
+
+using namespace std;
+using namespace rv::monitor;
+
+namespace
+{
+/* The executor whose worker runs on this thread, if any, and the worker's index */
+thread_local TopicExecutor const* current_executor = nullptr;
+thread_local unsigned current_worker = 0;
+
+/* How long a worker waits before retrying a callback that was not ready */
+chrono::milliseconds const NotReadyBackoff(1);
+}
+
+TopicCallbackQueue::TopicCallbackQueue(TopicExecutor& executor, std::string const& topic)
+  : executor(executor)
+  , topic_name(topic)
+  , scheduled(false)
+  , calling_thread(std::thread::id())
+{
+}
+
+std::string const& TopicCallbackQueue::topic() const
+{
+  return topic_name;
+}
+
+void TopicCallbackQueue::addCallback(ros::CallbackInterfacePtr const& callback, uint64_t owner_id)
+{
+  {
+    lock_guard<std::mutex> lock(mutex);
+    callbacks.push_back(Entry{ callback, owner_id });
+    if (scheduled)
+    {
+      return;
+    }
+    scheduled = true;
+  }
+  executor.schedule(this);
+}
+
+void TopicCallbackQueue::removeByID(uint64_t owner_id)
+{
+  // Wait for a callback in flight to finish, unless it is the one removing itself
+  unique_lock<std::mutex> call_lock(call_mutex, defer_lock);
+  if (calling_thread.load() != this_thread::get_id())
+  {
+    call_lock.lock();
+  }
+
+  lock_guard<std::mutex> lock(mutex);
+  for (auto it = callbacks.begin(); it != callbacks.end();)
+  {
+    if (it->owner_id == owner_id)
+    {
+      it = callbacks.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+TopicCallbackQueue::BatchResult TopicCallbackQueue::runBatch(size_t max_callbacks)
+{
+  lock_guard<std::mutex> call_lock(call_mutex);
+  calling_thread = this_thread::get_id();
+
+  bool retry = false;
+
+  for (size_t i = 0; i < max_callbacks; ++i)
+  {
+    Entry entry;
+    {
+      lock_guard<std::mutex> lock(mutex);
+      if (callbacks.empty())
+      {
+        break;
+      }
+      entry = callbacks.front();
+      callbacks.pop_front();
+    }
+
+    ros::CallbackInterface::CallResult result = ros::CallbackInterface::TryAgain;
+    if (entry.callback->ready())
+    {
+      result = entry.callback->call();
+    }
+    if (result == ros::CallbackInterface::TryAgain)
+    {
+      // Keep the topic's order: retry this callback before any later one
+      lock_guard<std::mutex> lock(mutex);
+      callbacks.push_front(entry);
+      retry = true;
+      break;
+    }
+  }
+
+  calling_thread = std::thread::id();
+
+  lock_guard<std::mutex> lock(mutex);
+  if (callbacks.empty())
+  {
+    scheduled = false;
+    return BatchResult::Idle;
+  }
+  return retry ? BatchResult::NotReady : BatchResult::More;
+}
+
+TopicExecutor::TopicExecutor(unsigned worker_count, size_t batch_size)
+  : batch_size(batch_size)
+  , pending(0)
+  , running(false)
+  , next_worker(0)
+{
+  if (worker_count == 0)
+  {
+    worker_count = 1;
+  }
+  for (unsigned i = 0; i < worker_count; ++i)
+  {
+    workers.emplace_back(new Worker());
+  }
+}
+
+TopicExecutor::~TopicExecutor()
+{
+  stop();
+}
+
+TopicCallbackQueuePtr TopicExecutor::queueForTopic(std::string const& topic)
+{
+  lock_guard<std::mutex> lock(queues_mutex);
+  auto it = queues.find(topic);
+  if (it != queues.end())
+  {
+    return it->second;
+  }
+  TopicCallbackQueuePtr queue = boost::make_shared<TopicCallbackQueue>(*this, topic);
+  queues.insert({ topic, queue });
+  return queue;
+}
+
+unsigned TopicExecutor::workerCount() const
+{
+  return workers.size();
+}
+
+void TopicExecutor::start()
+{
+  if (running.exchange(true))
+  {
+    return;
+  }
+  ROS_DEBUG("Starting monitor executor with %u workers", workerCount());
+  for (unsigned i = 0; i < workers.size(); ++i)
+  {
+    threads.emplace_back(&TopicExecutor::workerLoop, this, i);
+  }
+}
+
+void TopicExecutor::stop()
+{
+  if (!running.exchange(false))
+  {
+    return;
+  }
+  {
+    lock_guard<std::mutex> lock(idle_mutex);
+    idle_cv.notify_all();
+  }
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+  threads.clear();
+}
+
+void TopicExecutor::schedule(TopicCallbackQueue* queue)
+{
+  // Queues rescheduled by one of our workers stay with it; new work, including
+  // work scheduled from another executor's worker, is spread round-robin
+  unsigned index = current_executor == this ? current_worker : next_worker++ % workers.size();
+  {
+    lock_guard<std::mutex> lock(workers[index]->mutex);
+    workers[index]->ready.push_back(queue);
+  }
+  lock_guard<std::mutex> lock(idle_mutex);
+  ++pending;
+  idle_cv.notify_one();
+}
+
+TopicCallbackQueue* TopicExecutor::take(unsigned index)
+{
+  TopicCallbackQueue* queue = nullptr;
+  {
+    lock_guard<std::mutex> lock(workers[index]->mutex);
+    if (!workers[index]->ready.empty())
+    {
+      queue = workers[index]->ready.front();
+      workers[index]->ready.pop_front();
+    }
+  }
+
+  // Steal from the back of the other workers' deques
+  for (unsigned i = 1; !queue && i < workers.size(); ++i)
+  {
+    Worker& victim = *workers[(index + i) % workers.size()];
+    lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.ready.empty())
+    {
+      queue = victim.ready.back();
+      victim.ready.pop_back();
+    }
+  }
+
+  if (queue)
+  {
+    lock_guard<std::mutex> lock(idle_mutex);
+    --pending;
+  }
+  return queue;
+}
+
+void TopicExecutor::workerLoop(unsigned index)
+{
+  current_executor = this;
+  current_worker = index;
+  while (running)
+  {
+    TopicCallbackQueue* queue = take(index);
+    if (!queue)
+    {
+      unique_lock<std::mutex> lock(idle_mutex);
+      idle_cv.wait_for(lock, chrono::milliseconds(100), [this] { return !running || pending > 0; });
+      continue;
+    }
+    TopicCallbackQueue::BatchResult const result = queue->runBatch(batch_size);
+    if (result == TopicCallbackQueue::BatchResult::NotReady)
+    {
+      // Retrying at once would spin until the callback is ready. Wait a
+      // little first, unless new work or stop() wakes the worker earlier.
+      unique_lock<std::mutex> lock(idle_mutex);
+      idle_cv.wait_for(lock, NotReadyBackoff);
+    }
+    if (result != TopicCallbackQueue::BatchResult::Idle)
+    {
+      schedule(queue);
+    }
+  }
+  current_executor = nullptr;
+}
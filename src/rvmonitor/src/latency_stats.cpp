@@ -0,0 +1,138 @@
+#include "rv/latency_stats.h"
+
+#include <cstdio>
+#include <sstream>
+#include <ros/this_node.h>
+
+using namespace std;
+using namespace rv::monitor;
+
+namespace
+{
+string microseconds(uint64_t ns)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.1f", ns / 1000.0);
+  return buffer;
+}
+
+void addValue(diagnostic_msgs::DiagnosticStatus& status, string const& key, string const& value)
+{
+  diagnostic_msgs::KeyValue entry;
+  entry.key = key;
+  entry.value = value;
+  status.values.push_back(entry);
+}
+
+void addHistogram(diagnostic_msgs::DiagnosticStatus& status, string const& name, LatencyHistogram const& histogram)
+{
+  LatencySummary const summary = histogram.summary();
+  addValue(status, name + "/count", to_string(summary.count));
+  if (summary.count == 0)
+  {
+    return;
+  }
+  addValue(status, name + "/mean_us", microseconds(summary.mean_ns));
+  addValue(status, name + "/p50_us", microseconds(summary.p50_ns));
+  addValue(status, name + "/p90_us", microseconds(summary.p90_ns));
+  addValue(status, name + "/p99_us", microseconds(summary.p99_ns));
+  addValue(status, name + "/p99.9_us", microseconds(summary.p999_ns));
+  addValue(status, name + "/max_us", microseconds(summary.max_ns));
+}
+
+void describeHistogram(ostringstream& out, string const& name, LatencyHistogram const& histogram)
+{
+  LatencySummary const summary = histogram.summary();
+  out << "  " << name << ": " << summary.count << " samples";
+  if (summary.count != 0)
+  {
+    out << ", mean " << microseconds(summary.mean_ns) << "us, p50 " << microseconds(summary.p50_ns) << "us, p90 "
+        << microseconds(summary.p90_ns) << "us, p99 " << microseconds(summary.p99_ns) << "us, p99.9 "
+        << microseconds(summary.p999_ns) << "us, max " << microseconds(summary.max_ns) << "us";
+  }
+  out << "\n";
+}
+}
+
+TopicLatency::TopicLatency(std::vector<std::string> handler_names)
+  : handler_names(std::move(handler_names))
+  , handlers(new LatencyHistogram[this->handler_names.size()])
+{
+}
+
+StatsReporter::StatsReporter(ros::NodeHandle& n, ros::WallDuration period,
+                             std::function<std::vector<TopicStats>()> collect)
+  : collect(std::move(collect))
+{
+  publisher = n.advertise<diagnostic_msgs::DiagnosticArray>("/rv/stats", 1);
+  service = n.advertiseService("/rv/get_stats", &StatsReporter::trigger, this);
+  timer = n.createWallTimer(period, &StatsReporter::publish, this);
+}
+
+void StatsReporter::publish(ros::WallTimerEvent const&)
+{
+  if (publisher.getNumSubscribers() == 0)
+  {
+    return;
+  }
+  diagnostic_msgs::DiagnosticArray array;
+  array.header.stamp = ros::Time::now();
+  for (TopicStats const& stats : collect())
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "rvmonitor: " + stats.topic;
+    status.hardware_id = ros::this_node::getName();
+    addValue(status, "queue/received", to_string(stats.queue.received));
+    addValue(status, "queue/dropped", to_string(stats.queue.dropped));
+    addValue(status, "queue/peak_messages", to_string(stats.queue.peak_messages));
+    addValue(status, "pool/hits", to_string(stats.pool.hits));
+    addValue(status, "pool/misses", to_string(stats.pool.misses));
+    addValue(status, "links/publishers", to_string(stats.connections.publishers));
+    addValue(status, "links/duplicates", to_string(stats.connections.links - stats.connections.publishers));
+    addValue(status, "links/connects", to_string(stats.connections.connects));
+    addValue(status, "links/disconnects", to_string(stats.connections.disconnects));
+    addValue(status, "links/reconnects", to_string(stats.connections.reconnects));
+    addValue(status, "links/retrying", to_string(stats.connections.retrying));
+    if (stats.latency)
+    {
+      addHistogram(status, "receive_to_publish", stats.latency->receive_to_publish);
+      addHistogram(status, "end_to_end", stats.latency->end_to_end);
+      for (size_t i = 0; i < stats.latency->handler_names.size(); ++i)
+      {
+        addHistogram(status, "handlers/" + stats.latency->handler_names[i], stats.latency->handlers[i]);
+      }
+    }
+    array.status.push_back(status);
+  }
+  publisher.publish(array);
+}
+
+bool StatsReporter::trigger(std_srvs::Trigger::Request&, std_srvs::Trigger::Response& response)
+{
+  response.success = true;
+  response.message = summary();
+  return true;
+}
+
+std::string StatsReporter::summary() const
+{
+  ostringstream out;
+  for (TopicStats const& stats : collect())
+  {
+    out << stats.topic << ": " << stats.queue.received << " received, " << stats.queue.dropped << " dropped, "
+        << stats.pool.misses << " pool misses, " << stats.connections.publishers << " publishers, "
+        << stats.connections.links - stats.connections.publishers << " duplicate links\n";
+    if (!stats.latency)
+    {
+      continue;
+    }
+    describeHistogram(out, "receive to publish", stats.latency->receive_to_publish);
+    describeHistogram(out, "end to end", stats.latency->end_to_end);
+    for (size_t i = 0; i < stats.latency->handler_names.size(); ++i)
+    {
+      describeHistogram(out, stats.latency->handler_names[i], stats.latency->handlers[i]);
+    }
+  }
+  return out.str();
+}
@@ -51,9 +51,7 @@ bool PubUpdateShim::pubUpdate(std::string topic, const std::vector<std::string>
   string const monitor_topic_prefix = "/rv/monitored";
   if (boost::starts_with(topic, monitor_topic_prefix)) {
     topic = topic.substr(monitor_topic_prefix.size());
-    for (auto uri: uris) {
-        monitor.monitored_topics.at(topic)->subscription_shim.connect(uri);
-    }
+    monitor.monitored_topics.at(topic)->subscription_shim.reconcile(uris);
     return true;
   }
 
@@ -0,0 +1,315 @@
+#include "rv/shm_ring.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace rv;
+
+constexpr uint32_t ShmRing::DefaultSlots;
+constexpr uint32_t ShmRing::DefaultSlotSize;
+
+namespace
+{
+uint32_t const Magic = 0x72767368;  // "rvsh"
+size_t const CacheLine = 64;
+
+size_t roundUp(size_t size)
+{
+  return (size + CacheLine - 1) / CacheLine * CacheLine;
+}
+
+/* Remove segment name if the process that created it is gone, which leaves
+ * its lock on the segment free. The creator takes the lock right after
+ * creating the segment, so a free lock is only trusted a while later.
+ */
+bool unlinkAbandoned(std::string const& name)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    return errno == ENOENT;
+  }
+  bool abandoned = false;
+  if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+  {
+    flock(fd, LOCK_UN);
+    usleep(10000);
+    abandoned = flock(fd, LOCK_EX | LOCK_NB) == 0;
+  }
+  if (abandoned)
+  {
+    shm_unlink(name.c_str());
+  }
+  ::close(fd);
+  return abandoned;
+}
+
+void futexWait(std::atomic<uint32_t>& word, uint32_t seen, int timeout_ms)
+{
+  timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<uint32_t>& word)
+{
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+}
+
+/* Slot i of the ring holds message i, i + slots, ... Its sequence is
+ * 2 * index + 1 while message index is written and 2 * index + 2 once it
+ * is complete, so a reader can tell whether its copy was overwritten.
+ */
+struct ShmRing::Header
+{
+  uint32_t magic;
+  uint32_t slots;
+  uint32_t slot_size;
+  uint32_t stride;
+  std::atomic<uint64_t> written;   // Messages committed
+  std::atomic<uint32_t> notify;    // Futex word, bumped by every commit and close
+  std::atomic<uint32_t> waiters;   // Readers sleeping on notify
+  std::atomic<uint32_t> closed;
+};
+
+struct ShmRing::Slot
+{
+  std::atomic<uint64_t> sequence;
+  uint32_t size;
+  uint32_t reserved;
+
+  uint8_t* data()
+  {
+    return reinterpret_cast<uint8_t*>(this) + sizeof(Slot);
+  }
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && ATOMIC_LLONG_LOCK_FREE == 2,
+              "rv::ShmRing needs lock-free atomics in shared memory");
+
+std::unique_ptr<ShmRing> ShmRing::create(std::string const& name, uint32_t slots, uint32_t slot_size)
+{
+  if (slots == 0 || sizeof(Slot) + slot_size + CacheLine > UINT32_MAX)
+  {
+    return nullptr;
+  }
+  size_t const stride = roundUp(sizeof(Slot) + slot_size);
+  size_t const length = roundUp(sizeof(Header)) + stride * slots;
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST && unlinkAbandoned(name))
+  {
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  // Hold the lock for as long as the segment is in use, and allocate its pages
+  // up front: a segment that only has its size set faults with SIGBUS on the
+  // first write to a page the file system has no room for
+  void* memory = MAP_FAILED;
+  if (flock(fd, LOCK_EX | LOCK_NB) == 0 && posix_fallocate(fd, 0, length) == 0)
+  {
+    memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (memory == MAP_FAILED)
+  {
+    shm_unlink(name.c_str());
+    ::close(fd);
+    return nullptr;
+  }
+
+  // The segment starts out zeroed, so every slot and counter is at 0
+  Header* header = static_cast<Header*>(memory);
+  header->slots = slots;
+  header->slot_size = slot_size;
+  header->stride = stride;
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = Magic;
+  return std::unique_ptr<ShmRing>(new ShmRing(name, fd, memory, length));
+}
+
+std::unique_ptr<ShmRing> ShmRing::open(std::string const& name)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    return nullptr;
+  }
+  struct stat status;
+  void* memory = MAP_FAILED;
+  if (fstat(fd, &status) == 0 && size_t(status.st_size) >= roundUp(sizeof(Header)))
+  {
+    memory = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (memory == MAP_FAILED)
+  {
+    return nullptr;
+  }
+
+  Header const* header = static_cast<Header const*>(memory);
+  size_t const length = status.st_size;
+  if (header->magic != Magic || roundUp(sizeof(Header)) + size_t(header->stride) * header->slots > length)
+  {
+    munmap(memory, length);
+    return nullptr;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return std::unique_ptr<ShmRing>(new ShmRing(name, -1, memory, length));
+}
+
+ShmRing::ShmRing(std::string const& name, int owner_fd, void* memory, size_t length)
+  : segment_name(name), owner_fd(owner_fd), memory(memory), length(length), header(static_cast<Header*>(memory))
+{
+}
+
+ShmRing::~ShmRing()
+{
+  if (owner_fd >= 0)
+  {
+    close();
+    shm_unlink(segment_name.c_str());
+    ::close(owner_fd);
+  }
+  munmap(memory, length);
+}
+
+uint32_t ShmRing::slotSize() const
+{
+  return header->slot_size;
+}
+
+ShmRing::Slot& ShmRing::slot(uint64_t index) const
+{
+  uint8_t* slots = static_cast<uint8_t*>(memory) + roundUp(sizeof(Header));
+  return *reinterpret_cast<Slot*>(slots + size_t(index % header->slots) * header->stride);
+}
+
+uint8_t* ShmRing::beginWrite(uint32_t size)
+{
+  if (size > header->slot_size)
+  {
+    return nullptr;
+  }
+  uint64_t const index = header->written.load(std::memory_order_relaxed);
+  Slot& target = slot(index);
+  target.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  target.size = size;
+  return target.data();
+}
+
+void ShmRing::commitWrite()
+{
+  uint64_t const index = header->written.load(std::memory_order_relaxed);
+  slot(index).sequence.store(2 * index + 2, std::memory_order_release);
+  header->written.store(index + 1, std::memory_order_seq_cst);
+  header->notify.fetch_add(1, std::memory_order_seq_cst);
+  if (header->waiters.load(std::memory_order_seq_cst) != 0)
+  {
+    futexWakeAll(header->notify);
+  }
+}
+
+bool ShmRing::write(void const* data, uint32_t size)
+{
+  uint8_t* target = beginWrite(size);
+  if (!target)
+  {
+    return false;
+  }
+  std::memcpy(target, data, size);
+  commitWrite();
+  return true;
+}
+
+void ShmRing::close()
+{
+  header->closed.store(1, std::memory_order_seq_cst);
+  header->notify.fetch_add(1, std::memory_order_seq_cst);
+  futexWakeAll(header->notify);
+}
+
+ShmRing::Cursor ShmRing::tail() const
+{
+  Cursor cursor;
+  cursor.next = header->written.load(std::memory_order_acquire);
+  return cursor;
+}
+
+ShmRing::ReadResult ShmRing::acquire(Cursor& cursor, uint8_t const*& data, uint32_t& size, int timeout_ms)
+{
+  bool waited = false;
+  for (;;)
+  {
+    uint32_t const seen = header->notify.load(std::memory_order_seq_cst);
+    uint64_t const written = header->written.load(std::memory_order_seq_cst);
+    if (written != cursor.next)
+    {
+      if (written - cursor.next > header->slots)
+      {
+        // Fell a whole ring behind, skip to the oldest message still there
+        cursor.lost += written - cursor.next - header->slots;
+        cursor.next = written - header->slots;
+      }
+      Slot& source = slot(cursor.next);
+      if (source.sequence.load(std::memory_order_acquire) != 2 * cursor.next + 2)
+      {
+        // Already being overwritten
+        ++cursor.lost;
+        ++cursor.next;
+        continue;
+      }
+      size = source.size;
+      data = source.data();
+      if (size > header->slot_size)
+      {
+        // Torn by a writer that started overwriting the slot since
+        ++cursor.lost;
+        ++cursor.next;
+        continue;
+      }
+      return ReadResult::Message;
+    }
+    if (header->closed.load(std::memory_order_seq_cst))
+    {
+      return ReadResult::Closed;
+    }
+    if (waited)
+    {
+      return ReadResult::Timeout;
+    }
+
+    header->waiters.fetch_add(1, std::memory_order_seq_cst);
+    if (header->written.load(std::memory_order_seq_cst) == cursor.next && !header->closed.load())
+    {
+      futexWait(header->notify, seen, timeout_ms);
+    }
+    header->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    waited = true;
+  }
+}
+
+bool ShmRing::release(Cursor& cursor)
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  bool const intact = slot(cursor.next).sequence.load(std::memory_order_relaxed) == 2 * cursor.next + 2;
+  if (!intact)
+  {
+    ++cursor.lost;
+  }
+  ++cursor.next;
+  return intact;
+}
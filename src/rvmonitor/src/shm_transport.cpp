@@ -0,0 +1,314 @@
+#include "rv/shm_transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+#include "ros/header.h"
+#include "ros/ros.h"
+#include "rv/shm_ring.h"
+
+/* Allow usage of private members of internal ros APIs
+ * WARNING: This is undefined behaviour.
+ */
+#define private public
+#define protected public
+#include "ros/publisher_link.h"
+#include "ros/subscription.h"
+#include "ros/topic_manager.h"
+#include "ros/xmlrpc_manager.h"
+#undef private
+#undef protected
+
+using namespace std;
+using namespace ros;
+using namespace rv;
+using namespace XmlRpc;
+
+namespace
+{
+/* How long the reader sleeps at most before checking whether it was dropped */
+int const ReadTimeoutMs = 100;
+
+/* A publisher link whose messages come from an ShmRing. A thread of its own
+ * reads the ring until the link is dropped or the ring is closed by its
+ * writer, and drop() waits for it.
+ */
+class ShmPublisherLink : public PublisherLink
+{
+public:
+  ShmPublisherLink(SubscriptionPtr const& parent, string const& xmlrpc_uri, TransportHints const& hints,
+                   unique_ptr<ShmRing> ring)
+    : PublisherLink(parent, xmlrpc_uri, hints), ring(std::move(ring)), dropped(false), destroyed_by_reader(nullptr)
+  {
+  }
+
+  ~ShmPublisherLink()
+  {
+    dropped = true;
+    lock_guard<std::mutex> lock(reader_mutex);
+    if (reader.joinable())
+    {
+      // The reader released the last reference, and returns once told so
+      if (reader.get_id() == this_thread::get_id())
+      {
+        *destroyed_by_reader = true;
+        reader.detach();
+      }
+      else
+      {
+        reader.join();
+      }
+    }
+  }
+
+  void start()
+  {
+    self = boost::static_pointer_cast<ShmPublisherLink>(shared_from_this());
+    lock_guard<std::mutex> lock(reader_mutex);
+    reader = thread([this] { run(); });
+  }
+
+  string getTransportType()
+  {
+    return "SHMROS";
+  }
+
+  string getTransportInfo()
+  {
+    return "SHMROS connection on segment " + ring->name() + " to [" + publisher_xmlrpc_uri_ + "]";
+  }
+
+  void drop()
+  {
+    leave();
+    lock_guard<std::mutex> lock(reader_mutex);
+    if (reader.joinable() && reader.get_id() != this_thread::get_id())
+    {
+      reader.join();
+    }
+  }
+
+  void handleMessage(SerializedMessage const& m, bool ser, bool nocopy)
+  {
+    stats_.bytes_received_ += m.num_bytes;
+    stats_.messages_received_++;
+    if (SubscriptionPtr parent = parent_.lock())
+    {
+      stats_.drops_ += parent->handleMessage(m, ser, nocopy, header_.getValues(), shared_from_this());
+    }
+  }
+
+private:
+  /* Stop reading and remove the link from the subscription, once */
+  void leave()
+  {
+    if (dropped.exchange(true))
+    {
+      return;
+    }
+    if (SubscriptionPtr parent = parent_.lock())
+    {
+      parent->removePublisherLink(shared_from_this());
+    }
+  }
+
+  void run()
+  {
+    bool destroyed = false;
+    destroyed_by_reader = &destroyed;
+
+    // Start at the newest message, as a latched publisher would
+    ShmRing::Cursor cursor = ring->tail();
+    if (cursor.next > 0)
+    {
+      --cursor.next;
+    }
+    while (!dropped)
+    {
+      boost::shared_array<uint8_t> buffer;
+      uint32_t size = 0;
+      uint64_t const lost = cursor.lost;
+      ShmRing::ReadResult const result = ring->read(cursor,
+                                                    [&buffer, &size](uint32_t message_size) {
+                                                      size = message_size;
+                                                      buffer.reset(new uint8_t[size]);
+                                                      return buffer.get();
+                                                    },
+                                                    ReadTimeoutMs);
+      // Messages overwritten before they were read count as dropped
+      stats_.drops_ += cursor.lost - lost;
+      if (result == ShmRing::ReadResult::Timeout)
+      {
+        continue;
+      }
+
+      // Handling a message needs a reference to the link. Without one, the
+      // link is being destroyed and waits for this thread to return.
+      {
+        boost::shared_ptr<ShmPublisherLink> link = self.lock();
+        if (!link)
+        {
+          return;
+        }
+        if (result == ShmRing::ReadResult::Closed)
+        {
+          link->leave();
+          return;
+        }
+        link->handleMessage(SerializedMessage(buffer, size), true, false);
+      }
+      // Releasing the reference may have destroyed the link on this thread
+      if (destroyed)
+      {
+        return;
+      }
+    }
+  }
+
+  unique_ptr<ShmRing> const ring;
+  atomic<bool> dropped;
+  boost::weak_ptr<ShmPublisherLink> self;
+  std::mutex reader_mutex;
+  thread reader;
+  // Set in the reader's frame when the link is destroyed on its thread
+  bool* destroyed_by_reader;
+};
+}
+
+string rv::shmHostIdentity()
+{
+  // The boot of the kernel and the IPC namespace, which holds /dev/shm
+  string boot_id;
+  ifstream("/proc/sys/kernel/random/boot_id") >> boot_id;
+  char ipc[64] = {};
+  ssize_t const length = readlink("/proc/self/ns/ipc", ipc, sizeof(ipc) - 1);
+  if (boot_id.empty() || length <= 0)
+  {
+    return string();
+  }
+  return boot_id + "/" + string(ipc, length);
+}
+
+string rv::shmSegmentForTopic(string const& topic)
+{
+  string segment = "/rv" + topic + "." + to_string(getpid());
+  replace(segment.begin() + 1, segment.end(), '/', '.');
+  return segment;
+}
+
+ShmTopicServer::ShmTopicServer() : topic_manager(TopicManager::instance())
+{
+  XMLRPCManagerPtr xmlrpc_manager = XMLRPCManager::instance();
+  xmlrpc_manager->unbind("requestTopic");
+  xmlrpc_manager->bind("requestTopic", boost::bind(&ShmTopicServer::requestTopic, this, _1, _2));
+}
+
+ShmTopicServer::~ShmTopicServer()
+{
+  XMLRPCManagerPtr xmlrpc_manager = XMLRPCManager::instance();
+  xmlrpc_manager->unbind("requestTopic");
+  xmlrpc_manager->bind("requestTopic",
+                       boost::bind(&TopicManager::requestTopicCallback, topic_manager.get(), _1, _2));
+}
+
+void ShmTopicServer::add(string const& topic, string const& segment, string const& md5sum, string const& type)
+{
+  M_string fields;
+  fields["callerid"] = this_node::getName();
+  fields["topic"] = topic;
+  fields["md5sum"] = md5sum;
+  fields["type"] = type;
+  fields["latching"] = "1";
+  boost::shared_array<uint8_t> buffer;
+  uint32_t length;
+  Header::write(fields, buffer, length);
+
+  lock_guard<std::mutex> lock(mutex);
+  served[topic] = Served{ segment, XmlRpcValue(buffer.get(), length) };
+}
+
+void ShmTopicServer::requestTopic(XmlRpcValue& params, XmlRpcValue& result)
+{
+  if (params.getType() == XmlRpcValue::TypeArray && params.size() == 3 &&
+      params[1].getType() == XmlRpcValue::TypeString && params[2].getType() == XmlRpcValue::TypeArray)
+  {
+    string const topic = params[1];
+    string const host = shmHostIdentity();
+    for (int i = 0; i < params[2].size(); ++i)
+    {
+      XmlRpcValue& proto = params[2][i];
+      if (proto.getType() != XmlRpcValue::TypeArray || proto.size() < 2 ||
+          proto[0].getType() != XmlRpcValue::TypeString || proto[1].getType() != XmlRpcValue::TypeString ||
+          static_cast<string&>(proto[0]) != "SHMROS")
+      {
+        continue;
+      }
+      if (host.empty() || static_cast<string&>(proto[1]) != host)
+      {
+        break;
+      }
+      lock_guard<std::mutex> lock(mutex);
+      auto it = served.find(topic);
+      if (it == served.end())
+      {
+        break;
+      }
+      XmlRpcValue shmros;
+      shmros[0] = string("SHMROS");
+      shmros[1] = it->second.segment;
+      shmros[2] = it->second.header;
+      result[0] = 1;
+      result[1] = string("ready on SHMROS");
+      result[2] = shmros;
+      return;
+    }
+  }
+  topic_manager->requestTopicCallback(params, result);
+}
+
+PublisherLinkPtr rv::connectSharedMemory(SubscriptionPtr const& subscription, string const& xmlrpc_uri,
+                                         XmlRpcValue& proto)
+{
+  if (proto.size() != 3 || proto[1].getType() != XmlRpcValue::TypeString ||
+      proto[2].getType() != XmlRpcValue::TypeBase64)
+  {
+    ROSCPP_LOG_DEBUG("publisher implements SHMROS, but the parameters aren't string,base64");
+    return nullptr;
+  }
+  string const segment = proto[1];
+  XmlRpcValue::BinaryData const& header_bytes = proto[2];
+  boost::shared_array<uint8_t> buffer(new uint8_t[header_bytes.size()]);
+  std::copy(header_bytes.begin(), header_bytes.end(), buffer.get());
+  Header header;
+  string error;
+  if (!header.parse(buffer, header_bytes.size(), error))
+  {
+    ROSCPP_LOG_DEBUG("Unable to parse SHMROS connection header: %s", error.c_str());
+    return nullptr;
+  }
+
+  unique_ptr<ShmRing> ring = ShmRing::open(segment);
+  if (!ring)
+  {
+    ROSCPP_LOG_DEBUG("Unable to open shared memory segment [%s] of [%s]", segment.c_str(), xmlrpc_uri.c_str());
+    return nullptr;
+  }
+  boost::shared_ptr<ShmPublisherLink> link(
+      boost::make_shared<ShmPublisherLink>(subscription, xmlrpc_uri, subscription->transport_hints_, std::move(ring)));
+  if (!link->setHeader(header))
+  {
+    return nullptr;
+  }
+  {
+    boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
+    subscription->addPublisherLink(link);
+  }
+  link->start();
+  ROSCPP_CONN_LOG_DEBUG("Connected to publisher of topic [%s] at [%s] over shared memory [%s]",
+                        subscription->getName().c_str(), xmlrpc_uri.c_str(), segment.c_str());
+  return link;
+}
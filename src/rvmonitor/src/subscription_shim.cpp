@@ -1,9 +1,22 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include "ros/file_log.h"
+#include "ros/header.h"
 #include "ros/network.h"
 #include "ros/ros.h"
 #include <cstdint>
+#include "rv/shm_transport.h"
 #include "rv/subscription_shim.h"
 
 /* Allow usage of private members of internal ros APIs
@@ -18,7 +31,9 @@
 #include "ros/subscription.h"
 #include "ros/topic_manager.h"
 #include "ros/transport/transport_tcp.h"
+#include "ros/transport/transport_udp.h"
 #include "ros/transport_publisher_link.h"
+#include "ros/xmlrpc_manager.h"
 #undef private
 #undef protected
 
@@ -27,33 +42,390 @@ using namespace ros;
 using namespace rv;
 using namespace XmlRpc;
 
+constexpr size_t SubscriptionShim::MaxInFlight;
+constexpr double SubscriptionShim::RequestTimeout;
+constexpr double SubscriptionShim::MinBackoff;
+constexpr double SubscriptionShim::MaxBackoff;
+constexpr size_t SubscriptionShim::MaxRetries;
+
+namespace
+{
+/* Reaches the protected state of an XmlRpcClient, which only offers a
+ * blocking execute() without a timeout.
+ */
+struct TimedXmlRpcClient : XmlRpcClient
+{
+  /* Like XmlRpcClient::execute, but gives up after timeout seconds */
+  static bool execute(XmlRpcClient& client, char const* method, XmlRpcValue const& params, XmlRpcValue& result,
+                      double timeout)
+  {
+    static auto const dispatch = &TimedXmlRpcClient::_disp;
+    static auto const state = &TimedXmlRpcClient::_connectionState;
+
+    if (!client.executeNonBlock(method, params))
+    {
+      return false;
+    }
+    (client.*dispatch).work(timeout);
+    bool const done = client.*state == IDLE;
+    if (!done)
+    {
+      // Drop the half finished request, the next execute reconnects
+      client.close();
+    }
+    client.executeCheckDone(result);
+    return done && result.valid();
+  }
+};
+
+/* The subscriptions of this process by topic, shared by all shims. A miss
+ * or a dropped entry rebuilds the whole index with one pass over the
+ * TopicManager's subscriptions, so shims of other topics hit afterwards.
+ */
+class SubscriptionIndex
+{
+public:
+  static SubscriptionIndex& instance()
+  {
+    static SubscriptionIndex index;
+    return index;
+  }
+
+  SubscriptionPtr find(TopicManager& topic_manager, string const& topic)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    SubscriptionPtr found = lookup(topic);
+    if (!found)
+    {
+      rebuild(topic_manager);
+      found = lookup(topic);
+    }
+    return found;
+  }
+
+private:
+  SubscriptionPtr lookup(string const& topic) const
+  {
+    auto entry = subscriptions.find(topic);
+    if (entry == subscriptions.end())
+    {
+      return nullptr;
+    }
+    SubscriptionPtr subscription = entry->second.lock();
+    return subscription && !subscription->isDropped() ? subscription : nullptr;
+  }
+
+  void rebuild(TopicManager& topic_manager)
+  {
+    subscriptions.clear();
+    boost::mutex::scoped_lock lock(topic_manager.subs_mutex_);
+    for (SubscriptionPtr const& candidate : topic_manager.subscriptions_)
+    {
+      if (!candidate->isDropped())
+      {
+        subscriptions[candidate->getName()] = candidate;
+      }
+    }
+  }
+
+  boost::mutex mutex;
+  unordered_map<string, SubscriptionWPtr> subscriptions;
+};
+}
+
+TransportOptions TransportOptions::fromParams(NodeHandle const& private_n, std::string const& topic)
+{
+  TransportOptions options;
+  std::string const relative = topic.empty() || topic[0] != '/' ? topic : topic.substr(1);
+  std::string transports;
+  if (!private_n.getParam("transports/" + relative, transports))
+  {
+    return options;
+  }
+  std::istringstream names(transports);
+  std::string name;
+  while (names >> name)
+  {
+    if (name == "shm")
+      options.shared_memory = true;
+    else if (name == "udp")
+      options.hints.udp();
+    else if (name == "tcp")
+      options.hints.tcp();
+    else if (name == "tcp_nodelay")
+      options.hints.tcp().tcpNoDelay();
+    else
+      ROS_WARN("Unknown transport [%s] for [%s]", name.c_str(), topic.c_str());
+  }
+
+  int value;
+  if (private_n.getParam("shm/" + relative + "/slots", value) && value > 0)
+  {
+    options.shm_slots = value;
+  }
+  if (private_n.getParam("shm/" + relative + "/slot_size", value) && value > 0)
+  {
+    options.shm_slot_size = value;
+  }
+  return options;
+}
+
+/* The publishers of a shim waiting to be connected to again. It outlives
+ * the shim while drop listeners of its connections hold on to it, but only
+ * schedules attempts until stop().
+ */
+struct SubscriptionShim::Reconnects
+{
+  typedef std::chrono::steady_clock Clock;
+
+  /* Forget the publishers not in uris */
+  void want(std::vector<string> const& uris)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    wanted = set<string>(uris.begin(), uris.end());
+    forgetUnwanted(due);
+    forgetUnwanted(attempts);
+    forgetUnwanted(connected);
+  }
+
+  void succeeded(string const& uri)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    connected[uri] = Clock::now();
+  }
+
+  void failed(string const& uri)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping || !wanted.count(uri) || due.count(uri))
+    {
+      return;
+    }
+    if (due.size() >= MaxRetries)
+    {
+      ROS_WARN_THROTTLE(10, "Too many publishers to reconnect to, leaving [%s] to the next publisherUpdate",
+                        uri.c_str());
+      return;
+    }
+    // A connection that lasted a whole backoff starts over at the shortest
+    auto const now = Clock::now();
+    auto const link = connected.find(uri);
+    if (link != connected.end())
+    {
+      if (now - link->second >= std::chrono::duration<double>(MaxBackoff))
+      {
+        attempts.erase(uri);
+      }
+      connected.erase(link);
+    }
+    unsigned const attempt = attempts[uri]++;
+    double const backoff = std::min(MaxBackoff, MinBackoff * std::pow(2.0, std::min(attempt, 30u)));
+    double const delay = std::uniform_real_distribution<double>(backoff / 2, backoff)(random);
+    due[uri] = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(delay));
+    wakeup.notify_one();
+  }
+
+  /* Wait for the publishers whose backoff ran out; none once stopped */
+  std::vector<string> waitDue()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+      if (stopping)
+      {
+        return {};
+      }
+      auto const now = Clock::now();
+      Clock::time_point next = Clock::time_point::max();
+      std::vector<string> uris;
+      for (auto const& entry : due)
+      {
+        if (entry.second <= now)
+          uris.push_back(entry.first);
+        else
+          next = std::min(next, entry.second);
+      }
+      if (!uris.empty())
+      {
+        for (string const& uri : uris)
+        {
+          due.erase(uri);
+        }
+        return uris;
+      }
+      if (next == Clock::time_point::max())
+        wakeup.wait(lock);
+      else
+        wakeup.wait_until(lock, next);
+    }
+  }
+
+  size_t retrying()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return due.size();
+  }
+
+  void stop()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    wakeup.notify_all();
+  }
+
+private:
+  template <typename Map>
+  void forgetUnwanted(Map& by_uri)
+  {
+    for (auto it = by_uri.begin(); it != by_uri.end();)
+    {
+      if (wanted.count(it->first))
+        ++it;
+      else
+        it = by_uri.erase(it);
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping = false;
+  set<string> wanted;
+  std::map<string, Clock::time_point> due;
+  /* Failed attempts in a row, and when the last link was made */
+  std::map<string, unsigned> attempts;
+  std::map<string, Clock::time_point> connected;
+  std::minstd_rand random{ std::random_device()() };
+};
+
 SubscriptionShim::SubscriptionShim(std::string const& connectTopic, std::string const& handlerTopic)
   : connectTopic(connectTopic)
   , handlerTopic(handlerTopic)
   , topic_manager(ros::TopicManager::instance())
+  , connects(0)
+  , disconnects(0)
+  , reconnects_made(0)
+  , shared_memory(false)
+  , reconnects(std::make_shared<Reconnects>())
 {
+  retry_thread = std::thread([this] { retryLoop(); });
 }
 
-SubscriptionPtr SubscriptionShim::getSubscriptionForTopic(string const& topic)
+SubscriptionShim::~SubscriptionShim()
 {
-  if (topic_manager->isShuttingDown())
+  reconnects->stop();
+  retry_thread.join();
+}
+
+void SubscriptionShim::retryLoop()
+{
+  for (;;)
   {
-    return nullptr;
+    std::vector<string> uris = reconnects->waitDue();
+    if (uris.empty())
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> serialized(connect_mutex);
+    SubscriptionPtr subscription = getSubscription();
+    if (!subscription)
+    {
+      continue;
+    }
+    // Skip publishers reconcile linked to in the meantime
+    set<string> const linked = linkedPublishers(subscription);
+    uris.erase(std::remove_if(uris.begin(), uris.end(), [&linked](string const& uri) { return linked.count(uri); }),
+               uris.end());
+    reconnects_made += uris.size();
+    for (string const& uri : uris)
+    {
+      ROSCPP_CONN_LOG_DEBUG("Reconnecting to [%s] for topic [%s]", uri.c_str(), connectTopic.c_str());
+    }
+    connectAll(uris);
   }
+}
 
-  for (L_Subscription::iterator s = topic_manager->subscriptions_.begin(); s != topic_manager->subscriptions_.end(); ++s)
+set<string> SubscriptionShim::linkedPublishers(SubscriptionPtr const& subscription)
+{
+  set<string> linked;
+  boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
+  for (PublisherLinkPtr const& link : subscription->publisher_links_)
   {
-    SubscriptionPtr candidate = *s;
-    if (!candidate->isDropped() && candidate->getName() == topic)
+    if (owns(link))
     {
-      return candidate;
+      linked.insert(link->getPublisherXMLRPCURI());
     }
   }
-  return nullptr;
+  return linked;
 }
 
+void SubscriptionShim::adopt(PublisherLinkPtr const& link)
+{
+  std::lock_guard<std::mutex> lock(links_mutex);
+  for (auto it = own_links.begin(); it != own_links.end();)
+  {
+    if (it->second.expired())
+      it = own_links.erase(it);
+    else
+      ++it;
+  }
+  own_links[link.get()] = link;
+}
+
+bool SubscriptionShim::owns(PublisherLinkPtr const& link)
+{
+  std::lock_guard<std::mutex> lock(links_mutex);
+  auto it = own_links.find(link.get());
+  return it != own_links.end() && it->second.lock() == link;
+}
+
+void SubscriptionShim::watchConnection(ConnectionPtr const& connection, PublisherLinkPtr const& link,
+                                       std::string const& xmlrpc_uri)
+{
+  // Added before the link's own listener, so the link is dropping by the time that runs
+  std::weak_ptr<Reconnects> weak_reconnects = reconnects;
+  PublisherLinkWPtr weak_link = link;
+  connection->addDropListener(
+      [weak_reconnects, weak_link, xmlrpc_uri](ConnectionPtr const&, Connection::DropReason reason) {
+        if (reason != Connection::TransportDisconnect)
+        {
+          return;
+        }
+        if (PublisherLinkPtr dead = weak_link.lock())
+        {
+          dead->drop();
+        }
+        if (std::shared_ptr<Reconnects> reconnects = weak_reconnects.lock())
+        {
+          reconnects->failed(xmlrpc_uri);
+        }
+      });
+}
+
+SubscriptionPtr SubscriptionShim::getSubscription()
+{
+  if (topic_manager->isShuttingDown())
+  {
+    return nullptr;
+  }
+
+  SubscriptionPtr cached = handler_subscription.lock();
+  if (cached && !cached->isDropped())
+  {
+    return cached;
+  }
+  cached = SubscriptionIndex::instance().find(*topic_manager, handlerTopic);
+  handler_subscription = cached;
+  return cached;
+}
+
+/*
+ * Offer SHMROS if enabled, then the protocols of the handler subscription's
+ * transport hints in their order, as Subscription::negotiateConnection does. Offering UDPROS opens
+ * the local UDP socket; it is returned in udp_transport and closed again on
+ * failure.
+ */
 bool SubscriptionShim::executeRequestTopic(SubscriptionPtr subscription, std::string const& xmlrpc_uri,
-                                           XmlRpc::XmlRpcValue& proto)
+                                           XmlRpc::XmlRpcValue& proto, TransportUDPPtr& udp_transport)
 {
   string peer_host;
   uint32_t peer_port;
@@ -63,77 +435,231 @@ bool SubscriptionShim::executeRequestTopic(SubscriptionPtr subscription, std::st
     return false;
   }
 
-  XmlRpcValue tcpros_array, protos_array, params;
-  tcpros_array[0] = std::string("TCPROS");
-  protos_array[0] = tcpros_array;
+  XmlRpcValue protos_array, params;
+  int protos = 0;
+  std::string const host = shmHostIdentity();
+  if (shared_memory && !host.empty())
+  {
+    XmlRpcValue shmros_array;
+    shmros_array[0] = std::string("SHMROS");
+    shmros_array[1] = host;
+    protos_array[protos++] = shmros_array;
+  }
+  int const socket_protos = protos;
+  V_string const& transports = subscription->transport_hints_.getTransports();
+  for (string const& transport : transports)
+  {
+    if (transport == "UDP" && !udp_transport)
+    {
+      int max_datagram_size = subscription->transport_hints_.getMaxDatagramSize();
+      udp_transport = boost::make_shared<TransportUDP>(&PollManager::instance()->getPollSet());
+      if (!max_datagram_size)
+      {
+        max_datagram_size = udp_transport->max_datagram_size_;
+      }
+      udp_transport->createIncoming(0, false);
+
+      // The header the publisher checks is that of the topic it publishes
+      M_string header;
+      header["topic"] = connectTopic;
+      header["md5sum"] = subscription->md5sum();
+      header["callerid"] = this_node::getName();
+      header["type"] = subscription->datatype();
+      boost::shared_array<uint8_t> buffer;
+      uint32_t length;
+      Header::write(header, buffer, length);
+
+      XmlRpcValue udpros_array;
+      udpros_array[0] = std::string("UDPROS");
+      udpros_array[1] = XmlRpcValue(buffer.get(), length);
+      udpros_array[2] = network::getHost();
+      udpros_array[3] = udp_transport->getServerPort();
+      udpros_array[4] = max_datagram_size;
+      protos_array[protos++] = udpros_array;
+    }
+    else if (transport == "TCP")
+    {
+      XmlRpcValue tcpros_array;
+      tcpros_array[0] = std::string("TCPROS");
+      protos_array[protos++] = tcpros_array;
+    }
+  }
+  if (protos == socket_protos)
+  {
+    XmlRpcValue tcpros_array;
+    tcpros_array[0] = std::string("TCPROS");
+    protos_array[protos++] = tcpros_array;
+  }
   params[0] = this_node::getName();
   params[1] = connectTopic;
   params[2] = protos_array;
 
-  TransportUDPPtr udp_transport = nullptr;
-  XmlRpcClient* c = new XmlRpcClient(peer_host.c_str(), peer_port, "/");
   // Initiate the negotiation
   XmlRpcValue requestTopicResult;
-  if (!c->execute("requestTopic", params, requestTopicResult))
+  bool negotiated = callRequestTopic(peer_host, peer_port, params, requestTopicResult);
+  if (!negotiated)
   {
     ROSCPP_LOG_DEBUG("Failed to contact publisher [%s:%d] for topic [%s]", peer_host.c_str(), peer_port,
                      connectTopic.c_str());
-    delete c;
-    assert(!udp_transport);
-    return false;
   }
-
-  boost::mutex::scoped_lock lock(subscription->shutdown_mutex_);
-  if (subscription->shutting_down_ || subscription->dropped_)
+  else
   {
-    return false;
+    boost::mutex::scoped_lock lock(subscription->shutdown_mutex_);
+    negotiated = !subscription->shutting_down_ && !subscription->dropped_;
   }
 
-  if (!XMLRPCManager::instance()->validateXmlrpcResponse("requestTopic", requestTopicResult, proto))
+  if (negotiated && !XMLRPCManager::instance()->validateXmlrpcResponse("requestTopic", requestTopicResult, proto))
   {
     ROSCPP_LOG_DEBUG("Failed to contact publisher [%s:%d] for topic [%s]", peer_host.c_str(), peer_port,
                      connectTopic.c_str());
-    assert(!udp_transport);
-    return false;
+    negotiated = false;
   }
 
-  return true;
+  if (!negotiated && udp_transport)
+  {
+    udp_transport->close();
+    udp_transport.reset();
+  }
+  return negotiated;
 }
 
-bool SubscriptionShim::startROSTCPConnection(SubscriptionPtr subscription, std::string const& xmlrpc_uri,
-                                             XmlRpc::XmlRpcValue proto)
+/* Clients come from the XMLRPCManager's pool, so that they and their
+ * connections are reused across topics and calls.
+ */
+bool SubscriptionShim::callRequestTopic(std::string const& host, uint32_t port, XmlRpcValue const& params,
+                                        XmlRpcValue& result)
+{
+  XMLRPCManagerPtr xmlrpc_manager = XMLRPCManager::instance();
+  XmlRpcClient* c = xmlrpc_manager->getXMLRPCClient(host, port, "/");
+  bool const ok = TimedXmlRpcClient::execute(*c, "requestTopic", params, result, RequestTimeout);
+  xmlrpc_manager->releaseXMLRPCClient(c);
+  return ok;
+}
+
+/*
+ * Connect with the protocol the publisher chose. The UDP socket offered
+ * during negotiation is closed unless the publisher chose UDPROS.
+ */
+bool SubscriptionShim::startConnection(SubscriptionPtr subscription, std::string const& xmlrpc_uri,
+                                       XmlRpc::XmlRpcValue proto, TransportUDPPtr udp_transport)
 {
-  TransportUDPPtr udp_transport = nullptr;
-  if (proto.size() == 0)
+  std::string proto_name;
+  if (proto.getType() != XmlRpcValue::TypeArray)
+  {
+    ROSCPP_LOG_DEBUG("Available protocol info returned from %s is not a list.", xmlrpc_uri.c_str());
+  }
+  else if (proto.size() == 0)
   {
     ROSCPP_LOG_DEBUG("Couldn't agree on any common protocols with [%s] for topic [%s]", xmlrpc_uri.c_str(),
                      connectTopic.c_str());
-    assert(!udp_transport);
-    return false;
+  }
+  else if (proto[0].getType() != XmlRpcValue::TypeString)
+  {
+    ROSCPP_LOG_DEBUG("Available protocol info list doesn't have a string as its first element.");
+  }
+  else
+  {
+    proto_name = static_cast<std::string&>(proto[0]);
   }
 
-  if (proto.getType() != XmlRpcValue::TypeArray)
+  if (proto_name == "UDPROS" && udp_transport)
   {
-    ROSCPP_LOG_DEBUG("Available protocol info returned from %s is not a list.", xmlrpc_uri.c_str());
-    assert(!udp_transport);
-    return false;
+    return startUDPROSConnection(subscription, xmlrpc_uri, proto, udp_transport);
   }
+  if (udp_transport)
+  {
+    udp_transport->close();
+  }
+  if (proto_name == "SHMROS")
+  {
+    PublisherLinkPtr link = connectSharedMemory(subscription, xmlrpc_uri, proto);
+    if (!link)
+    {
+      return false;
+    }
+    adopt(link);
+    return true;
+  }
+  if (proto_name == "TCPROS")
+  {
+    return startROSTCPConnection(subscription, xmlrpc_uri, proto);
+  }
+  if (!proto_name.empty())
+  {
+    ROSCPP_LOG_DEBUG("Publisher [%s] of topic [%s] chose unsupported protocol [%s]", xmlrpc_uri.c_str(),
+                     connectTopic.c_str(), proto_name.c_str());
+  }
+  return false;
+}
 
-  if (proto[0].getType() != XmlRpcValue::TypeString)
+bool SubscriptionShim::startUDPROSConnection(SubscriptionPtr subscription, std::string const& xmlrpc_uri,
+                                             XmlRpc::XmlRpcValue& proto, TransportUDPPtr udp_transport)
+{
+  if (proto.size() != 6 || proto[1].getType() != XmlRpcValue::TypeString ||
+      proto[2].getType() != XmlRpcValue::TypeInt || proto[3].getType() != XmlRpcValue::TypeInt ||
+      proto[4].getType() != XmlRpcValue::TypeInt || proto[5].getType() != XmlRpcValue::TypeBase64)
   {
-    ROSCPP_LOG_DEBUG("Available protocol info list doesn't have a string as its first element.");
-    assert(!udp_transport);
+    ROSCPP_LOG_DEBUG("publisher implements UDPROS, but the parameters aren't string,int,int,int,base64");
+    udp_transport->close();
     return false;
   }
+  std::string pub_host = proto[1];
+  int pub_port = proto[2];
+  int conn_id = proto[3];
+  int max_datagram_size = proto[4];
+  XmlRpcValue::BinaryData const& header_bytes = proto[5];
+  boost::shared_array<uint8_t> buffer(new uint8_t[header_bytes.size()]);
+  std::copy(header_bytes.begin(), header_bytes.end(), buffer.get());
+
+  Header header;
+  std::string error;
+  if (!header.parse(buffer, header_bytes.size(), error))
+  {
+    ROSCPP_LOG_DEBUG("Unable to parse UDPROS connection header: %s", error.c_str());
+    udp_transport->close();
+    return false;
+  }
+  if (header.getValue("error", error))
+  {
+    ROSCPP_LOG_DEBUG("Received error message in header for connection to [%s]: [%s]", xmlrpc_uri.c_str(),
+                     error.c_str());
+    udp_transport->close();
+    return false;
+  }
+  ROSCPP_CONN_LOG_DEBUG("Connecting via udpros to topic [%s] at host [%s:%d] connection id [%08x] "
+                        "max_datagram_size [%d]",
+                        connectTopic.c_str(), pub_host.c_str(), pub_port, conn_id, max_datagram_size);
 
-  std::string proto_name = proto[0];
-  if (proto_name != "TCPROS")
+  TransportPublisherLinkPtr pub_link(
+      boost::make_shared<TransportPublisherLink>(subscription, xmlrpc_uri, subscription->transport_hints_));
+  if (!pub_link->setHeader(header))
   {
-    ROSCPP_LOG_DEBUG("RV Monitors only support TCPROS when RVMaster is running");
-    assert(!udp_transport);
+    udp_transport->close();
     return false;
   }
 
+  ConnectionPtr connection(boost::make_shared<Connection>());
+  connection->initialize(udp_transport, false, HeaderReceivedFunc());
+  connection->setHeader(header);
+  watchConnection(connection, pub_link, xmlrpc_uri);
+  pub_link->initialize(connection);
+
+  ConnectionManager::instance()->addConnection(connection);
+
+  adopt(pub_link);
+  {
+    boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
+    subscription->addPublisherLink(pub_link);
+  }
+
+  ROSCPP_CONN_LOG_DEBUG("Connected to publisher of topic [%s] at [%s:%d]", connectTopic.c_str(), pub_host.c_str(),
+                        pub_port);
+  return true;
+}
+
+bool SubscriptionShim::startROSTCPConnection(SubscriptionPtr subscription, std::string const& xmlrpc_uri,
+                                             XmlRpc::XmlRpcValue& proto)
+{
   if (proto.size() != 3 || proto[1].getType() != XmlRpcValue::TypeString || proto[2].getType() != XmlRpcValue::TypeInt)
   {
     ROSCPP_LOG_DEBUG("publisher implements TCPROS, but the "
@@ -150,6 +676,8 @@ bool SubscriptionShim::startROSTCPConnection(SubscriptionPtr subscription, std::
   {
     ROSCPP_CONN_LOG_DEBUG("Failed to connect to publisher of topic [%s] at [%s:%d]", connectTopic.c_str(),
                           pub_host.c_str(), pub_port);
+    transport->close();
+    return false;
   }
 
   ConnectionPtr connection(boost::make_shared<Connection>());
@@ -159,6 +687,7 @@ bool SubscriptionShim::startROSTCPConnection(SubscriptionPtr subscription, std::
   connection->initialize(transport, false, HeaderReceivedFunc());
 
   pub_link->connection_ = connection;
+  watchConnection(connection, pub_link, xmlrpc_uri);
   // slot_type is used to automatically track the TransporPublisherLink class' existence
   // and disconnect when this class' reference count is decremented to 0. It increments
   // then decrements the shared_from_this reference count around calls to the
@@ -188,6 +717,7 @@ bool SubscriptionShim::startROSTCPConnection(SubscriptionPtr subscription, std::
 
   ConnectionManager::instance()->addConnection(connection);
 
+  adopt(pub_link);
   {
     boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
     subscription->addPublisherLink(pub_link);
@@ -206,15 +736,149 @@ bool SubscriptionShim::connect(std::string const& xmlrpc_uri)
 {
   std::cerr << "Connecting to: " << xmlrpc_uri << std::endl;
   XmlRpcValue proto;
-  SubscriptionPtr subscription = getSubscriptionForTopic(handlerTopic);
-  if (!executeRequestTopic(subscription, xmlrpc_uri, proto)) return false;
-  if (!startROSTCPConnection(subscription, xmlrpc_uri, proto)) return false;
+  SubscriptionPtr subscription = getSubscription();
+  if (!subscription) return false;
+  TransportUDPPtr udp_transport;
+  if (!executeRequestTopic(subscription, xmlrpc_uri, proto, udp_transport)) return false;
+  if (!startConnection(subscription, xmlrpc_uri, proto, udp_transport)) return false;
   return true;
 }
 
+/*
+ * Negotiate with up to MaxInFlight publishers at a time, then set up the
+ * TCPROS connections on this thread in the order of uris.
+ */
+size_t SubscriptionShim::connectAll(std::vector<std::string> const& uris)
+{
+  SubscriptionPtr subscription = getSubscription();
+  if (!subscription || uris.empty())
+  {
+    return 0;
+  }
+
+  std::vector<XmlRpcValue> protos(uris.size());
+  std::vector<TransportUDPPtr> udp_transports(uris.size());
+  std::vector<char> negotiated(uris.size(), false);
+  std::atomic<size_t> next(0);
+  auto negotiate = [&]() {
+    for (size_t i = next++; i < uris.size(); i = next++)
+    {
+      negotiated[i] = executeRequestTopic(subscription, uris[i], protos[i], udp_transports[i]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  size_t const worker_count = std::min(MaxInFlight, uris.size());
+  for (size_t i = 1; i < worker_count; ++i)
+  {
+    workers.emplace_back(negotiate);
+  }
+  negotiate();
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+
+  size_t connected = 0;
+  for (size_t i = 0; i < uris.size(); ++i)
+  {
+    if (negotiated[i] && startConnection(subscription, uris[i], protos[i], udp_transports[i]))
+    {
+      reconnects->succeeded(uris[i]);
+      ++connected;
+    }
+    else
+    {
+      reconnects->failed(uris[i]);
+    }
+  }
+  return connected;
+}
+
+size_t SubscriptionShim::reconcile(std::vector<std::string> const& uris)
+{
+  reconnects->want(uris);
+  std::lock_guard<std::mutex> serialized(connect_mutex);
+  SubscriptionPtr subscription = getSubscription();
+  if (!subscription)
+  {
+    return 0;
+  }
+
+  // The shim negotiates synchronously, so the subscription's pending
+  // connections are all its own, for handlerTopic, and are not counted
+  set<string> const wanted(uris.begin(), uris.end());
+  set<string> linked;
+  std::vector<PublisherLinkPtr> stale;
+  {
+    boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
+    for (PublisherLinkPtr const& link : subscription->publisher_links_)
+    {
+      string const& uri = link->getPublisherXMLRPCURI();
+      if (!owns(link))
+      {
+        // The subscription's own link to a publisher of connectTopic carries
+        // the header of handlerTopic; it duplicates the shim's
+        if (wanted.count(uri))
+        {
+          stale.push_back(link);
+        }
+      }
+      else if (!wanted.count(uri) || !linked.insert(uri).second)
+      {
+        stale.push_back(link);
+      }
+    }
+  }
+
+  // Links remove themselves from the subscription, so drop them unlocked
+  for (PublisherLinkPtr const& link : stale)
+  {
+    ROSCPP_CONN_LOG_DEBUG("Dropping link to [%s] for topic [%s]", link->getPublisherXMLRPCURI().c_str(),
+                          connectTopic.c_str());
+    link->drop();
+  }
+  disconnects += stale.size();
+
+  std::vector<string> added;
+  for (string const& uri : uris)
+  {
+    if (linked.insert(uri).second)
+    {
+      added.push_back(uri);
+    }
+  }
+  size_t const connected = connectAll(added);
+  connects += connected;
+  return connected;
+}
+
+ConnectionStats SubscriptionShim::connectionStats()
+{
+  ConnectionStats stats{ 0, 0, connects, disconnects, reconnects_made, reconnects->retrying() };
+  SubscriptionPtr subscription = getSubscription();
+  if (!subscription)
+  {
+    return stats;
+  }
+  set<string> publishers;
+  boost::mutex::scoped_lock lock(subscription->publisher_links_mutex_);
+  for (PublisherLinkPtr const& link : subscription->publisher_links_)
+  {
+    publishers.insert(link->getPublisherXMLRPCURI());
+  }
+  stats.publishers = publishers.size();
+  stats.links = subscription->publisher_links_.size();
+  return stats;
+}
+
 bool SubscriptionShim::connectToPublishers()
 {
-  SubscriptionPtr subscription = getSubscriptionForTopic(handlerTopic);
+  SubscriptionPtr subscription = getSubscription();
+  if (!subscription)
+  {
+    return false;
+  }
 
   std::vector<string> uris;
   {
@@ -226,18 +890,16 @@ bool SubscriptionShim::connectToPublishers()
     }
   }
 
-  for (string const& uri: uris) {
-    connect(uri);
-  }
-
   {
     boost::mutex::scoped_lock lock(subscription->pending_connections_mutex_);
     auto it = subscription->pending_connections_.begin();
     auto end = subscription->pending_connections_.end();
     for (; it != end; ++it)
     {
-      connect((*it)->getRemoteURI());
+      uris.push_back((*it)->getRemoteURI());
     }
   }
+
+  connectAll(uris);
   return true;
 }
@@ -0,0 +1,129 @@
+#include "rv/topic_queue.h"
+
+#include <ros/console.h>
+
+using namespace std;
+using namespace rv::monitor;
+
+QueueOptions::QueueOptions()
+  : policy(QueuePolicy::DropOldest)
+  , depth(1000)
+  , byte_budget(0)
+{
+}
+
+QueueOptions QueueOptions::keepLatest()
+{
+  QueueOptions options;
+  options.policy = QueuePolicy::KeepLatest;
+  options.depth = 1;
+  return options;
+}
+
+QueueOptions QueueOptions::dropOldest(size_t depth)
+{
+  QueueOptions options;
+  options.depth = depth;
+  return options;
+}
+
+QueueOptions QueueOptions::byteBudget(size_t bytes)
+{
+  QueueOptions options;
+  options.policy = QueuePolicy::ByteBudget;
+  options.byte_budget = bytes;
+  return options;
+}
+
+QueueOptions QueueOptions::block(size_t depth)
+{
+  QueueOptions options;
+  options.policy = QueuePolicy::Block;
+  options.depth = depth;
+  return options;
+}
+
+QueueOptions QueueOptions::fromParams(ros::NodeHandle const& private_n, std::string const& topic,
+                                      QueueOptions options)
+{
+  std::string const prefix = "queues/" + (topic.empty() || topic[0] != '/' ? topic : topic.substr(1)) + "/";
+
+  std::string policy;
+  if (private_n.getParam(prefix + "policy", policy) && !parseQueuePolicy(policy, options.policy))
+  {
+    ROS_WARN("Unknown queue policy [%s] for [%s], using %s", policy.c_str(), topic.c_str(),
+             queuePolicyName(options.policy));
+  }
+
+  int value;
+  if (private_n.getParam(prefix + "depth", value) && value > 0)
+  {
+    options.depth = value;
+  }
+  if (private_n.getParam(prefix + "bytes", value) && value > 0)
+  {
+    options.byte_budget = value;
+  }
+  if (options.policy == QueuePolicy::ByteBudget && options.byte_budget == 0)
+  {
+    ROS_WARN("No byte budget for [%s], dropping the oldest of %lu messages instead", topic.c_str(),
+             (unsigned long)options.depth);
+    options.policy = QueuePolicy::DropOldest;
+  }
+  return options;
+}
+
+bool rv::monitor::parseQueuePolicy(std::string const& name, QueuePolicy& policy)
+{
+  if (name == "keep_latest")
+    policy = QueuePolicy::KeepLatest;
+  else if (name == "drop_oldest")
+    policy = QueuePolicy::DropOldest;
+  else if (name == "byte_budget")
+    policy = QueuePolicy::ByteBudget;
+  else if (name == "block")
+    policy = QueuePolicy::Block;
+  else
+    return false;
+  return true;
+}
+
+char const* rv::monitor::queuePolicyName(QueuePolicy policy)
+{
+  switch (policy)
+  {
+    case QueuePolicy::KeepLatest:
+      return "keep_latest";
+    case QueuePolicy::DropOldest:
+      return "drop_oldest";
+    case QueuePolicy::ByteBudget:
+      return "byte_budget";
+    case QueuePolicy::Block:
+      return "block";
+  }
+  return "unknown";
+}
+
+void InlineCallbackQueue::addCallback(ros::CallbackInterfacePtr const& callback, uint64_t)
+{
+  if (callback->ready())
+  {
+    callback->call();
+  }
+}
+
+void InlineCallbackQueue::removeByID(uint64_t)
+{
+  // Nothing is ever queued
+}
+
+FunctionCallback::FunctionCallback(std::function<void()> function)
+  : function(std::move(function))
+{
+}
+
+ros::CallbackInterface::CallResult FunctionCallback::call()
+{
+  function();
+  return Success;
+}
@@ -0,0 +1,139 @@
+#include <rv/monitor.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <geometry_msgs/Point.h>
+#include <gtest/gtest.h>
+
+using namespace rv::monitor;
+
+namespace
+{
+struct Handler
+{
+  Handler() : handled(0)
+  {
+  }
+
+  void onPoint(geometry_msgs::Point const&)
+  {
+    ++handled;
+  }
+
+  std::atomic<int> handled;
+};
+
+/* Records the size of every batch it is given */
+struct BatchHandler
+{
+  struct Batch
+  {
+    static void append(Batch& batch, geometry_msgs::Point const&)
+    {
+      ++batch.messages;
+    }
+
+    size_t size() const
+    {
+      return messages;
+    }
+
+    void clear()
+    {
+      messages = 0;
+    }
+
+    size_t messages = 0;
+  };
+
+  void onBatch(Batch& batch)
+  {
+    sizes.push_back(batch.size());
+  }
+
+  std::vector<size_t> sizes;
+};
+
+/* Poll condition for up to timeout, returning whether it held */
+template <class Condition>
+bool waitFor(Condition condition, std::chrono::seconds timeout = std::chrono::seconds(10))
+{
+  auto const deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+    {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+}
+
+TEST(MonitorTopic, shutdownReleasesAFullBlockingTopic)
+{
+  std::string const name = "/full_blocking_topic";
+  ros::NodeHandle n;
+  TopicExecutor executor(1);
+  Handler handler;
+  auto topic =
+      boost::make_shared<MonitorTopic<geometry_msgs::Point>>(n, name, 8, executor.queueForTopic(name).get());
+  topic->registerEvent(&handler, &Handler::onPoint);
+  topic->start(QueueOptions::block(1));
+
+  // From here on nothing handles the topic, as after Monitor::stop() stopped the executor
+  executor.start();
+  executor.stop();
+
+  ros::Publisher publisher = n.advertise<geometry_msgs::Point>(getMonitorSubscribedTopicForTopic(name), 10);
+  ASSERT_TRUE(waitFor([&publisher] { return publisher.getNumSubscribers() > 0; }));
+  for (int i = 0; i < 3; ++i)
+  {
+    publisher.publish(geometry_msgs::Point());
+  }
+
+  // One message fills the queue and the receive callback waits for room for the next
+  ASSERT_TRUE(waitFor([&topic] { return topic->queueStats().received >= 2; }));
+  std::future<void> stopped = std::async(std::launch::async, [&topic] { topic->shutdown(); });
+  EXPECT_EQ(std::future_status::ready, stopped.wait_for(std::chrono::seconds(5)));
+}
+
+TEST(MonitorTopic, shutdownHandlesQueuedMessagesAndFlushesPartialBatches)
+{
+  std::string const name = "/partial_batch_topic";
+  ros::NodeHandle n;
+  TopicExecutor executor(1);
+  BatchHandler handler;
+  auto topic =
+      boost::make_shared<MonitorTopic<geometry_msgs::Point>>(n, name, 8, executor.queueForTopic(name).get());
+  topic->registerBatchEvent(&handler, &BatchHandler::onBatch, BatchOptions(10));
+  topic->start(QueueOptions::dropOldest(10));
+
+  // The messages stay queued: nothing handles the topic before it shuts down
+  ros::Publisher publisher = n.advertise<geometry_msgs::Point>(getMonitorSubscribedTopicForTopic(name), 10);
+  ASSERT_TRUE(waitFor([&publisher] { return publisher.getNumSubscribers() > 0; }));
+  for (int i = 0; i < 3; ++i)
+  {
+    publisher.publish(geometry_msgs::Point());
+  }
+  ASSERT_TRUE(waitFor([&topic] { return topic->queueStats().received >= 3; }));
+
+  topic->shutdown();
+  ASSERT_EQ(1u, handler.sizes.size());
+  EXPECT_EQ(3u, handler.sizes[0]);
+
+  // Once only
+  topic->shutdown();
+  EXPECT_EQ(1u, handler.sizes.size());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_monitor_topic", ros::init_options::AnonymousName);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,184 @@
+#include <rv/partial_decoder.h>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <gtest/gtest.h>
+
+using namespace rv::monitor;
+
+namespace
+{
+template<class MessageType>
+std::vector<uint8_t> serialize(MessageType const& message)
+{
+  std::vector<uint8_t> buffer(ros::serialization::serializationLength(message));
+  ros::serialization::OStream stream(buffer.data(), buffer.size());
+  ros::serialization::serialize(stream, message);
+  return buffer;
+}
+
+template<class MessageType>
+void decode(FieldSelection const& selection, std::vector<uint8_t> buffer, MessageType& message)
+{
+  PartialDecoder<MessageType>(selection).decode(buffer.data(), buffer.size(), message);
+}
+
+geometry_msgs::PoseWithCovarianceStamped pose()
+{
+  geometry_msgs::PoseWithCovarianceStamped message;
+  message.header.seq = 7;
+  message.header.stamp = ros::Time(12, 34);
+  message.header.frame_id = "map";
+  message.pose.pose.position.x = 1.5;
+  message.pose.pose.position.y = 2.5;
+  message.pose.pose.orientation.w = 1;
+  for (size_t i = 0; i < message.pose.covariance.size(); ++i)
+  {
+    message.pose.covariance[i] = i;
+  }
+  return message;
+}
+
+diagnostic_msgs::DiagnosticArray diagnostics()
+{
+  diagnostic_msgs::DiagnosticArray message;
+  message.header.frame_id = "robot";
+  for (int i = 0; i < 3; ++i)
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = i;
+    status.name = "status " + std::to_string(i);
+    status.hardware_id = "hw";
+    for (int j = 0; j <= i; ++j)
+    {
+      diagnostic_msgs::KeyValue value;
+      value.key = "key " + std::to_string(j);
+      value.value = std::to_string(i * j);
+      status.values.push_back(value);
+    }
+    message.status.push_back(status);
+  }
+  return message;
+}
+}
+
+TEST(PartialDecoder, recordsOffsetsOfFields)
+{
+  geometry_msgs::PoseWithCovarianceStamped prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.header.stamp);
+  selection.add(prototype.pose.pose.position.y);
+
+  ASSERT_EQ(2u, selection.ranges().size());
+  EXPECT_EQ(size_t(reinterpret_cast<char*>(&prototype.header.stamp) - reinterpret_cast<char*>(&prototype)),
+            selection.ranges()[0].offset);
+  EXPECT_EQ(sizeof(ros::Time), selection.ranges()[0].size);
+  EXPECT_EQ(size_t(reinterpret_cast<char*>(&prototype.pose.pose.position.y) - reinterpret_cast<char*>(&prototype)),
+            selection.ranges()[1].offset);
+  EXPECT_EQ(sizeof(double), selection.ranges()[1].size);
+}
+
+TEST(PartialDecoder, decodesOnlySelectedFields)
+{
+  geometry_msgs::PoseWithCovarianceStamped prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.header.frame_id);
+  selection.add(prototype.pose.pose.position.y);
+
+  geometry_msgs::PoseWithCovarianceStamped decoded;
+  decode(selection, serialize(pose()), decoded);
+
+  EXPECT_EQ("map", decoded.header.frame_id);
+  EXPECT_EQ(2.5, decoded.pose.pose.position.y);
+  EXPECT_EQ(0u, decoded.header.seq);
+  EXPECT_TRUE(decoded.header.stamp.isZero());
+  EXPECT_EQ(0, decoded.pose.pose.position.x);
+  EXPECT_EQ(0, decoded.pose.pose.orientation.w);
+  EXPECT_EQ(0, decoded.pose.covariance[35]);
+}
+
+TEST(PartialDecoder, decodesFieldsAfterSkippedOnes)
+{
+  // Skipping the string and the fixed-size pose must land on the covariance
+  geometry_msgs::PoseWithCovarianceStamped prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.pose.covariance);
+
+  geometry_msgs::PoseWithCovarianceStamped decoded;
+  decode(selection, serialize(pose()), decoded);
+
+  EXPECT_TRUE(decoded.header.frame_id.empty());
+  for (size_t i = 0; i < decoded.pose.covariance.size(); ++i)
+  {
+    EXPECT_EQ(double(i), decoded.pose.covariance[i]);
+  }
+}
+
+TEST(PartialDecoder, skipsVectorsOfMessages)
+{
+  diagnostic_msgs::DiagnosticArray prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.header.stamp);
+
+  diagnostic_msgs::DiagnosticArray message = diagnostics();
+  message.header.stamp = ros::Time(5, 6);
+  diagnostic_msgs::DiagnosticArray decoded;
+  decode(selection, serialize(message), decoded);
+
+  EXPECT_EQ(ros::Time(5, 6), decoded.header.stamp);
+  EXPECT_TRUE(decoded.header.frame_id.empty());
+  EXPECT_TRUE(decoded.status.empty());
+}
+
+TEST(PartialDecoder, decodesSelectedVectorsWhole)
+{
+  diagnostic_msgs::DiagnosticArray prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.status);
+
+  diagnostic_msgs::DiagnosticArray const message = diagnostics();
+  diagnostic_msgs::DiagnosticArray decoded;
+  decode(selection, serialize(message), decoded);
+
+  EXPECT_TRUE(decoded.header.frame_id.empty());
+  ASSERT_EQ(3u, decoded.status.size());
+  EXPECT_EQ("status 2", decoded.status[2].name);
+  ASSERT_EQ(3u, decoded.status[2].values.size());
+  EXPECT_EQ("key 2", decoded.status[2].values[2].key);
+  EXPECT_EQ("4", decoded.status[2].values[2].value);
+}
+
+TEST(PartialDecoder, keepsFieldsThatAreNotSelected)
+{
+  geometry_msgs::PoseWithCovarianceStamped prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype.pose.pose.position.x);
+
+  geometry_msgs::PoseWithCovarianceStamped decoded;
+  decoded.header.frame_id = "previous";
+  decoded.pose.pose.position.z = -1;
+  decode(selection, serialize(pose()), decoded);
+
+  EXPECT_EQ(1.5, decoded.pose.pose.position.x);
+  EXPECT_EQ("previous", decoded.header.frame_id);
+  EXPECT_EQ(-1, decoded.pose.pose.position.z);
+}
+
+TEST(PartialDecoder, decodesWholeMessageWhenSelected)
+{
+  geometry_msgs::PoseWithCovarianceStamped prototype;
+  FieldSelection selection(&prototype);
+  selection.add(prototype);
+
+  geometry_msgs::PoseWithCovarianceStamped const message = pose();
+  geometry_msgs::PoseWithCovarianceStamped decoded;
+  decode(selection, serialize(message), decoded);
+
+  EXPECT_EQ(message, decoded);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,187 @@
+#include <rv/shm_ring.h>
+
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+using rv::ShmRing;
+
+namespace
+{
+/* A segment name of its own for each test, so that runs do not interfere */
+std::string segmentName(char const* test)
+{
+  return "/rv_test_" + std::to_string(getpid()) + "_" + test;
+}
+
+void writeNumber(ShmRing& ring, uint32_t number)
+{
+  ASSERT_TRUE(ring.write(&number, sizeof(number)));
+}
+
+/* Read one message into number; the result of the read */
+ShmRing::ReadResult readNumber(ShmRing& ring, ShmRing::Cursor& cursor, uint32_t& number, int timeout_ms = 0)
+{
+  std::vector<uint8_t> buffer;
+  ShmRing::ReadResult result = ring.read(cursor,
+                                         [&buffer](uint32_t size) {
+                                           buffer.resize(size);
+                                           return buffer.data();
+                                         },
+                                         timeout_ms);
+  if (result == ShmRing::ReadResult::Message)
+  {
+    EXPECT_EQ(sizeof(number), buffer.size());
+    std::memcpy(&number, buffer.data(), sizeof(number));
+  }
+  return result;
+}
+}
+
+TEST(ShmRing, ReaderGetsMessagesInOrder)
+{
+  std::unique_ptr<ShmRing> writer = ShmRing::create(segmentName("order"), 4, 64);
+  ASSERT_TRUE(writer);
+  std::unique_ptr<ShmRing> reader = ShmRing::open(writer->name());
+  ASSERT_TRUE(reader);
+  EXPECT_EQ(64u, reader->slotSize());
+
+  ShmRing::Cursor cursor = reader->tail();
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    writeNumber(*writer, i);
+  }
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    uint32_t number;
+    ASSERT_EQ(ShmRing::ReadResult::Message, readNumber(*reader, cursor, number));
+    EXPECT_EQ(i, number);
+  }
+  EXPECT_EQ(0u, cursor.lost);
+
+  uint32_t number;
+  EXPECT_EQ(ShmRing::ReadResult::Timeout, readNumber(*reader, cursor, number, 10));
+}
+
+TEST(ShmRing, ReaderBehindByMoreThanARingSkipsToTheOldestMessage)
+{
+  std::unique_ptr<ShmRing> writer = ShmRing::create(segmentName("wrap"), 4, 64);
+  ASSERT_TRUE(writer);
+  std::unique_ptr<ShmRing> reader = ShmRing::open(writer->name());
+  ASSERT_TRUE(reader);
+
+  ShmRing::Cursor cursor = reader->tail();
+  for (uint32_t i = 0; i < 11; ++i)
+  {
+    writeNumber(*writer, i);
+  }
+
+  // Messages 7 to 10 are still in the ring, in slots 3, 0, 1 and 2
+  std::vector<uint32_t> numbers;
+  uint32_t number;
+  while (readNumber(*reader, cursor, number) == ShmRing::ReadResult::Message)
+  {
+    numbers.push_back(number);
+  }
+  EXPECT_EQ(std::vector<uint32_t>({ 7, 8, 9, 10 }), numbers);
+  EXPECT_EQ(7u, cursor.lost);
+  EXPECT_EQ(11u, cursor.next);
+}
+
+TEST(ShmRing, MessageOverwrittenWhileCopiedIsDiscarded)
+{
+  std::unique_ptr<ShmRing> writer = ShmRing::create(segmentName("torn"), 2, 64);
+  ASSERT_TRUE(writer);
+  std::unique_ptr<ShmRing> reader = ShmRing::open(writer->name());
+  ASSERT_TRUE(reader);
+
+  ShmRing::Cursor cursor = reader->tail();
+  writeNumber(*writer, 0);
+
+  // The writer laps the reader while it copies message 0 out of its slot
+  std::vector<uint8_t> buffer;
+  bool lapped = false;
+  ShmRing::ReadResult result = reader->read(cursor,
+                                            [&](uint32_t size) {
+                                              if (!lapped)
+                                              {
+                                                lapped = true;
+                                                writeNumber(*writer, 1);
+                                                writeNumber(*writer, 2);
+                                              }
+                                              buffer.resize(size);
+                                              return buffer.data();
+                                            },
+                                            0);
+
+  // The torn copy of message 0 is dropped and the read returns message 1
+  ASSERT_EQ(ShmRing::ReadResult::Message, result);
+  uint32_t number;
+  std::memcpy(&number, buffer.data(), sizeof(number));
+  EXPECT_EQ(1u, number);
+  EXPECT_EQ(1u, cursor.lost);
+  EXPECT_EQ(2u, cursor.next);
+}
+
+TEST(ShmRing, MessageLargerThanASlotIsRejected)
+{
+  std::unique_ptr<ShmRing> writer = ShmRing::create(segmentName("large"), 2, 64);
+  ASSERT_TRUE(writer);
+  std::vector<uint8_t> message(65);
+  EXPECT_FALSE(writer->write(message.data(), message.size()));
+  EXPECT_TRUE(writer->write(message.data(), 64));
+}
+
+TEST(ShmRing, CloseWakesReaders)
+{
+  std::unique_ptr<ShmRing> writer = ShmRing::create(segmentName("close"), 2, 64);
+  ASSERT_TRUE(writer);
+  std::unique_ptr<ShmRing> reader = ShmRing::open(writer->name());
+  ASSERT_TRUE(reader);
+
+  ShmRing::Cursor cursor = reader->tail();
+  writer->close();
+  uint32_t number;
+  EXPECT_EQ(ShmRing::ReadResult::Closed, readNumber(*reader, cursor, number, 1000));
+}
+
+TEST(ShmRing, SegmentInUseIsNotReplaced)
+{
+  std::unique_ptr<ShmRing> first = ShmRing::create(segmentName("in_use"), 2, 64);
+  ASSERT_TRUE(first);
+  EXPECT_FALSE(ShmRing::create(first->name(), 2, 64));
+  EXPECT_TRUE(ShmRing::open(first->name()));
+}
+
+TEST(ShmRing, SegmentOfAProcessThatIsGoneIsReplaced)
+{
+  std::string const name = segmentName("abandoned");
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0)
+  {
+    // Exit without destroying the ring, leaving the segment behind
+    _exit(ShmRing::create(name, 2, 64).release() ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(child, waitpid(child, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  std::unique_ptr<ShmRing> ring = ShmRing::create(name, 2, 64);
+  EXPECT_TRUE(ring);
+}
+
+TEST(ShmRing, RingThatCannotBeAllocatedIsNotCreated)
+{
+  EXPECT_FALSE(ShmRing::create(segmentName("empty"), 0, 64));
+  EXPECT_FALSE(ShmRing::create(segmentName("huge"), UINT32_MAX, UINT32_MAX - 1024));
+  EXPECT_FALSE(ShmRing::open(segmentName("huge")));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+#include <rv/topic_queue.h>
+
+#include <atomic>
+#include <thread>
+#include <gtest/gtest.h>
+
+using namespace rv::monitor;
+
+namespace
+{
+/* Push the items 0..count-1, each size bytes, and return how many pops were scheduled */
+size_t pushAll(TopicQueue<int>& queue, int count, size_t size = 1)
+{
+  size_t scheduled = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    scheduled += queue.push(i, size);
+  }
+  return scheduled;
+}
+
+std::vector<int> popAll(TopicQueue<int>& queue, size_t scheduled)
+{
+  std::vector<int> items;
+  for (size_t i = 0; i < scheduled; ++i)
+  {
+    int item;
+    if (queue.pop(item))
+    {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+}
+
+TEST(TopicQueue, keepLatestHoldsNewestMessage)
+{
+  TopicQueue<int> queue(QueueOptions::keepLatest());
+  size_t const scheduled = pushAll(queue, 5);
+
+  EXPECT_EQ(1u, scheduled);
+  EXPECT_EQ(std::vector<int>{ 4 }, popAll(queue, scheduled));
+
+  QueueStats const stats = queue.stats();
+  EXPECT_EQ(5u, stats.received);
+  EXPECT_EQ(4u, stats.dropped);
+  EXPECT_EQ(1u, stats.peak_messages);
+  EXPECT_EQ(0u, stats.messages);
+}
+
+TEST(TopicQueue, dropOldestKeepsDepthNewestMessages)
+{
+  TopicQueue<int> queue(QueueOptions::dropOldest(3));
+  size_t const scheduled = pushAll(queue, 10);
+
+  EXPECT_EQ(3u, scheduled);
+  EXPECT_EQ((std::vector<int>{ 7, 8, 9 }), popAll(queue, scheduled));
+  EXPECT_EQ(7u, queue.stats().dropped);
+}
+
+TEST(TopicQueue, schedulesOnePopPerQueuedItem)
+{
+  TopicQueue<int> queue(QueueOptions::dropOldest(2));
+  EXPECT_TRUE(queue.push(0, 1));
+  EXPECT_TRUE(queue.push(1, 1));
+  // Drops 0, whose pop is still scheduled
+  EXPECT_FALSE(queue.push(2, 1));
+
+  int item;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(1, item);
+  EXPECT_TRUE(queue.push(3, 1));
+  EXPECT_EQ((std::vector<int>{ 2, 3 }), popAll(queue, 2));
+}
+
+TEST(TopicQueue, byteBudgetDropsOldestBytes)
+{
+  TopicQueue<int> queue(QueueOptions::byteBudget(100));
+  queue.push(0, 40);
+  queue.push(1, 40);
+  queue.push(2, 40);
+
+  QueueStats const stats = queue.stats();
+  EXPECT_EQ(1u, stats.dropped);
+  EXPECT_EQ(2u, stats.messages);
+  EXPECT_EQ(80u, stats.bytes);
+  EXPECT_EQ(80u, stats.peak_bytes);
+  EXPECT_EQ((std::vector<int>{ 1, 2 }), popAll(queue, 2));
+}
+
+TEST(TopicQueue, byteBudgetKeepsMessageLargerThanBudget)
+{
+  TopicQueue<int> queue(QueueOptions::byteBudget(100));
+  queue.push(0, 10);
+  queue.push(1, 500);
+
+  QueueStats const stats = queue.stats();
+  EXPECT_EQ(1u, stats.dropped);
+  EXPECT_EQ(1u, stats.messages);
+  EXPECT_EQ(500u, stats.bytes);
+}
+
+TEST(TopicQueue, zeroDepthHoldsOneMessage)
+{
+  TopicQueue<int> dropping(QueueOptions::dropOldest(0));
+  EXPECT_EQ(std::vector<int>{ 2 }, popAll(dropping, pushAll(dropping, 3)));
+
+  // Must not wait for room that never comes
+  TopicQueue<int> blocking(QueueOptions::block(0));
+  EXPECT_TRUE(blocking.push(0, 1));
+  std::thread consumer([&blocking] {
+    int item;
+    blocking.pop(item);
+  });
+  EXPECT_TRUE(blocking.push(1, 1));
+  consumer.join();
+  EXPECT_EQ(0u, blocking.stats().dropped);
+}
+
+TEST(TopicQueue, blockWaitsForRoom)
+{
+  TopicQueue<int> queue(QueueOptions::block(2));
+  pushAll(queue, 2);
+
+  std::atomic<bool> pushed(false);
+  std::thread producer([&] {
+    queue.push(2, 1);
+    pushed = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(pushed);
+
+  int item;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(0, item);
+  producer.join();
+  EXPECT_TRUE(pushed);
+  EXPECT_EQ((std::vector<int>{ 1, 2 }), popAll(queue, 2));
+  EXPECT_EQ(0u, queue.stats().dropped);
+}
+
+TEST(TopicQueue, closeStopsBlocking)
+{
+  TopicQueue<int> queue(QueueOptions::block(1));
+  queue.push(0, 1);
+
+  std::thread producer([&queue] { queue.push(1, 1); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.close();
+  producer.join();
+
+  EXPECT_EQ(1u, queue.stats().dropped);
+  EXPECT_EQ(std::vector<int>{ 1 }, popAll(queue, 1));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}